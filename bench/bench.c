@@ -0,0 +1,747 @@
+// Microbenchmarks for the request parser, header normalization, MIME lookup,
+// string comparison, chunked body decoding and response building, run over
+// bench/corpus.c.
+//
+// Output is tab-separated, one line per benchmark, '#' lines are comments:
+//   benchmark  ns_per_op  bytes_per_op  instructions_per_op  [ns_change_pct]
+// Instructions come from perf_event_open() and read "-" where the kernel
+// does not allow it. Save a run and pass it back with -b to get the change
+// against that baseline.
+//
+// Usage: bench [-t ms] [-f filter] [-b baseline.tsv]   (run by `make bench`)
+
+#define _GNU_SOURCE // syscall()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "corpus.h"
+#include "http_parser.h"
+#include "http_request.h"
+#include "http_mappings.h"
+#include "http_handlers.h"
+#include "http_scan.h"
+#include "http_chunked.h"
+#include "string_utils.h"
+#include "response_utils.h"
+#include "connection.h"
+#include "file_cache.h"
+#include "log.h"
+
+#define ROUNDS 5              // timed rounds per benchmark; the fastest is reported
+#define DEFAULT_ROUND_MS 40   // target duration of one round
+#define MAX_BENCHMARKS 128
+#define MAX_BASELINE 256
+
+typedef struct benchmark benchmark_t;
+
+// Run `iterations` operations. In-place operations first restore their
+// input; with `restore_only` set they do nothing else, so that cost can be
+// measured and taken out of the result.
+typedef void (*bench_fn)(const benchmark_t *bench, size_t iterations, int restore_only);
+
+struct benchmark
+{
+    char name[64];
+    bench_fn run;
+    int restores;                 // run() copies its input back every operation
+    const corpus_entry_t *entry;  // request the benchmark works on, if any
+    size_t bytes;                 // input bytes handled per operation
+};
+
+typedef struct
+{
+    double ns;
+    double instructions; // < 0 when no counter is available
+} measurement_t;
+
+static benchmark_t benchmarks[MAX_BENCHMARKS];
+static int benchmark_count;
+static volatile uint64_t sink; // keeps results observable to the compiler
+
+static char scratch[MAX_REQUEST_SIZE + 1];
+static http_request scratch_request;
+
+// ----- Header extraction -----
+
+// Header lines of a corpus request, in their original case
+typedef struct
+{
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+} corpus_header_t;
+
+typedef struct
+{
+    corpus_header_t headers[MAX_HEADERS];
+    int count;
+    size_t name_bytes;
+    size_t value_bytes;
+    char lower[MAX_HEADERS][64]; // lowercased names, for lookups
+    size_t lower_len[MAX_HEADERS];
+    const header_mapping_t *mappings[MAX_HEADERS];
+} header_set_t;
+
+#define MAX_CORPUS 32
+
+static header_set_t header_sets[MAX_CORPUS];
+
+static int noop_span(void *ctx, size_t offset, size_t len)
+{
+    (void)ctx;
+    sink += offset + len;
+    return 1;
+}
+
+static int noop_target(void *ctx, size_t offset, size_t len, size_t query_offset)
+{
+    (void)ctx;
+    sink += offset + len + query_offset;
+    return 1;
+}
+
+static int noop_header(void *ctx, size_t name_offset, size_t name_len, size_t value_offset, size_t value_len)
+{
+    (void)ctx;
+    sink += name_offset + name_len + value_offset + value_len;
+    return 1;
+}
+
+static int noop_complete(void *ctx)
+{
+    (void)ctx;
+    return 1;
+}
+
+// Tokenizer only: the parser reports spans and nothing is written
+static const http_parser_callbacks_t noop_callbacks = {
+    .on_method = noop_span,
+    .on_target = noop_target,
+    .on_version = noop_span,
+    .on_header = noop_header,
+    .on_headers_complete = noop_complete,
+};
+
+static const char *collect_text;
+
+static int collect_header(void *ctx, size_t name_offset, size_t name_len, size_t value_offset, size_t value_len)
+{
+    header_set_t *set = ctx;
+    corpus_header_t *header = &set->headers[set->count++];
+    header->name = collect_text + name_offset;
+    header->name_len = name_len;
+    header->value = collect_text + value_offset;
+    header->value_len = value_len;
+    set->name_bytes += name_len;
+    set->value_bytes += value_len;
+
+    size_t lower_len = name_len < sizeof(set->lower[0]) - 1 ? name_len : sizeof(set->lower[0]) - 1;
+    for (size_t i = 0; i < lower_len; i++)
+        set->lower[set->count - 1][i] = (char)ascii_tolower_uc((unsigned char)header->name[i]);
+    set->lower_len[set->count - 1] = lower_len;
+    set->mappings[set->count - 1] = lookup_header(set->lower[set->count - 1], lower_len);
+    return 1;
+}
+
+static void collect_headers(const corpus_entry_t *entry, header_set_t *set)
+{
+    static const http_parser_callbacks_t callbacks = {
+        .on_method = noop_span,
+        .on_target = noop_target,
+        .on_version = noop_span,
+        .on_header = collect_header,
+        .on_headers_complete = noop_complete,
+    };
+
+    http_parser_t parser;
+    http_parser_init(&parser);
+    collect_text = entry->text;
+    http_parser_execute(&parser, &callbacks, set, entry->text, strlen(entry->text));
+}
+
+static header_set_t *entry_headers(const benchmark_t *bench)
+{
+    return &header_sets[bench->entry - corpus];
+}
+
+// ----- Benchmarks -----
+
+static void bench_tokenize(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    (void)restore_only;
+    const char *text = bench->entry->text;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        http_parser_t parser;
+        http_parser_init(&parser);
+        sink += (uint64_t)http_parser_execute(&parser, &noop_callbacks, NULL, text, bench->bytes);
+    }
+}
+
+// Full parse into an http_request, normalizing names and values in place
+static void bench_parse(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    for (size_t i = 0; i < iterations; i++)
+    {
+        memcpy(scratch, bench->entry->text, bench->bytes + 1);
+        if (restore_only)
+            continue;
+
+        http_parser_t parser;
+        http_request_init(&scratch_request, scratch);
+        http_parser_init(&parser);
+        sink += (uint64_t)http_parser_execute(&parser, &http_request_parser_callbacks, &scratch_request,
+                                              scratch, bench->bytes);
+    }
+}
+
+static void bench_normalize_name(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    const header_set_t *set = entry_headers(bench);
+    for (size_t i = 0; i < iterations; i++)
+    {
+        char *p = scratch;
+        for (int h = 0; h < set->count; h++)
+        {
+            memcpy(p, set->headers[h].name, set->headers[h].name_len);
+            p[set->headers[h].name_len] = '\0';
+            if (!restore_only)
+                normalize_string_lower(p);
+            p += set->headers[h].name_len + 1;
+        }
+        sink += (uint64_t)scratch[0];
+    }
+}
+
+static void bench_normalize_value(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    const header_set_t *set = entry_headers(bench);
+    for (size_t i = 0; i < iterations; i++)
+    {
+        char *p = scratch;
+        for (int h = 0; h < set->count; h++)
+        {
+            memcpy(p, set->headers[h].value, set->headers[h].value_len);
+            p[set->headers[h].value_len] = '\0';
+            if (!restore_only)
+                normalize_header_value(set->mappings[h], p);
+            p += set->headers[h].value_len + 1;
+        }
+        sink += (uint64_t)scratch[0];
+    }
+}
+
+static void bench_lookup_header(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    (void)restore_only;
+    const header_set_t *set = entry_headers(bench);
+    for (size_t i = 0; i < iterations; i++)
+    {
+        for (int h = 0; h < set->count; h++)
+            sink += (uint64_t)lookup_header_id(set->lower[h], set->lower_len[h]);
+    }
+}
+
+static const char *const mime_paths[] = {
+    "./www/index.html", "./www/css/site.css", "./www/js/app.bundle.js", "./www/img/logo.png",
+    "./www/photos/IMG_2041.JPEG", "./www/docs/readme.txt", "./www/download/archive.tar.gz", "./www/favicon",
+};
+#define MIME_PATH_COUNT (sizeof(mime_paths) / sizeof(mime_paths[0]))
+
+static void bench_mime_type(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    (void)bench;
+    (void)restore_only;
+    for (size_t i = 0; i < iterations; i++)
+        sink += (uintptr_t)get_mime_type(mime_paths[i % MIME_PATH_COUNT]);
+}
+
+// Connection values and header names as the handlers compare them
+static const char *const case_pairs[][2] = {
+    {"keep-alive", "Keep-Alive"},
+    {"close", "keep-alive"},
+    {"content-type", "Content-Type"},
+    {"application/x-www-form-urlencoded", "application/json"},
+    {"upgrade", "Upgrade"},
+    {"text/html", "TEXT/HTML"},
+};
+#define CASE_PAIR_COUNT (sizeof(case_pairs) / sizeof(case_pairs[0]))
+
+static void bench_str_case_cmp(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    (void)bench;
+    (void)restore_only;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        const char *const *pair = case_pairs[i % CASE_PAIR_COUNT];
+        sink += (uint64_t)str_case_cmp(pair[0], pair[1]);
+    }
+}
+
+// Responses are queued on a connection that is never flushed and dropped again
+static connection_t *response_conn;
+
+// Head of a static file response. Returns the queued bytes.
+static size_t queue_file_head(size_t file_size)
+{
+    response_builder_t response;
+    response_begin(&response, 200, "OK");
+    response_add_literal(&response, "Content-Type: text/html\r\n");
+    response_add_content_length(&response, file_size);
+    response_add_connection(&response, "keep-alive");
+    response_finish(&response, response_conn, NULL, 0);
+
+    size_t queued = response_conn->out_head->remain;
+    connection_pop_chunk(response_conn);
+    return queued;
+}
+
+// Error response head plus a short body, as built for a 404
+static size_t queue_error(void)
+{
+    static const char body[] = "<html><body><h1>404 Not Found</h1></body></html>";
+    response_builder_t response;
+    response_begin(&response, 404, "Not Found");
+    response_add_literal(&response, "Content-Type: text/html\r\n");
+    response_add_content_length(&response, sizeof(body) - 1);
+    response_add_connection(&response, "close");
+    response_finish(&response, response_conn, body, sizeof(body) - 1);
+
+    size_t queued = response_conn->out_head->remain;
+    connection_pop_chunk(response_conn);
+    return queued;
+}
+
+static void bench_response_file(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    (void)bench;
+    (void)restore_only;
+    for (size_t i = 0; i < iterations; i++)
+        sink += queue_file_head(23817 + (i & 0xff));
+}
+
+static void bench_response_error(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    (void)bench;
+    (void)restore_only;
+    for (size_t i = 0; i < iterations; i++)
+        sink += queue_error();
+}
+
+// A three-range request for a file too large to be held in memory: the
+// part heads are queued between slices served from the cached fd
+#define RANGE_FILE_SIZE (2 * FILE_CACHE_MAX_BODY)
+
+static char range_path[] = "/tmp/bench-range-XXXXXX";
+static char range_text[] = "GET /range HTTP/1.1\r\n"
+                           "Host: bench\r\n"
+                           "Range: bytes=0-99,1000-1999,1500000-1509999\r\n"
+                           "\r\n";
+static http_request range_request;
+
+static int prepare_range_request(void)
+{
+    int fd = mkstemp(range_path);
+    if (fd < 0)
+        return -1;
+    int rc = ftruncate(fd, RANGE_FILE_SIZE);
+    close(fd);
+
+    http_parser_t parser;
+    http_request_init(&range_request, range_text);
+    http_parser_init(&parser);
+    if (rc < 0 || http_parser_execute(&parser, &http_request_parser_callbacks, &range_request, range_text,
+                                      strlen(range_text)) != 1)
+    {
+        unlink(range_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Multipart 206 for range_request. Returns the queued bytes.
+static size_t queue_multirange(void)
+{
+    send_file_response(response_conn, range_path, &range_request);
+
+    size_t queued = 0;
+    while (response_conn->out_head)
+    {
+        queued += response_conn->out_head->remain;
+        connection_pop_chunk(response_conn);
+    }
+    return queued;
+}
+
+static void bench_response_multirange(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    (void)bench;
+    (void)restore_only;
+    for (size_t i = 0; i < iterations; i++)
+        sink += queue_multirange();
+}
+
+static void bench_allow_header(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    (void)bench;
+    (void)restore_only;
+    for (size_t i = 0; i < iterations; i++)
+        sink += (uintptr_t)build_allow_header();
+}
+
+// ----- Chunked bodies -----
+
+#define CHUNKED_DATA 16384 // decoded bytes of the benchmark body
+#define CHUNKED_PIECE 1024 // chunk size
+#define TCP_SEGMENT 1460   // bytes per read in the segmented variant
+
+static char chunked_body[CHUNKED_DATA + 4096];
+
+// 16 chunks of 1 KB, the first with an extension, then a trailer field.
+// Returns the encoded length.
+static size_t build_chunked_body(void)
+{
+    size_t len = 0;
+    for (size_t sent = 0; sent < CHUNKED_DATA; sent += CHUNKED_PIECE)
+    {
+        len += http_chunked_head(chunked_body + len, CHUNKED_PIECE);
+        if (sent == 0)
+        {
+            len -= 2; // extension goes before the CRLF
+            len += (size_t)sprintf(chunked_body + len, ";name=\"value\"\r\n");
+        }
+        memset(chunked_body + len, 'a' + (int)(sent / CHUNKED_PIECE), CHUNKED_PIECE);
+        len += CHUNKED_PIECE;
+        memcpy(chunked_body + len, HTTP_CHUNK_END, 2);
+        len += 2;
+    }
+    len += (size_t)sprintf(chunked_body + len, "0\r\nServer-Timing: db;dur=53\r\n\r\n");
+    return len;
+}
+
+// Decode in place, fed `segment` bytes per call as a socket would deliver them
+static void decode_chunked(const benchmark_t *bench, size_t iterations, int restore_only, size_t segment)
+{
+    for (size_t i = 0; i < iterations; i++)
+    {
+        memcpy(scratch, chunked_body, bench->bytes);
+        if (restore_only)
+            continue;
+
+        http_chunked_t decoder;
+        http_chunked_init(&decoder, SIZE_MAX);
+        size_t in = 0;
+        size_t out = 0;
+        int rc = 0;
+        while (rc == 0 && in < bench->bytes)
+        {
+            size_t consumed = bench->bytes - in < segment ? bench->bytes - in : segment;
+            size_t decoded;
+            rc = http_chunked_decode(&decoder, scratch + in, &consumed, scratch + out, &decoded);
+            in += consumed;
+            out += decoded;
+        }
+        sink += (uint64_t)rc + out;
+    }
+}
+
+static void bench_chunked_decode(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    decode_chunked(bench, iterations, restore_only, SIZE_MAX);
+}
+
+static void bench_chunked_segmented(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    decode_chunked(bench, iterations, restore_only, TCP_SEGMENT);
+}
+
+// ----- Measurement -----
+
+static int instruction_counter = -1;
+
+static void open_instruction_counter(void)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // user space only: allowed at perf_event_paranoid 2
+    attr.exclude_hv = 1;
+    instruction_counter = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+// One timed round of `iterations` operations
+static measurement_t run_round(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    measurement_t m = {0, -1};
+    if (instruction_counter >= 0)
+    {
+        ioctl(instruction_counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(instruction_counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    double start = now_ns();
+    bench->run(bench, iterations, restore_only);
+    m.ns = now_ns() - start;
+
+    if (instruction_counter >= 0)
+    {
+        uint64_t count;
+        ioctl(instruction_counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(instruction_counter, &count, sizeof(count)) == sizeof(count))
+            m.instructions = (double)count;
+    }
+    m.ns /= (double)iterations;
+    if (m.instructions >= 0)
+        m.instructions /= (double)iterations;
+    return m;
+}
+
+// Fastest of ROUNDS rounds: the least disturbed by the rest of the system
+static measurement_t measure(const benchmark_t *bench, size_t iterations, int restore_only)
+{
+    measurement_t best = run_round(bench, iterations, restore_only);
+    for (int round = 1; round < ROUNDS; round++)
+    {
+        measurement_t m = run_round(bench, iterations, restore_only);
+        if (m.ns < best.ns)
+            best = m;
+    }
+    return best;
+}
+
+// Iterations that make a round last about `round_ms`
+static size_t calibrate(const benchmark_t *bench, double round_ms)
+{
+    size_t iterations = 1;
+    for (;;)
+    {
+        double start = now_ns();
+        bench->run(bench, iterations, 0);
+        double elapsed = now_ns() - start;
+        if (elapsed >= 1e6 || iterations >= ((size_t)1 << 40))
+        {
+            double scaled = (double)iterations * round_ms * 1e6 / elapsed;
+            return scaled < 1 ? 1 : (size_t)scaled;
+        }
+        iterations *= 2;
+    }
+}
+
+// ----- Setup and reporting -----
+
+static void add_benchmark(const char *prefix, const corpus_entry_t *entry, bench_fn run, int restores, size_t bytes)
+{
+    if (benchmark_count == MAX_BENCHMARKS)
+        return;
+    benchmark_t *bench = &benchmarks[benchmark_count++];
+    if (entry)
+        snprintf(bench->name, sizeof(bench->name), "%s/%s", prefix, entry->name);
+    else
+        snprintf(bench->name, sizeof(bench->name), "%s", prefix);
+    bench->run = run;
+    bench->restores = restores;
+    bench->entry = entry;
+    bench->bytes = bytes;
+}
+
+// Average length of the strings in `strings`, every `stride`-th one
+static size_t average_length(const char *const *strings, size_t count, size_t stride)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++)
+        total += strlen(strings[i * stride]);
+    return (total + count / 2) / count;
+}
+
+static int register_benchmarks(void)
+{
+    if (corpus_count > MAX_CORPUS)
+    {
+        fprintf(stderr, "Corpus has more than %d entries\n", MAX_CORPUS);
+        return -1;
+    }
+    response_conn = connection_create(-1);
+    if (!response_conn)
+        return -1;
+
+    for (size_t i = 0; i < corpus_count; i++)
+    {
+        const corpus_entry_t *entry = &corpus[i];
+        size_t len = strlen(entry->text);
+        add_benchmark("tokenize", entry, bench_tokenize, 0, len);
+        add_benchmark("parse", entry, bench_parse, 1, len);
+        if (entry->malformed)
+            continue;
+
+        header_set_t *set = &header_sets[i];
+        collect_headers(entry, set);
+        add_benchmark("normalize_name", entry, bench_normalize_name, 1, set->name_bytes);
+        add_benchmark("normalize_value", entry, bench_normalize_value, 1, set->value_bytes);
+        add_benchmark("lookup_header", entry, bench_lookup_header, 0, set->name_bytes);
+    }
+
+    // Bytes for these are the strings read or the response bytes produced
+    add_benchmark("mime_type", NULL, bench_mime_type, 0, average_length(mime_paths, MIME_PATH_COUNT, 1));
+    add_benchmark("str_case_cmp", NULL, bench_str_case_cmp, 0,
+                  2 * average_length(&case_pairs[0][0], CASE_PAIR_COUNT, 2));
+    size_t chunked_len = build_chunked_body();
+    add_benchmark("chunked/decode_16k", NULL, bench_chunked_decode, 1, chunked_len);
+    add_benchmark("chunked/decode_16k_segmented", NULL, bench_chunked_segmented, 1, chunked_len);
+    add_benchmark("response/file_head", NULL, bench_response_file, 0, queue_file_head(23817));
+    add_benchmark("response/error_404", NULL, bench_response_error, 0, queue_error());
+    add_benchmark("response/allow_header", NULL, bench_allow_header, 0, strlen(build_allow_header()));
+    if (prepare_range_request() < 0)
+    {
+        fprintf(stderr, "Failed to prepare %s\n", range_path);
+        return -1;
+    }
+    add_benchmark("response/file_multirange_3", NULL, bench_response_multirange, 0, queue_multirange());
+    return 0;
+}
+
+typedef struct
+{
+    char name[64];
+    double ns;
+} baseline_entry_t;
+
+static baseline_entry_t baseline[MAX_BASELINE];
+static int baseline_count;
+
+static int load_baseline(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return -1;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) && baseline_count < MAX_BASELINE)
+    {
+        baseline_entry_t *entry = &baseline[baseline_count];
+        if (line[0] == '#' || sscanf(line, "%63s %lf", entry->name, &entry->ns) != 2)
+            continue; // comments and the column header
+        baseline_count++;
+    }
+    fclose(file);
+    return 0;
+}
+
+static const baseline_entry_t *find_baseline(const char *name)
+{
+    for (int i = 0; i < baseline_count; i++)
+    {
+        if (strcmp(baseline[i].name, name) == 0)
+            return &baseline[i];
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    double round_ms = DEFAULT_ROUND_MS;
+    const char *filter = NULL;
+    const char *baseline_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:f:b:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            round_ms = atof(optarg);
+            if (round_ms <= 0)
+            {
+                fprintf(stderr, "Invalid round time: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 'h':
+        default:
+            fprintf(stderr,
+                    "Usage: %s [options]\n"
+                    "  -t <ms>    Duration of each of the %d timed rounds (default %d)\n"
+                    "  -f <text>  Only run benchmarks whose name contains this\n"
+                    "  -b <file>  Compare against a saved run\n",
+                    argv[0], ROUNDS, DEFAULT_ROUND_MS);
+            return 1;
+        }
+    }
+
+    if (baseline_path && load_baseline(baseline_path) < 0)
+        return 1;
+
+    log_level = LOG_LEVEL_OFF; // malformed requests would log every iteration
+    open_instruction_counter();
+    if (register_benchmarks() < 0)
+        return 1;
+
+    printf("# scanner=%s instructions=%s rounds=%d round_ms=%g\n", http_scan_impl_name(),
+           instruction_counter >= 0 ? "perf_event" : "unavailable", ROUNDS, round_ms);
+    printf("benchmark\tns_per_op\tbytes_per_op\tinstructions_per_op%s\n", baseline_path ? "\tns_change_pct" : "");
+
+    for (int i = 0; i < benchmark_count; i++)
+    {
+        const benchmark_t *bench = &benchmarks[i];
+        if (filter && !strstr(bench->name, filter))
+            continue;
+
+        size_t iterations = calibrate(bench, round_ms);
+        measurement_t m = measure(bench, iterations, 0);
+        if (bench->restores)
+        {
+            // Take out the per-operation copy of the input
+            measurement_t copy = measure(bench, iterations, 1);
+            m.ns = m.ns > copy.ns ? m.ns - copy.ns : 0;
+            if (m.instructions >= 0 && copy.instructions >= 0)
+                m.instructions = m.instructions > copy.instructions ? m.instructions - copy.instructions : 0;
+        }
+
+        printf("%s\t%.2f\t%zu\t", bench->name, m.ns, bench->bytes);
+        if (m.instructions >= 0)
+            printf("%.1f", m.instructions);
+        else
+            printf("-");
+
+        if (baseline_path)
+        {
+            const baseline_entry_t *base = find_baseline(bench->name);
+            if (base && base->ns > 0)
+                printf("\t%+.1f", (m.ns - base->ns) * 100.0 / base->ns);
+            else
+                printf("\t-");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    unlink(range_path);
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <stddef.h>
+
+// Request heads the benchmarks run against: real browser and tool traffic,
+// an oversized cookie jar and inputs the parser must reject
+typedef struct
+{
+    const char *name;
+    const char *text; // complete head, "\r\n\r\n" included
+    int malformed;    // the parser is expected to reject it
+} corpus_entry_t;
+
+extern const corpus_entry_t corpus[];
+extern const size_t corpus_count;
+
+#endif
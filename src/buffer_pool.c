@@ -0,0 +1,82 @@
+#include <stdlib.h>
+
+#include "buffer_pool.h"
+
+// Free buffers are chained through their first bytes
+typedef struct free_buffer
+{
+    struct free_buffer *next;
+} free_buffer_t;
+
+typedef struct
+{
+    free_buffer_t *head;
+    size_t count;
+} buffer_class_t;
+
+static const size_t class_sizes[BUFFER_POOL_CLASSES] = {BUFFER_POOL_SMALL, BUFFER_POOL_MEDIUM, BUFFER_POOL_LARGE};
+
+// One set of free lists per worker thread
+static _Thread_local buffer_class_t classes[BUFFER_POOL_CLASSES];
+
+static int class_index(size_t size)
+{
+    for (int i = 0; i < BUFFER_POOL_CLASSES; i++)
+    {
+        if (size <= class_sizes[i])
+            return i;
+    }
+    return -1;
+}
+
+size_t buffer_pool_class_size(size_t size)
+{
+    int index = class_index(size);
+    return index < 0 ? 0 : class_sizes[index];
+}
+
+char *buffer_pool_get(size_t size, size_t *capacity)
+{
+    int index = class_index(size);
+    if (index < 0)
+        return NULL;
+
+    buffer_class_t *class = &classes[index];
+    char *buffer;
+    if (class->head)
+    {
+        // Most recently returned first: likely still in cache
+        free_buffer_t *free_buffer = class->head;
+        class->head = free_buffer->next;
+        class->count--;
+        buffer = (char *)free_buffer;
+    }
+    else
+    {
+        buffer = malloc(class_sizes[index] + 1);
+        if (!buffer)
+            return NULL;
+    }
+
+    *capacity = class_sizes[index];
+    return buffer;
+}
+
+void buffer_pool_put(char *buffer, size_t capacity)
+{
+    if (!buffer)
+        return;
+
+    int index = class_index(capacity);
+    if (index < 0 || classes[index].count >= BUFFER_POOL_MAX_FREE)
+    {
+        free(buffer);
+        return;
+    }
+
+    buffer_class_t *class = &classes[index];
+    free_buffer_t *free_buffer = (free_buffer_t *)buffer;
+    free_buffer->next = class->head;
+    class->head = free_buffer;
+    class->count++;
+}
@@ -0,0 +1,31 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+// Size classes of connection receive buffers. A connection starts in the
+// smallest class and moves up only when a request head or body needs it.
+#define BUFFER_POOL_CLASSES 3
+#define BUFFER_POOL_SMALL 4096
+#define BUFFER_POOL_MEDIUM 16384
+#define BUFFER_POOL_LARGE 65536 // MAX_REQUEST_SIZE
+
+#define BUFFER_POOL_MAX_FREE 64 // free buffers kept per class and worker; the rest go back to malloc
+
+// Per-worker pool of receive buffers. Freed buffers are kept on a free list
+// per size class and handed out again without touching the allocator. Each
+// worker thread has its own lists, so no locking is involved; a buffer must
+// be returned on the thread that got it.
+
+// Smallest class holding `size` bytes, or 0 if `size` exceeds the largest
+size_t buffer_pool_class_size(size_t size);
+
+// Get a buffer of at least `size` bytes (plus one for a terminating '\0').
+// `*capacity` is set to the usable size of its class. Returns NULL if `size`
+// is above BUFFER_POOL_LARGE or allocation fails.
+char *buffer_pool_get(size_t size, size_t *capacity);
+
+// Return a buffer obtained from buffer_pool_get() with its `capacity`
+void buffer_pool_put(char *buffer, size_t capacity);
+
+#endif
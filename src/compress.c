@@ -0,0 +1,271 @@
+#define _GNU_SOURCE // fopencookie()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+#include "http_handlers.h"
+#include "server_config.h"
+#include "log.h"
+
+#define COMPRESS_OUT_CHUNK 16384 // compressed bytes handed on at a time
+
+// One compression run, whichever library does it
+typedef struct
+{
+    http_encoding_t encoding;
+#ifdef HAVE_ZLIB
+    z_stream zlib;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx *zstd;
+#endif
+} encoder_t;
+
+// Receives compressed output. Returns 0, or -1 to abort.
+typedef int (*emit_fn)(void *ctx, const char *data, size_t len);
+
+unsigned compress_supported(void)
+{
+    unsigned codings = 0;
+#ifdef HAVE_ZLIB
+    codings |= 1u << HTTP_ENCODING_GZIP;
+#endif
+#ifdef HAVE_ZSTD
+    codings |= 1u << HTTP_ENCODING_ZSTD;
+#endif
+    return codings;
+}
+
+int compress_eligible(const char *mime_type, size_t size)
+{
+    return server_config.compress_level > 0 && compress_supported() != 0 &&
+           size >= server_config.compress_min_size && mime_type_compressible(mime_type);
+}
+
+static int encoder_init(encoder_t *encoder, http_encoding_t encoding)
+{
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->encoding = encoding;
+
+    switch (encoding)
+    {
+#ifdef HAVE_ZLIB
+    case HTTP_ENCODING_GZIP:
+        // windowBits 15 + 16: gzip header and trailer instead of zlib's
+        return deflateInit2(&encoder->zlib, server_config.compress_level, Z_DEFLATED, 15 + 16, 8,
+                            Z_DEFAULT_STRATEGY) == Z_OK
+                   ? 0
+                   : -1;
+#endif
+#ifdef HAVE_ZSTD
+    case HTTP_ENCODING_ZSTD:
+        encoder->zstd = ZSTD_createCCtx();
+        if (!encoder->zstd)
+            return -1;
+        ZSTD_CCtx_setParameter(encoder->zstd, ZSTD_c_compressionLevel, server_config.compress_level);
+        return 0;
+#endif
+    default:
+        return -1;
+    }
+}
+
+static void encoder_free(encoder_t *encoder)
+{
+    switch (encoder->encoding)
+    {
+#ifdef HAVE_ZLIB
+    case HTTP_ENCODING_GZIP:
+        deflateEnd(&encoder->zlib);
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case HTTP_ENCODING_ZSTD:
+        ZSTD_freeCCtx(encoder->zstd);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+// Compress `len` bytes, ending the compressed data if `finish`, and pass the
+// output to `emit` as it is produced. Returns 0 or -1.
+static int encoder_run(encoder_t *encoder, const void *data, size_t len, int finish, emit_fn emit, void *ctx)
+{
+    char out[COMPRESS_OUT_CHUNK];
+
+    switch (encoder->encoding)
+    {
+#ifdef HAVE_ZLIB
+    case HTTP_ENCODING_GZIP:
+    {
+        if (len > UINT_MAX)
+            return -1;
+        z_stream *zlib = &encoder->zlib;
+        zlib->next_in = (Bytef *)data;
+        zlib->avail_in = (uInt)len;
+        int rc;
+        do
+        {
+            zlib->next_out = (Bytef *)out;
+            zlib->avail_out = sizeof(out);
+            rc = deflate(zlib, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (rc == Z_STREAM_ERROR)
+                return -1;
+            size_t produced = sizeof(out) - zlib->avail_out;
+            if (produced && emit(ctx, out, produced) < 0)
+                return -1;
+        } while (zlib->avail_out == 0 || (finish && rc != Z_STREAM_END));
+        return 0;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case HTTP_ENCODING_ZSTD:
+    {
+        ZSTD_inBuffer in = {data, len, 0};
+        for (;;)
+        {
+            ZSTD_outBuffer output = {out, sizeof(out), 0};
+            size_t pending = ZSTD_compressStream2(encoder->zstd, &output, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(pending))
+                return -1;
+            if (output.pos && emit(ctx, out, output.pos) < 0)
+                return -1;
+            if (finish ? pending == 0 : in.pos == in.size)
+                return 0;
+        }
+    }
+#endif
+    default:
+        (void)data;
+        (void)len;
+        (void)finish;
+        (void)emit;
+        (void)ctx;
+        (void)out;
+        return -1;
+    }
+}
+
+// ----- Whole buffers -----
+
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t capacity;
+} output_buffer_t;
+
+static int emit_to_buffer(void *ctx, const char *data, size_t len)
+{
+    output_buffer_t *buffer = ctx;
+    if (buffer->len + len > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity * 2 > buffer->len + len ? buffer->capacity * 2 : buffer->len + len;
+        char *grown = realloc(buffer->data, capacity);
+        if (!grown)
+            return -1;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    return 0;
+}
+
+char *compress_buffer(http_encoding_t encoding, const void *data, size_t len, size_t *out_len)
+{
+    encoder_t encoder;
+    if (encoder_init(&encoder, encoding) < 0)
+        return NULL;
+
+    // Text usually shrinks to well under half
+    output_buffer_t buffer = {NULL, 0, len / 2 + 64};
+    buffer.data = malloc(buffer.capacity);
+    int rc = buffer.data ? encoder_run(&encoder, data, len, 1, emit_to_buffer, &buffer) : -1;
+    encoder_free(&encoder);
+    if (rc < 0)
+    {
+        LOG_WARN("Failed to compress %zu bytes with %s", len, http_encoding_names[encoding]);
+        free(buffer.data);
+        return NULL;
+    }
+
+    *out_len = buffer.len;
+    return buffer.data;
+}
+
+// ----- Streams -----
+
+typedef struct
+{
+    encoder_t encoder;
+    FILE *out;
+    int failed;
+} compress_stream_t;
+
+static int emit_to_file(void *ctx, const char *data, size_t len)
+{
+    return fwrite(data, 1, len, ctx) == len ? 0 : -1;
+}
+
+static ssize_t compress_stream_write(void *cookie, const char *data, size_t len)
+{
+    compress_stream_t *stream = cookie;
+    if (stream->failed || encoder_run(&stream->encoder, data, len, 0, emit_to_file, stream->out) < 0)
+    {
+        stream->failed = 1;
+        return 0;
+    }
+    return (ssize_t)len;
+}
+
+static int compress_stream_close(void *cookie)
+{
+    compress_stream_t *stream = cookie;
+    if (!stream->failed && encoder_run(&stream->encoder, NULL, 0, 1, emit_to_file, stream->out) < 0)
+        stream->failed = 1;
+    encoder_free(&stream->encoder);
+    int rc = fclose(stream->out);
+    int failed = stream->failed;
+    free(stream);
+    return failed ? -1 : rc;
+}
+
+FILE *compress_stream(http_encoding_t encoding, FILE *out)
+{
+    compress_stream_t *stream = malloc(sizeof(*stream));
+    if (!stream)
+        return NULL;
+    if (encoder_init(&stream->encoder, encoding) < 0)
+    {
+        free(stream);
+        return NULL;
+    }
+    stream->out = out;
+    stream->failed = 0;
+
+    cookie_io_functions_t functions = {
+        .write = compress_stream_write,
+        .close = compress_stream_close,
+    };
+    FILE *in = fopencookie(stream, "w", functions);
+    if (!in)
+    {
+        encoder_free(&stream->encoder);
+        free(stream);
+        return NULL;
+    }
+    setvbuf(in, NULL, _IOFBF, COMPRESS_OUT_CHUNK);
+    return in;
+}
@@ -0,0 +1,31 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "http_encoding.h"
+
+// On-the-fly content coding: gzip through zlib and zstd through libzstd, each
+// compiled in when the Makefile finds the library (HAVE_ZLIB, HAVE_ZSTD).
+// Serving precompressed .br/.zst/.gz files needs neither.
+
+// Codings that can be produced on the fly (bit 1 << http_encoding_t)
+unsigned compress_supported(void);
+
+// 1 if a `size`-byte body (SIZE_MAX if not known up front) of `mime_type` is
+// worth compressing: compression is on, some coding is compiled in, the body
+// reaches the minimum size and the type is in the compressible MIME list.
+// Responses for which this holds vary with Accept-Encoding.
+int compress_eligible(const char *mime_type, size_t size);
+
+// Compress `len` bytes in one go at the configured level. Returns a
+// malloc()ed buffer, its length in *out_len, or NULL on failure.
+char *compress_buffer(http_encoding_t encoding, const void *data, size_t len, size_t *out_len);
+
+// Stdio stream that compresses everything written to it into `out`.
+// fclose() ends the compressed data and closes `out` too. Returns NULL on
+// failure, leaving `out` open.
+FILE *compress_stream(http_encoding_t encoding, FILE *out);
+
+#endif
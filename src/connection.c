@@ -0,0 +1,1336 @@
+#define _GNU_SOURCE // splice(), pipe2()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "connection.h"
+#include "http_errors.h"
+#include "error_handlers.h"
+#include "http_handlers.h"
+#include "buffer_pool.h"
+#include "server_config.h"
+#include "metrics.h"
+#include "tls.h"
+#include "http2.h"
+#include "log.h"
+
+_Static_assert(MAX_REQUEST_SIZE <= BUFFER_POOL_LARGE, "largest buffer class must hold a full request");
+
+#define BODY_PIPE_PIECE 65536 // streamed body bytes moved per socket -> pipe round (default pipe capacity)
+
+static int end_body_stream(connection_t *conn, int status);
+
+connection_t *connection_create(int fd)
+{
+    connection_t *conn = calloc(1, sizeof(*conn));
+    if (!conn)
+        return NULL;
+
+    conn->fd = fd;
+    conn->state = CONN_READ_HEADERS;
+
+    // Responses are gathered into as few sends as possible and file bodies
+    // follow their head with MSG_MORE, so Nagle has nothing left to merge:
+    // it would only hold back the short last segment of a response, a TLS
+    // record or an HTTP/2 window until the peer's delayed ACK
+    int nodelay = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) < 0)
+        LOG_WARN("setsockopt(TCP_NODELAY) failed: %s", strerror(errno));
+
+    if (tls_enabled())
+    {
+        conn->tls = tls_accept(fd);
+        if (!conn->tls)
+        {
+            free(conn);
+            return NULL;
+        }
+        conn->state = CONN_TLS_HANDSHAKE;
+    }
+    http_parser_init(&conn->parser);
+    conn->pipe_fds[0] = -1;
+    conn->pipe_fds[1] = -1;
+    conn->body_fd = -1;
+    metrics_count_connection_opened();
+    return conn;
+}
+
+static void free_chunk(out_chunk_t *chunk)
+{
+    if (chunk->release)
+        chunk->release(chunk->owner);
+    if (chunk->owns_fd)
+        close(chunk->fd);
+    free(chunk);
+}
+
+static void free_out_queue(connection_t *conn)
+{
+    out_chunk_t *chunk = conn->out_head;
+    while (chunk)
+    {
+        out_chunk_t *next = chunk->next;
+        free_chunk(chunk);
+        chunk = next;
+    }
+    conn->out_head = NULL;
+    conn->out_tail = NULL;
+}
+
+void connection_destroy(connection_t *conn)
+{
+    if (connection_is_streaming(conn))
+        end_body_stream(conn, HTTP_IO_ERROR);
+    free_out_queue(conn);
+    http2_free(conn->h2); // after the queue: DATA frames borrow from its streams
+    free(conn->request);
+    connection_release_buffer(conn);
+    if (conn->pipe_fds[0] >= 0)
+    {
+        close(conn->pipe_fds[0]);
+        close(conn->pipe_fds[1]);
+    }
+    if (conn->tls)
+        tls_close(conn->tls);
+    buffer_pool_put(conn->tls_stage, CONN_TLS_RECORD);
+    close(conn->fd);
+    free(conn);
+    metrics_count_connection_closed();
+}
+
+int connection_is_idle(const connection_t *conn)
+{
+    if (conn->h2)
+        return conn->state == CONN_READ_HEADERS && conn->buffer_len == 0 && http2_is_idle(conn->h2);
+    return conn->state == CONN_READ_HEADERS && conn->buffer_len == 0 && conn->requests_served > 0;
+}
+
+// ----- Response queue -----
+
+static void queue_chunk(connection_t *conn, out_chunk_t *chunk)
+{
+    chunk->next = NULL;
+    if (conn->out_tail)
+        conn->out_tail->next = chunk;
+    else
+        conn->out_head = chunk;
+    conn->out_tail = chunk;
+}
+
+int connection_send(connection_t *conn, const void *data, size_t len)
+{
+    struct iovec iov = {(void *)data, len};
+    return connection_sendv(conn, &iov, 1);
+}
+
+int connection_sendv(connection_t *conn, const struct iovec *iov, int count)
+{
+    size_t len = 0;
+    for (int i = 0; i < count; i++)
+        len += iov[i].iov_len;
+    if (len == 0)
+        return 0;
+
+    out_chunk_t *chunk = malloc(sizeof(*chunk) + len);
+    if (!chunk)
+    {
+        LOG_ERROR("Failed to allocate response chunk");
+        conn->close_after_write = 1;
+        return -1;
+    }
+
+    chunk->fd = -1;
+    chunk->use_splice = 0;
+    chunk->offset = 0;
+    chunk->remain = len;
+    chunk->base = chunk->data;
+    chunk->release = NULL;
+    chunk->owner = NULL;
+    chunk->owns_fd = 0;
+    char *p = chunk->data;
+    for (int i = 0; i < count; i++)
+    {
+        memcpy(p, iov[i].iov_base, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+    queue_chunk(conn, chunk);
+    return 0;
+}
+
+int connection_send_ref(connection_t *conn, const void *data, size_t len,
+                        chunk_release_fn release, void *owner)
+{
+    out_chunk_t *chunk = malloc(sizeof(*chunk));
+    if (!chunk)
+    {
+        LOG_ERROR("Failed to allocate response chunk");
+        if (release)
+            release(owner);
+        conn->close_after_write = 1;
+        return -1;
+    }
+
+    chunk->fd = -1;
+    chunk->use_splice = 0;
+    chunk->offset = 0;
+    chunk->remain = len;
+    chunk->base = data;
+    chunk->release = release;
+    chunk->owner = owner;
+    chunk->owns_fd = 0;
+    queue_chunk(conn, chunk);
+    return 0;
+}
+
+// Receive buffer shared by the connection and the queued chunks pointing
+// into it; back to the pool once the last of them lets go
+typedef struct lent_buffer
+{
+    char *buffer;
+    size_t capacity;
+    int refs;
+} lent_buffer_t;
+
+static void release_lent_buffer(void *owner)
+{
+    lent_buffer_t *lent = owner;
+    if (--lent->refs > 0)
+        return;
+    buffer_pool_put(lent->buffer, lent->capacity);
+    free(lent);
+}
+
+int connection_send_buffer_ref(connection_t *conn, const char *data, size_t len)
+{
+    lent_buffer_t *lent = conn->lent_buffer;
+    if (!lent)
+    {
+        lent = malloc(sizeof(*lent));
+        if (!lent)
+            return connection_send(conn, data, len); // copied after all
+        lent->buffer = conn->buffer;
+        lent->capacity = conn->buffer_cap;
+        lent->refs = 1; // the connection's own
+        conn->lent_buffer = lent;
+    }
+    lent->refs++;
+    return connection_send_ref(conn, data, len, release_lent_buffer, lent);
+}
+
+int connection_send_file(connection_t *conn, int fd, off_t offset, size_t len)
+{
+    out_chunk_t *chunk = malloc(sizeof(*chunk));
+    if (!chunk)
+    {
+        LOG_ERROR("Failed to allocate response chunk");
+        close(fd);
+        conn->close_after_write = 1;
+        return -1;
+    }
+
+    chunk->fd = fd;
+    chunk->use_splice = 0;
+    chunk->offset = offset;
+    chunk->remain = len;
+    chunk->base = NULL;
+    chunk->release = NULL;
+    chunk->owner = NULL;
+    chunk->owns_fd = 1;
+    queue_chunk(conn, chunk);
+    return 0;
+}
+
+int connection_send_file_ref(connection_t *conn, int fd, off_t offset, size_t len,
+                             chunk_release_fn release, void *owner)
+{
+    out_chunk_t *chunk = malloc(sizeof(*chunk));
+    if (!chunk)
+    {
+        LOG_ERROR("Failed to allocate response chunk");
+        if (release)
+            release(owner);
+        conn->close_after_write = 1;
+        return -1;
+    }
+
+    chunk->fd = fd;
+    chunk->use_splice = 0;
+    chunk->offset = offset;
+    chunk->remain = len;
+    chunk->base = NULL;
+    chunk->release = release;
+    chunk->owner = owner;
+    chunk->owns_fd = 0;
+    queue_chunk(conn, chunk);
+    return 0;
+}
+
+void connection_pop_chunk(connection_t *conn)
+{
+    out_chunk_t *chunk = conn->out_head;
+    if (!chunk)
+        return;
+
+    conn->out_head = chunk->next;
+    if (!conn->out_head)
+        conn->out_tail = NULL;
+    free_chunk(chunk);
+}
+
+int connection_open_pipe(connection_t *conn)
+{
+    if (conn->pipe_fds[0] >= 0)
+        return 0;
+
+    if (pipe2(conn->pipe_fds, O_CLOEXEC | O_NONBLOCK) < 0)
+    {
+        LOG_WARN("pipe2() failed: %s", strerror(errno));
+        conn->pipe_fds[0] = -1;
+        conn->pipe_fds[1] = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// Fallback when sendfile() is not supported for this file: stage the next
+// piece in the connection's pipe and splice it to the socket
+static ssize_t splice_file_piece(connection_t *conn, out_chunk_t *chunk, unsigned int more)
+{
+    if (connection_open_pipe(conn) < 0)
+        return -1;
+
+    if (conn->pipe_pending == 0)
+    {
+        loff_t file_offset = chunk->offset;
+        ssize_t staged = splice(chunk->fd, &file_offset, conn->pipe_fds[1], NULL, chunk->remain,
+                                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (staged <= 0)
+        {
+            // The pipe is empty here, so nothing short of an error or a
+            // truncated file stops the file side from making progress
+            if (staged == 0 || errno == EAGAIN)
+                errno = EIO;
+            return -1;
+        }
+        conn->pipe_pending = (size_t)staged;
+    }
+
+    ssize_t sent = splice(conn->pipe_fds[0], NULL, conn->fd, NULL, conn->pipe_pending,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK | more);
+    if (sent > 0)
+        conn->pipe_pending -= (size_t)sent;
+    return sent;
+}
+
+// Send the next part of a file chunk straight from the page cache
+static ssize_t send_file_piece(connection_t *conn, out_chunk_t *chunk)
+{
+    unsigned int more = chunk->next ? SPLICE_F_MORE : 0;
+
+    if (!chunk->use_splice)
+    {
+        off_t file_offset = chunk->offset;
+        ssize_t sent = sendfile(conn->fd, chunk->fd, &file_offset, chunk->remain);
+        if (sent == 0)
+        {
+            errno = EIO; // file shrank underneath us
+            return -1;
+        }
+        if (sent > 0 || (errno != EINVAL && errno != ENOSYS))
+            return sent;
+
+        chunk->use_splice = 1;
+    }
+
+    return splice_file_piece(conn, chunk, more);
+}
+
+int connection_gather_iov(connection_t *conn, struct iovec *iov, int max_iov, int *more)
+{
+    int count = 0;
+    out_chunk_t *chunk = conn->out_head;
+    for (; chunk && chunk->fd < 0 && count < max_iov; chunk = chunk->next)
+    {
+        iov[count].iov_base = (void *)(chunk->base + chunk->offset);
+        iov[count].iov_len = chunk->remain;
+        count++;
+    }
+    *more = chunk && chunk->fd >= 0;
+    return count;
+}
+
+void connection_advance_sent(connection_t *conn, size_t sent)
+{
+    while (sent > 0 && conn->out_head)
+    {
+        out_chunk_t *chunk = conn->out_head;
+        size_t step = sent < chunk->remain ? sent : chunk->remain;
+        chunk->offset += step;
+        chunk->remain -= step;
+        sent -= step;
+        if (chunk->remain == 0)
+            connection_pop_chunk(conn);
+    }
+}
+
+// ----- TLS in user space -----
+
+// Copy the next record's worth of queued bytes into the stage, reading file
+// chunks through it, so that small responses and the head of a large one
+// share a record. Returns 0, or -1 with errno set.
+static int stage_tls_record(connection_t *conn)
+{
+    if (!conn->tls_stage)
+    {
+        size_t capacity;
+        conn->tls_stage = buffer_pool_get(CONN_TLS_RECORD, &capacity);
+        if (!conn->tls_stage)
+        {
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    conn->tls_staged = 0;
+    conn->tls_stage_sent = 0;
+    while (conn->out_head && conn->tls_staged < CONN_TLS_RECORD)
+    {
+        out_chunk_t *chunk = conn->out_head;
+        char *stage = conn->tls_stage + conn->tls_staged;
+        size_t take = CONN_TLS_RECORD - conn->tls_staged;
+        if (take > chunk->remain)
+            take = chunk->remain;
+
+        if (chunk->fd < 0)
+        {
+            memcpy(stage, chunk->base + chunk->offset, take);
+        }
+        else if (take > 0)
+        {
+            ssize_t n = pread(chunk->fd, stage, take, chunk->offset);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                if (n == 0)
+                    errno = EIO; // file shrank underneath us
+                return -1;
+            }
+            take = (size_t)n;
+        }
+
+        conn->tls_staged += take;
+        chunk->offset += (off_t)take;
+        chunk->remain -= take;
+        if (chunk->remain == 0)
+            connection_pop_chunk(conn);
+    }
+    return 0;
+}
+
+// Encrypt and send queued chunks, see flush_tls(). Sets `*corked` once it
+// corks the socket, which it does from the second record of a flush on.
+static int send_tls_records(connection_t *conn, int *corked)
+{
+    int records = 0;
+    for (;;)
+    {
+        const char *data;
+        size_t len;
+        int direct = 0;
+
+        if (conn->tls_stage_sent < conn->tls_staged)
+        {
+            data = conn->tls_stage + conn->tls_stage_sent;
+            len = conn->tls_staged - conn->tls_stage_sent;
+        }
+        else if (!conn->out_head)
+        {
+            break;
+        }
+        else if (conn->out_head->fd < 0 && conn->out_head->remain >= CONN_TLS_RECORD)
+        {
+            data = conn->out_head->base + conn->out_head->offset;
+            len = conn->out_head->remain;
+            direct = 1;
+        }
+        else
+        {
+            if (stage_tls_record(conn) < 0)
+            {
+                LOG_WARN("Failed to stage TLS record: %s", strerror(errno));
+                return -1;
+            }
+            continue;
+        }
+
+        // Every SSL_write() is a record of its own that would otherwise leave
+        // a short last segment; hold those back while more records follow
+        if (records++ > 0 && !*corked)
+        {
+            int on = 1;
+            *corked = setsockopt(conn->fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on)) == 0;
+        }
+
+        ssize_t sent = tls_send(conn->tls, data, len);
+        if (sent < 0)
+        {
+            if (errno == EAGAIN)
+                return 0;
+            LOG_DEBUG("TLS send failed: %s", strerror(errno));
+            return -1;
+        }
+
+        metrics_count_bytes_out((size_t)sent);
+        if (direct)
+            connection_advance_sent(conn, (size_t)sent);
+        else
+            conn->tls_stage_sent += (size_t)sent;
+    }
+
+    // Drained: idle connections hold no stage
+    buffer_pool_put(conn->tls_stage, CONN_TLS_RECORD);
+    conn->tls_stage = NULL;
+    conn->tls_staged = 0;
+    conn->tls_stage_sent = 0;
+    return 1;
+}
+
+// flush_out_queue() for a TLS session the kernel does not encrypt for.
+// In-memory chunks of a record or more are encrypted in place; everything
+// else goes through the stage. A send that would block is retried with the
+// same bytes, as OpenSSL requires, because nothing advances until it succeeds.
+static int flush_tls(connection_t *conn)
+{
+    int corked = 0;
+    int rc = send_tls_records(conn, &corked);
+    if (corked)
+    {
+        int off = 0;
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    }
+    return rc;
+}
+
+// Write queued chunks until the queue is empty or the socket would block.
+// Consecutive in-memory chunks (the responses of a pipelined batch) leave in
+// one sendmsg(). Returns 1 when everything was sent, 0 if the socket is full,
+// -1 on error. With kTLS the socket encrypts on its own and this path serves
+// TLS unchanged, sendfile() included.
+static int flush_out_queue(connection_t *conn)
+{
+    if (conn->tls && !conn->tls_kernel_send)
+        return flush_tls(conn);
+
+    while (conn->out_head)
+    {
+        out_chunk_t *chunk = conn->out_head;
+        ssize_t sent;
+
+        if (chunk->remain == 0)
+        {
+            connection_pop_chunk(conn);
+            continue;
+        }
+
+        if (chunk->fd < 0)
+        {
+            struct iovec iov[64];
+            int more;
+            struct msghdr msg = {0};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = (size_t)connection_gather_iov(conn, iov, 64, &more);
+
+            // Headers followed by a file body: hold the segment open so
+            // they leave in the same packet as the first file bytes
+            int flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+            if (more)
+                flags |= MSG_MORE;
+            sent = sendmsg(conn->fd, &msg, flags);
+        }
+        else
+        {
+            sent = send_file_piece(conn, chunk);
+        }
+
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EINTR)
+                continue;
+            LOG_WARN("send() failed: %s", strerror(errno));
+            return -1;
+        }
+
+        metrics_count_bytes_out((size_t)sent);
+        connection_advance_sent(conn, (size_t)sent);
+    }
+    return 1;
+}
+
+// ----- Receive buffer -----
+
+// Capacity needed to take `incoming` more bytes. A request whose body is being
+// read is sized for the whole body at once, so it grows at most once. A body
+// streamed through the buffer only ever needs room for the next read.
+static size_t wanted_capacity(const connection_t *conn, size_t incoming)
+{
+    size_t need = conn->buffer_len + incoming;
+    if (conn->state == CONN_READ_BODY && conn->request && !connection_is_streaming(conn))
+    {
+        size_t request_size = conn->header_len + conn->request->content_length;
+        if (request_size > need)
+            need = request_size;
+    }
+    return need;
+}
+
+int connection_reserve_buffer(connection_t *conn, size_t size)
+{
+    if (size <= conn->buffer_cap)
+        return 0;
+
+    size_t capacity;
+    char *buffer = buffer_pool_get(size, &capacity);
+    if (!buffer)
+    {
+        LOG_ERROR("Failed to allocate receive buffer (%zu bytes)", size);
+        return -1;
+    }
+
+    if (conn->buffer)
+    {
+        memcpy(buffer, conn->buffer, conn->buffer_len);
+        if (conn->request)
+            http_request_rebase(conn->request, buffer, conn->buffer_len);
+        connection_release_buffer(conn);
+    }
+    buffer[conn->buffer_len] = '\0';
+    conn->buffer = buffer;
+    conn->buffer_cap = capacity;
+    return 0;
+}
+
+void connection_release_buffer(connection_t *conn)
+{
+    if (conn->lent_buffer)
+        release_lent_buffer(conn->lent_buffer);
+    else
+        buffer_pool_put(conn->buffer, conn->buffer_cap);
+    conn->lent_buffer = NULL;
+    conn->buffer = NULL;
+    conn->buffer_cap = 0;
+}
+
+// Access log lines are in combined log format
+void connection_request_completed(connection_t *conn)
+{
+    int status = conn->response_status;
+    conn->response_status = 0;
+    conn->request_start = 0;
+    conn->head_done = 0;
+    conn->parse_ns = 0;
+    if (!status)
+        return;
+    metrics_count_response(status);
+    if (!log_access_enabled())
+        return;
+
+    char client[INET_ADDRSTRLEN];
+    if (!inet_ntop(AF_INET, &conn->peer.sin_addr, client, sizeof(client)))
+        strcpy(client, "-");
+
+    const http_request *request = conn->request;
+    const char *referer = request ? http_request_header(request, HTTP_HEADER_REFERER) : NULL;
+    const char *user_agent = request ? http_request_header(request, HTTP_HEADER_USER_AGENT) : NULL;
+
+    if (request && request->version[0]) // request line fully parsed
+    {
+        log_access("%s - - %s \"%s %s%s%s %s\" %d %zu \"%s\" \"%s\"", client, log_access_time(),
+                   request->method, request->path, request->query[0] ? "?" : "", request->query,
+                   request->version, status, conn->response_bytes,
+                   referer ? referer : "-", user_agent ? user_agent : "-");
+    }
+    else
+    {
+        log_access("%s - - %s \"-\" %d %zu \"-\" \"-\"", client, log_access_time(), status, conn->response_bytes);
+    }
+}
+
+// Stop reading and flush whatever response was queued
+static void begin_response(connection_t *conn, int keep_alive)
+{
+    uint64_t now = metrics_now();
+    if (conn->request_start)
+        metrics_record(METRICS_PHASE_TOTAL, now - conn->request_start);
+    if (!conn->write_start)
+        conn->write_start = now;
+    connection_request_completed(conn);
+
+    size_t used = conn->header_len + (conn->request ? conn->request->body_length : 0);
+    free(conn->request);
+    conn->request = NULL;
+    if (!keep_alive)
+        conn->close_after_write = 1;
+
+    // Drop the finished request's bytes but keep whatever the client
+    // pipelined behind it for the next parse
+    if (conn->close_after_write || used >= conn->buffer_len)
+    {
+        conn->buffer_len = 0;
+    }
+    else if (conn->lent_buffer)
+    {
+        // The response points into the buffer: the pipelined bytes move out
+        size_t left = conn->buffer_len - used;
+        size_t capacity;
+        char *buffer = buffer_pool_get(left, &capacity);
+        if (buffer)
+            memcpy(buffer, conn->buffer + used, left);
+        else
+            LOG_ERROR("Failed to allocate receive buffer (%zu bytes)", left);
+        connection_release_buffer(conn);
+        conn->buffer = buffer;
+        conn->buffer_cap = buffer ? capacity : 0;
+        conn->buffer_len = buffer ? left : 0;
+        if (!buffer)
+            conn->close_after_write = 1;
+    }
+    else
+    {
+        conn->buffer_len -= used;
+        memmove(conn->buffer, conn->buffer + used, conn->buffer_len);
+    }
+    if (conn->buffer_len == 0)
+        connection_release_buffer(conn);
+    else
+        conn->buffer[conn->buffer_len] = '\0';
+    conn->header_len = 0;
+    http_parser_init(&conn->parser);
+    if (!conn->close_after_write)
+        conn->requests_served++;
+
+    conn->state = CONN_WRITING;
+}
+
+static int buffer_full_status(const connection_t *conn)
+{
+    LOG_INFO("Request too large for buffer");
+    return (conn->state == CONN_READ_HEADERS) ? HTTP_PARSE_ERROR : HTTP_BODY_TOO_LARGE;
+}
+
+int connection_append(connection_t *conn, const char *data, size_t len)
+{
+    if (len > MAX_REQUEST_SIZE - conn->buffer_len)
+        return buffer_full_status(conn);
+    if (connection_reserve_buffer(conn, wanted_capacity(conn, len)) < 0)
+        return HTTP_IO_ERROR;
+
+    memcpy(conn->buffer + conn->buffer_len, data, len);
+    conn->buffer_len += len;
+    metrics_count_bytes_in(len);
+    conn->buffer[conn->buffer_len] = '\0';
+    return 0;
+}
+
+// Pull bytes from the socket into the request buffer. Returns 1 if data
+// arrived, 0 if the socket would block, or -1 with the http_io_status_t in
+// `*status` (HTTP_IO_EOF, itself 0, for a clean close).
+static int fill_buffer(connection_t *conn, int *status)
+{
+    for (;;)
+    {
+        *status = HTTP_IO_ERROR;
+        if (conn->buffer_len == MAX_REQUEST_SIZE)
+        {
+            *status = buffer_full_status(conn);
+            return -1;
+        }
+        // Grow to the next size class only once the current one is full
+        if (connection_reserve_buffer(conn, wanted_capacity(conn, 1)) < 0)
+            return -1;
+
+        size_t space = conn->buffer_cap - conn->buffer_len;
+        char *free_space = conn->buffer + conn->buffer_len;
+        ssize_t bytes = conn->tls ? tls_recv(conn->tls, free_space, space) : recv(conn->fd, free_space, space, 0);
+        if (bytes < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (conn->buffer_len == 0)
+                    connection_release_buffer(conn); // idle: do not hold a buffer while waiting
+                return 0;
+            }
+            if (errno == EINTR)
+                continue;
+            LOG_WARN("recv() failed: %s", strerror(errno));
+            return -1;
+        }
+        if (bytes == 0)
+        {
+            *status = HTTP_IO_EOF;
+            return -1;
+        }
+
+        conn->buffer_len += (size_t)bytes;
+        conn->buffer[conn->buffer_len] = '\0';
+        metrics_count_bytes_in((size_t)bytes);
+
+        LOG_DEBUG("Read %zd bytes (total: %zu)", bytes, conn->buffer_len);
+        return 1;
+    }
+}
+
+// ----- Streamed request bodies -----
+
+void connection_stream_body(connection_t *conn, int fd, off_t offset, void *upload)
+{
+    conn->body_fd = fd;
+    conn->body_offset = offset;
+    conn->body_remaining = conn->request->content_length;
+    conn->body_upload = upload;
+}
+
+// Stop streaming and hand the upload back to its handler. After a failure
+// the pipe may still hold body bytes; it is dropped so they can never end up
+// in a response. Returns finish_streamed_body()'s keep-alive verdict.
+static int end_body_stream(connection_t *conn, int status)
+{
+    void *upload = conn->body_upload;
+    conn->body_fd = -1;
+    conn->body_upload = NULL;
+    if (conn->pipe_pending > 0)
+    {
+        close(conn->pipe_fds[0]);
+        close(conn->pipe_fds[1]);
+        conn->pipe_fds[0] = -1;
+        conn->pipe_fds[1] = -1;
+        conn->pipe_pending = 0;
+    }
+    return finish_streamed_body(conn, conn->request, upload, status);
+}
+
+static void complete_body_stream(connection_t *conn)
+{
+    metrics_record_since(METRICS_PHASE_READ_BODY, conn->head_done);
+    int keep_alive = end_body_stream(conn, 1);
+    begin_response(conn, keep_alive);
+}
+
+void connection_body_received(connection_t *conn, size_t len)
+{
+    conn->pipe_pending += len;
+    conn->body_remaining -= len;
+    metrics_count_bytes_in(len);
+}
+
+void connection_body_stored(connection_t *conn, size_t len)
+{
+    conn->pipe_pending -= len;
+    conn->body_offset += (off_t)len;
+    if (conn->body_remaining == 0 && conn->pipe_pending == 0)
+        complete_body_stream(conn);
+}
+
+void connection_body_store_failed(connection_t *conn)
+{
+    const char *method = conn->request->method;
+    end_body_stream(conn, HTTP_IO_ERROR);
+    send_error_response(conn, 500, "Internal Server Error", "close", method);
+    begin_response(conn, 0);
+}
+
+// Write body bytes held in user space to the body file. Returns 0, or -1
+// after failing the upload.
+static int store_body_bytes(connection_t *conn, const char *data, size_t len)
+{
+    for (size_t written = 0; written < len;)
+    {
+        ssize_t n = pwrite(conn->body_fd, data + written, len - written, conn->body_offset + (off_t)written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            LOG_ERROR("Failed to store request body: %s", n < 0 ? strerror(errno) : "short write");
+            connection_body_store_failed(conn);
+            return -1;
+        }
+        written += (size_t)n;
+    }
+    conn->body_offset += (off_t)len;
+    return 0;
+}
+
+// Write the body bytes that arrived along with the head. Bytes pipelined
+// behind the body stay buffered for the next request.
+static void store_buffered_body(connection_t *conn)
+{
+    size_t buffered = conn->buffer_len - conn->header_len;
+    size_t take = buffered < conn->body_remaining ? buffered : conn->body_remaining;
+    const char *body = conn->buffer + conn->header_len;
+
+    if (store_body_bytes(conn, body, take) < 0)
+        return;
+
+    conn->body_remaining -= take;
+    conn->buffer_len -= take;
+    memmove(conn->buffer + conn->header_len, body + take, conn->buffer_len - conn->header_len);
+    conn->buffer[conn->buffer_len] = '\0';
+
+    if (conn->body_remaining == 0)
+        complete_body_stream(conn);
+}
+
+// Move body bytes socket -> pipe -> file. Returns 1 after progress (the
+// request may have completed or failed with a response queued), 0 if the
+// socket would block, or -1 with the http_io_status_t in `*status`.
+static int stream_body(connection_t *conn, int *status)
+{
+    *status = HTTP_IO_ERROR;
+    if (connection_open_pipe(conn) < 0)
+    {
+        connection_body_store_failed(conn);
+        return 1;
+    }
+
+    if (conn->pipe_pending == 0)
+    {
+        size_t want = conn->body_remaining < BODY_PIPE_PIECE ? conn->body_remaining : BODY_PIPE_PIECE;
+        ssize_t received = splice(conn->fd, NULL, conn->pipe_fds[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (received < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if (errno == EINTR)
+                return 1;
+            LOG_WARN("splice() from socket failed: %s", strerror(errno));
+            return -1;
+        }
+        if (received == 0)
+        {
+            *status = HTTP_IO_EOF;
+            return -1;
+        }
+        connection_body_received(conn, (size_t)received);
+    }
+
+    loff_t file_offset = conn->body_offset;
+    ssize_t stored = splice(conn->pipe_fds[0], NULL, conn->body_fd, &file_offset, conn->pipe_pending, SPLICE_F_MOVE);
+    if (stored < 0 && errno == EINTR)
+        return 1;
+    if (stored <= 0)
+    {
+        LOG_ERROR("Failed to store request body: %s", stored < 0 ? strerror(errno) : "no progress");
+        connection_body_store_failed(conn);
+        return 1;
+    }
+    connection_body_stored(conn, (size_t)stored);
+    return 1;
+}
+
+// ----- Request processing -----
+
+// Steps 3-4: feed the new bytes to the parser. Returns 1 once the request
+// head is complete, 0 while more is needed or after queuing an error response.
+static int parse_input(connection_t *conn)
+{
+    uint64_t parse_start = metrics_now();
+    if (!conn->request)
+    {
+        http_request *request = malloc(sizeof(*request));
+        if (!request)
+        {
+            LOG_ERROR("Failed to allocate request");
+            send_error_response(conn, 500, "Internal Server Error", "close", NULL);
+            begin_response(conn, 0);
+            return 0;
+        }
+        http_request_init(request, conn->buffer);
+        conn->request = request;
+        conn->request_start = parse_start;
+        if (conn->requests_served > 0)
+            metrics_count_keepalive_reuse();
+    }
+
+    int rc = http_parser_execute(&conn->parser, &http_request_parser_callbacks, conn->request,
+                                 conn->buffer, conn->buffer_len);
+    conn->head_done = metrics_now();
+    conn->parse_ns += conn->head_done - parse_start;
+    if (rc == 0)
+        return 0; // wait for more
+
+    if (rc < 0)
+    {
+        if (rc == HTTP_HEADERS_TOO_LARGE)
+            handle_parse_headers_status(rc, conn, conn->request->method);
+        else
+            handle_request_line_status(rc, conn, conn->request->method);
+        begin_response(conn, 0);
+        return 0;
+    }
+
+    conn->header_len = conn->parser.offset;
+    metrics_record(METRICS_PHASE_READ_HEADERS, conn->head_done - conn->request_start);
+    metrics_record(METRICS_PHASE_PARSE, conn->parse_ns);
+    return 1;
+}
+
+// Steps 5-6, run once the request head is parsed
+static void process_headers(connection_t *conn)
+{
+    http_request *request = conn->request;
+    LOG_DEBUG("Request: %s %s %s", request->method, request->path, request->version);
+
+    // Step 5: Validate request
+    uint64_t validate_start = metrics_now();
+    int error_code = validate_http_request(request);
+    metrics_record_since(METRICS_PHASE_VALIDATE, validate_start);
+    if (!handle_validate_status(error_code, conn, request->method))
+    {
+        begin_response(conn, 0);
+        return;
+    }
+
+    // Step 6: Frame the body (for POST/PUT requests)
+    request->content_length = get_content_length(request);
+    if (request->content_length > 0 || request->chunked)
+    {
+        if (request->chunked)
+            LOG_DEBUG("Transfer-Encoding: chunked");
+        else
+            LOG_DEBUG("Content-Length: %zu bytes", request->content_length);
+
+        // The route decides how large the body may be and whether it is
+        // buffered or streamed to disk
+        if (!prepare_request_body(conn, request))
+        {
+            begin_response(conn, 0);
+            return;
+        }
+        if (request->chunked)
+        {
+            // The decoded size is only known at the end. A buffered body must
+            // also fit the request buffer, where it is decoded in place.
+            size_t limit = server_config_max_body(request->path);
+            if (!connection_is_streaming(conn) && limit > MAX_REQUEST_SIZE - conn->header_len)
+                limit = MAX_REQUEST_SIZE - conn->header_len;
+            http_chunked_init(&conn->chunked, limit);
+            conn->body_decoded = 0;
+        }
+        else if (!connection_is_streaming(conn) && request->content_length > MAX_REQUEST_SIZE - conn->header_len)
+        {
+            LOG_INFO("Content-Length too large: %zu bytes for %d", request->content_length, MAX_REQUEST_SIZE);
+            handle_read_body_status(HTTP_BODY_TOO_LARGE, conn, request->connection_header, request->method);
+            begin_response(conn, 0);
+            return;
+        }
+    }
+
+    conn->state = CONN_READ_BODY;
+}
+
+// Decode the chunked body bytes received so far. Buffered bodies accumulate
+// behind the head; streamed ones are written out and dropped. Dispatches the
+// request once the last chunk arrived.
+static void process_chunked_body(connection_t *conn)
+{
+    http_request *request = conn->request;
+    char *body = conn->buffer + conn->header_len + conn->body_decoded;
+    size_t available = conn->buffer_len - conn->header_len - conn->body_decoded;
+    size_t consumed = available;
+    size_t decoded;
+    int rc = http_chunked_decode(&conn->chunked, body, &consumed, body, &decoded);
+
+    if (connection_is_streaming(conn) && decoded > 0 && store_body_bytes(conn, body, decoded) < 0)
+        return;
+
+    // Close the gap the framing left: the bytes after the body (pipelined
+    // requests) move up behind the data that is kept
+    size_t kept = connection_is_streaming(conn) ? 0 : decoded;
+    memmove(body + kept, body + consumed, available - consumed);
+    conn->buffer_len -= consumed - kept;
+    conn->buffer[conn->buffer_len] = '\0';
+    conn->body_decoded += kept;
+
+    if (rc == 0)
+        return; // wait for more
+
+    if (rc < 0)
+    {
+        if (connection_is_streaming(conn))
+            end_body_stream(conn, rc);
+        handle_read_body_status(rc, conn, "close", request->method);
+        begin_response(conn, 0);
+        return;
+    }
+
+    if (connection_is_streaming(conn))
+    {
+        complete_body_stream(conn);
+        return;
+    }
+
+    metrics_record_since(METRICS_PHASE_READ_BODY, conn->head_done);
+    request->body = conn->buffer + conn->header_len;
+    request->body_length = conn->body_decoded;
+    LOG_DEBUG("Chunked request body: %zu bytes", request->body_length);
+
+    int keep_alive = dispatch_request(conn, request);
+    begin_response(conn, keep_alive);
+}
+
+// Dispatch the request once its body (if any) is fully buffered
+static void process_body(connection_t *conn)
+{
+    http_request *request = conn->request;
+    if (request->chunked)
+    {
+        process_chunked_body(conn);
+        return;
+    }
+    if (connection_is_streaming(conn))
+    {
+        store_buffered_body(conn);
+        return;
+    }
+
+    size_t body_already_read = conn->buffer_len - conn->header_len;
+
+    if (body_already_read < request->content_length)
+        return; // wait for more
+
+    if (request->content_length > 0)
+    {
+        metrics_record_since(METRICS_PHASE_READ_BODY, conn->head_done);
+        request->body = conn->buffer + conn->header_len;
+        request->body_length = request->content_length;
+
+        LOG_DEBUG("Request body: %zu bytes", request->body_length);
+        // For debugging, print first 100 chars of body
+        LOG_DEBUG("Body preview: %.*s%s", (int)(request->body_length < 100 ? request->body_length : 100),
+                  request->body, (request->body_length > 100) ? "..." : "");
+    }
+
+    int keep_alive = dispatch_request(conn, request);
+    begin_response(conn, keep_alive);
+}
+
+void connection_process_input(connection_t *conn)
+{
+    if (conn->h2)
+    {
+        http2_process_input(conn);
+        return;
+    }
+
+    // A plain connection whose first bytes are the HTTP/2 preface speaks h2c
+    // (prior knowledge). Until they tell either way, wait for more.
+    if (server_config.http2 && !conn->tls && conn->requests_served == 0 && !conn->request &&
+        conn->state == CONN_READ_HEADERS && conn->buffer_len > 0)
+    {
+        int rc = http2_check_preface(conn->buffer, conn->buffer_len);
+        if (rc == 0)
+            return;
+        if (rc > 0)
+        {
+            if (http2_start(conn) == 0)
+                http2_process_input(conn);
+            else
+            {
+                conn->close_after_write = 1;
+                conn->state = CONN_WRITING;
+            }
+            return;
+        }
+    }
+
+    for (int batched = 1;; batched++)
+    {
+        if (conn->state == CONN_READ_HEADERS)
+        {
+            // The parser resumes where the previous read left off, so each byte
+            // of the head is examined once however it was split across reads
+            if (!parse_input(conn))
+                break;
+
+            LOG_DEBUG("Found complete headers (%zu bytes)", conn->header_len);
+            process_headers(conn);
+        }
+
+        if (conn->state == CONN_READ_BODY)
+            process_body(conn);
+
+        if (conn->state != CONN_WRITING)
+            break; // request incomplete
+
+        // Pipelining: answer requests already buffered behind this one before
+        // flushing, so their responses leave together, in order
+        if (conn->close_after_write || conn->buffer_len == 0 || batched == PIPELINE_MAX_BATCH)
+            return;
+        conn->state = CONN_READ_HEADERS;
+    }
+
+    // The next request is incomplete: send what this batch answered first
+    if (conn->out_head)
+        conn->state = CONN_WRITING;
+}
+
+void connection_on_read_error(connection_t *conn, int status)
+{
+    if (conn->h2)
+    {
+        // Open streams die with the connection: send what is queued and close
+        conn->close_after_write = 1;
+        conn->state = CONN_WRITING;
+        return;
+    }
+    if (conn->state == CONN_READ_HEADERS)
+    {
+        // Client close: idle vs partial
+        if (status == HTTP_IO_EOF && conn->buffer_len > 0)
+            status = HTTP_IO_EOF_PARTIAL;
+        handle_read_headers_status(status, conn, NULL);
+    }
+    else if (conn->state == CONN_READ_BODY)
+    {
+        if (status == HTTP_IO_EOF)
+        {
+            LOG_INFO("EOF mid-body");
+            status = HTTP_IO_EOF_PARTIAL;
+        }
+        if (connection_is_streaming(conn))
+            end_body_stream(conn, status);
+        handle_read_body_status(status, conn, "close", conn->request->method);
+    }
+    begin_response(conn, 0);
+}
+
+int connection_on_response_sent(connection_t *conn)
+{
+    if (conn->write_start)
+    {
+        metrics_record_since(METRICS_PHASE_WRITE, conn->write_start);
+        conn->write_start = 0;
+    }
+    if (conn->close_after_write)
+        return 0;
+    if (conn->h2)
+        return http2_on_output_sent(conn);
+
+    // Responses sent: go back to reading. A request may already be partly
+    // parsed (its head complete if header_len is set), and pipelined bytes
+    // left over from the batch may hold further complete requests.
+    conn->state = conn->header_len ? CONN_READ_BODY : CONN_READ_HEADERS;
+    if (conn->buffer_len > 0)
+        connection_process_input(conn);
+    return 1;
+}
+
+int connection_on_events(connection_t *conn, uint32_t events)
+{
+    if (events & EPOLLERR)
+        return 0;
+
+    for (;;)
+    {
+        if (conn->state == CONN_TLS_HANDSHAKE)
+        {
+            int rc = tls_handshake(conn->tls);
+            if (rc == 0)
+                return 1; // wait for the client's next flight
+            if (rc < 0)
+            {
+                metrics_count_tls_handshake(METRICS_TLS_FAILED);
+                return 0;
+            }
+            metrics_count_tls_handshake(tls_resumed(conn->tls) ? METRICS_TLS_RESUMED : METRICS_TLS_FULL);
+            conn->tls_kernel_send = tls_kernel_send(conn->tls);
+            if (conn->tls_kernel_send)
+                metrics_count_tls_kernel_send();
+            conn->state = CONN_READ_HEADERS;
+            if (server_config.http2 && tls_alpn_h2(conn->tls) && http2_start(conn) < 0)
+                return 0;
+            continue; // the first request may have arrived with the Finished message
+        }
+
+        if (conn->state == CONN_WRITING)
+        {
+            int rc = flush_out_queue(conn);
+            if (rc < 0)
+                return 0;
+            if (rc == 0)
+            {
+                // HTTP/2 reads on while output waits, so that WINDOW_UPDATEs
+                // and new streams do not queue up behind a slow download
+                if (!conn->h2 || conn->close_after_write)
+                    return 1; // wait for EPOLLOUT
+                int status;
+                rc = fill_buffer(conn, &status);
+                if (rc == 0)
+                    return 1; // wait for either
+                if (rc < 0)
+                    connection_on_read_error(conn, status);
+                else
+                    http2_process_input(conn);
+                continue;
+            }
+            if (!connection_on_response_sent(conn))
+                return 0;
+            continue; // edge-triggered: the next request may already be waiting
+        }
+
+        // A streamed body bypasses the buffer: the socket is spliced to its file
+        int status;
+        int splicing = connection_splices_body(conn);
+        int rc = splicing ? stream_body(conn, &status) : fill_buffer(conn, &status);
+        if (rc == 0)
+            return 1; // wait for EPOLLIN
+
+        if (rc < 0)
+            connection_on_read_error(conn, status);
+        else if (!splicing)
+            connection_process_input(conn);
+    }
+}
+
+void connection_on_timeout(connection_t *conn)
+{
+    if (conn->h2)
+    {
+        http2_on_timeout(conn);
+        flush_out_queue(conn); // best effort, as below
+        return;
+    }
+
+    if (conn->state == CONN_READ_HEADERS)
+    {
+        // Timeout: idle vs partial
+        int partial = conn->buffer_len > 0;
+        metrics_count_timeout(partial);
+        handle_read_headers_status(partial ? HTTP_IO_TIMEOUT_PARTIAL : HTTP_IO_TIMEOUT, conn, NULL);
+    }
+    else if (conn->state == CONN_READ_BODY)
+    {
+        LOG_INFO("Timeout mid-body");
+        metrics_count_timeout(1);
+        if (connection_is_streaming(conn))
+            end_body_stream(conn, HTTP_IO_TIMEOUT_PARTIAL);
+        handle_read_body_status(HTTP_IO_TIMEOUT_PARTIAL, conn, "close", conn->request->method);
+    }
+
+    connection_request_completed(conn);
+
+    // Best effort: the connection is closed right after
+    flush_out_queue(conn);
+}
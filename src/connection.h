@@ -0,0 +1,267 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "http_request.h"
+#include "http_chunked.h"
+
+#define PIPELINE_MAX_BATCH 16 // pipelined requests answered per flush
+#define CONN_SEND_IOV 16      // memory chunks gathered into one send
+#define CONN_TLS_RECORD 16384 // response bytes encrypted per user-space TLS record
+
+struct ssl_st;
+struct http2_session;
+struct lent_buffer;
+
+// Where a connection is in its request/response cycle
+typedef enum
+{
+    CONN_TLS_HANDSHAKE, // TLS connection before its first request: handshake in progress
+    CONN_READ_HEADERS, // waiting for the end of the header block (\r\n\r\n)
+    CONN_READ_BODY,    // headers parsed, waiting for the body (Content-Length or chunked)
+    CONN_WRITING,      // response queued, flushing to the socket
+} conn_state_t;
+
+// Called when a borrowed chunk is done with (sent or discarded)
+typedef void (*chunk_release_fn)(void *owner);
+
+// Queued piece of a response: either bytes at `base` or a file range (fd >= 0).
+// Copied chunks own their bytes (in `data`) and their fd; borrowed chunks point
+// at memory or a file someone else owns and call `release` when finished.
+typedef struct out_chunk
+{
+    struct out_chunk *next;
+    int fd;         // -1 for in-memory data, otherwise file to send from
+    int use_splice; // sendfile() refused this file, move it through the pipe instead
+    off_t offset;   // next byte to send (file: file offset, memory: index into base)
+    size_t remain;  // bytes still to send
+    const char *base; // in-memory bytes: `data` or borrowed memory
+    chunk_release_fn release; // NULL if the chunk owns its bytes/fd, or they outlive it
+    void *owner;
+    int owns_fd; // fd came from connection_send_file() and is closed with the chunk
+    char data[];
+} out_chunk_t;
+
+typedef struct connection
+{
+    int fd;
+    conn_state_t state;
+    struct sockaddr_in peer; // client address, for the access log
+
+    // Receive buffer from the worker's buffer pool. Starts in the smallest
+    // size class and grows as a request needs it, up to MAX_REQUEST_SIZE.
+    // NULL while nothing is buffered, so idle keep-alive connections hold none.
+    char *buffer;
+    size_t buffer_cap; // usable bytes (one more is allocated for the terminating '\0')
+    size_t buffer_len; // bytes currently held in buffer
+    size_t header_len; // bytes of request line + headers including \r\n\r\n, 0 until known
+    struct lent_buffer *lent_buffer; // set while queued chunks point into the buffer (connection_send_buffer_ref())
+    http_parser_t parser; // parses the request head as bytes arrive
+
+    // Chunked request body: decoded in place as it arrives, the data compacted
+    // right behind the head (or written out and dropped while streaming)
+    http_chunked_t chunked;
+    size_t body_decoded; // decoded body bytes held after the head
+
+    // Request being processed. Allocated when its first bytes arrive and
+    // released after the response is queued, so idle connections do not hold it.
+    http_request *request;
+    unsigned int requests_served;
+
+    // Pending response bytes
+    out_chunk_t *out_head;
+    out_chunk_t *out_tail;
+    int close_after_write; // close once the queue drains
+
+    // Outcome of the request being answered, logged once it completes
+    int response_status;   // 0 until a response is queued
+    size_t response_bytes; // body bytes of that response
+
+    // Phase timestamps of the request in progress (metrics_now(), 0 = not reached)
+    uint64_t request_start; // first byte of the request handed to the parser
+    uint64_t head_done;     // request head parsed
+    uint64_t parse_ns;      // parser time so far, over every resumed call
+    uint64_t write_start;   // first response of the current batch queued
+
+    // Timeout bookkeeping, owned by the event loop
+    struct connection *timer_prev;
+    struct connection *timer_next;
+    void *timer_list;
+    long long deadline;
+
+    // splice() path for file bodies: file -> pipe -> socket without copying
+    // through user space, and for streamed request bodies: socket -> pipe ->
+    // file. Created on first use, kept for the connection lifetime.
+    int pipe_fds[2];
+    size_t pipe_pending; // bytes sitting in the pipe, not yet moved out
+
+    // Streamed request body (see connection_stream_body()), body_fd -1 otherwise
+    int body_fd;
+    off_t body_offset;     // file offset of the next stored byte
+    size_t body_remaining; // body bytes not yet taken from the socket
+    void *body_upload;     // handler state, handed back when the body ends
+
+    // TLS session, NULL for plain HTTP. With kTLS the kernel encrypts and the
+    // queue is sent exactly as in plaintext; otherwise response bytes are
+    // staged a record at a time and encrypted in user space.
+    struct ssl_st *tls;
+    int tls_kernel_send;   // kTLS transmit active
+    char *tls_stage;       // staged plaintext (pool buffer), NULL while nothing is staged
+    size_t tls_staged;     // bytes staged
+    size_t tls_stage_sent; // of which already encrypted and sent
+
+    // HTTP/2 session (see http2.h), NULL while the connection speaks HTTP/1.x.
+    // The receive buffer then holds frames and the queue carries frames of
+    // every stream; requests live in per-stream connections of the session.
+    struct http2_session *h2;
+
+    // io_uring backend bookkeeping (unused by the epoll loop)
+    int inflight; // submitted operations not yet completed
+    int closing;  // destroy once inflight drops to zero
+    struct iovec send_iov[CONN_SEND_IOV]; // gathered chunks of the SENDMSG in flight
+    struct msghdr send_msg;
+} connection_t;
+
+// New connection on accepted socket `fd`, starting with a TLS handshake
+// when TLS is enabled
+connection_t *connection_create(int fd);
+void connection_destroy(connection_t *conn);
+
+// Advance the connection state machine after epoll reported `events`.
+// Reads, parses, dispatches and writes until the socket would block.
+// Returns 1 to keep the connection open, 0 when it must be closed.
+int connection_on_events(connection_t *conn, uint32_t events);
+
+// ----- Backend-neutral state machine steps -----
+// The epoll loop drives these through connection_on_events(); completion
+// based backends call them directly as their operations finish.
+
+// Copy received bytes into the request buffer.
+// Returns 0, or a negative http_io_status_t if they do not fit.
+int connection_append(connection_t *conn, const char *data, size_t len);
+
+// Run the parser over the buffered bytes. Pipelined requests already in the
+// buffer are answered in the same pass (up to PIPELINE_MAX_BATCH), their
+// responses queued in order. Leaves the connection either waiting for more
+// input or in CONN_WRITING with responses queued.
+void connection_process_input(connection_t *conn);
+
+// Reading failed with http_io_status_t `status` (HTTP_IO_EOF for a clean
+// close). Queues the matching error response, if any, and switches to writing.
+void connection_on_read_error(connection_t *conn, int status);
+
+// The response queue drained. Returns 1 if the connection was reset for the
+// next keep-alive request (parsing any pipelined bytes already buffered,
+// which may queue more responses), 0 if it must be closed.
+int connection_on_response_sent(connection_t *conn);
+
+// Make room for `size` bytes in the receive buffer, moving into a larger pool
+// buffer if needed (the request is repointed). Returns 0 or -1.
+int connection_reserve_buffer(connection_t *conn, size_t size);
+
+// Let go of the receive buffer: back to the pool, or, if it is lent to
+// queued chunks, to them. Leaves the connection without a buffer.
+void connection_release_buffer(connection_t *conn);
+
+// Count the request just answered and write its access log line
+void connection_request_completed(connection_t *conn);
+
+// Drop the fully sent chunk at the head of the response queue
+void connection_pop_chunk(connection_t *conn);
+
+// Gather the in-memory chunks at the head of the queue (up to the first file
+// chunk) into `iov`. Returns the iovec count; `*more` is set when a file
+// chunk follows, so the caller can hold the segment open with MSG_MORE.
+int connection_gather_iov(connection_t *conn, struct iovec *iov, int max_iov, int *more);
+
+// Account `sent` bytes of a gathered send, popping the chunks it completed
+void connection_advance_sent(connection_t *conn, size_t sent);
+
+// Create the connection's splice pipe if it does not exist yet. Returns 0 or -1.
+int connection_open_pipe(connection_t *conn);
+
+// ----- Streamed request bodies -----
+// A handler that takes a request body as a stream opens its destination and
+// calls connection_stream_body() from prepare_request_body(). Body bytes then
+// move socket -> pipe -> file with splice() and never enter user space,
+// except those that arrived along with the head; memory use stays constant
+// whatever the body size. A chunked body is read into the request buffer,
+// decoded and written out piece by piece, which is just as bounded. The
+// epoll loop drives this inside connection_on_events(); completion based
+// backends submit the splices themselves and report each step below.
+
+// Store the rest of the request body in `fd` from `offset` on. `upload` is
+// handed back to finish_streamed_body() once the body is complete or abandoned.
+void connection_stream_body(connection_t *conn, int fd, off_t offset, void *upload);
+
+// 1 while the request body is being streamed to a file
+static inline int connection_is_streaming(const connection_t *conn)
+{
+    return conn->body_fd >= 0;
+}
+
+// 1 while body bytes go socket -> pipe -> file. Chunked bodies are streamed
+// through the request buffer instead: their framing has to be decoded. So
+// are bodies arriving over TLS, which must be decrypted.
+static inline int connection_splices_body(const connection_t *conn)
+{
+    return conn->body_fd >= 0 && !conn->request->chunked && !conn->tls;
+}
+
+// `len` body bytes were spliced from the socket into the pipe
+void connection_body_received(connection_t *conn, size_t len);
+
+// `len` bytes moved from the pipe into the file. Once the whole body is
+// stored, the handler queues its response and the connection switches to
+// writing.
+void connection_body_stored(connection_t *conn, size_t len);
+
+// Storing the body failed: abandons the upload and queues a 500
+void connection_body_store_failed(connection_t *conn);
+
+// Called when the connection outlived its deadline. Sends 408 if a request
+// was partially received; the caller closes the connection afterwards.
+void connection_on_timeout(connection_t *conn);
+
+// 1 if the connection is parked between requests with nothing buffered
+int connection_is_idle(const connection_t *conn);
+
+// Record the status and body size of the response being queued (access log)
+static inline void connection_set_response(connection_t *conn, int status, size_t body_bytes)
+{
+    conn->response_status = status;
+    conn->response_bytes = body_bytes;
+}
+
+// Queue bytes for sending (copied)
+int connection_send(connection_t *conn, const void *data, size_t len);
+
+// Queue the concatenation of `count` fragments as one chunk (copied)
+int connection_sendv(connection_t *conn, const struct iovec *iov, int count);
+
+// Queue `len` bytes of file `fd` starting at `offset`. Takes ownership of fd.
+int connection_send_file(connection_t *conn, int fd, off_t offset, size_t len);
+
+// Borrowed variants: queue memory or a file range without copying or taking
+// ownership. `release(owner)` runs once the chunk is sent or discarded, and
+// also when queuing fails, so the caller hands its reference over either way.
+// Memory or files that live for the whole process may be queued with a NULL
+// release.
+int connection_send_ref(connection_t *conn, const void *data, size_t len,
+                        chunk_release_fn release, void *owner);
+int connection_send_file_ref(connection_t *conn, int fd, off_t offset, size_t len,
+                             chunk_release_fn release, void *owner);
+
+// Queue `len` bytes of the receive buffer (the request body, say) without
+// copying them. The buffer is lent to the chunk and returns to the pool once
+// the chunk is done with; pipelined bytes behind the request move to a fresh
+// buffer meanwhile.
+int connection_send_buffer_ref(connection_t *conn, const char *data, size_t len);
+
+#endif
@@ -1,128 +1,57 @@
 #include <stdio.h>
 #include <string.h>
-#include <sys/types.h>
-#include <sys/socket.h>
 
 #include "http_errors.h"
 #include "error_handlers.h"
 #include "response_utils.h"
 #include "http_mappings.h"
 #include "string_utils.h"
+#include "error_pages.h"
+#include "log.h"
 
 // Send error response
-void send_error_response(int client_fd, int status_code, const char *status_text, const char *connection_header, const char *method)
+void send_error_response(connection_t *conn, int status_code, const char *status_text, const char *connection_header, const char *method)
 {
-    char headers[1024] = {0};
-    size_t offset = 0;
-    char body[256];
-
-    snprintf(body, sizeof(body),
-             "<html><body><h1>%d %s</h1></body></html>",
-             status_code, status_text);
-
-    offset += snprintf(headers + offset, sizeof(headers) - offset,
-                       "HTTP/1.1 %d %s\r\n", status_code, status_text);
-    add_date_header(headers, &offset, sizeof(headers));
-    offset += snprintf(headers + offset, sizeof(headers) - offset,
-                       "Content-Type: text/html\r\n"
-                       "Content-Length: %d\r\n"
-                       "Connection: %s\r\n",
-                       (method && str_case_cmp(method, "HEAD") == 0)
-                           ? 0
-                           : (int)strlen(body),
-                       connection_header);
-
-    if (offset >= sizeof(headers))
+    int head_only = method && str_case_cmp(method, "HEAD") == 0;
+    if (error_page_send(conn, status_code, connection_header, head_only))
     {
-        fprintf(stderr, "Error: Headers buffer too small\n");
+        LOG_DEBUG("Sent %d %s response", status_code, status_text);
         return;
     }
 
-    // Combine headers and body, if not HEAD
-    if (!method || str_case_cmp(method, "HEAD") != 0)
-    {
-        size_t body_len = strlen(body);
-        if (offset + body_len < sizeof(headers))
-        {
-            memcpy(headers + offset, body, body_len);
-            offset += body_len;
-        }
-        else
-        {
-            fprintf(stderr, "Error: Headers+body buffer too small\n");
-            return;
-        }
-    }
-
-    if (send(client_fd, headers, offset, 0) < 0)
-    {
-        perror("send failed");
-    }
-    printf("Sent %d %s response\n", status_code, status_text);
+    // Not pre-rendered: build it now. 405 must still list the allowed methods.
+    send_error_response_with_headers(conn, status_code, status_text, connection_header,
+                                     status_code == 405 ? build_allow_header() : NULL, method);
 }
 
-// Minimal helper that can attach extra headers (e.g., Allow:)
-void send_error_response_with_headers(int client_fd, int status_code, const char *status_text, const char *connection_header, const char *extra_headers, const char *method)
+// Variant that can attach extra headers (e.g., Allow:)
+void send_error_response_with_headers(connection_t *conn, int status_code, const char *status_text, const char *connection_header, const char *extra_headers, const char *method)
 {
-    char headers[1536] = {0};
-    size_t offset = 0;
     char body[256];
-
-    // Body
-    snprintf(body, sizeof(body),
-             "<html><body><h1>%d %s</h1></body></html>",
-             status_code, status_text);
-
-    // Status line
-    offset += snprintf(headers + offset, sizeof(headers) - offset,
-                       "HTTP/1.1 %d %s\r\n", status_code, status_text);
-
-    add_date_header(headers, &offset, sizeof(headers));
-
-    // Extra headers (e.g., Allow:)
+    int body_len = snprintf(body, sizeof(body),
+                            "<html><body><h1>%d %s</h1></body></html>",
+                            status_code, status_text);
+    if (body_len < 0 || (size_t)body_len >= sizeof(body))
+        body_len = (int)strlen(body);
+    int head_only = method && str_case_cmp(method, "HEAD") == 0;
+
+    connection_set_response(conn, status_code, head_only ? 0 : (size_t)body_len);
+    response_builder_t response;
+    response_begin(&response, status_code, status_text);
     if (extra_headers && *extra_headers)
-    {
-        offset += snprintf(headers + offset, sizeof(headers) - offset, "%s", extra_headers);
-    }
-
-    // Standard headers
-    offset += snprintf(headers + offset, sizeof(headers) - offset,
-                       "Content-Type: text/html\r\n"
-                       "Content-Length: %d\r\n"
-                       "Connection: %s\r\n",
-                       (method && str_case_cmp(method, "HEAD") == 0)
-                           ? 0
-                           : (int)strlen(body),
-                       connection_header);
-
-    if (offset >= sizeof(headers))
+        response_add(&response, extra_headers, strlen(extra_headers));
+    response_add_literal(&response, "Content-Type: text/html\r\n");
+    response_add_content_length(&response, (size_t)body_len);
+    response_add_connection(&response, connection_header);
+    if (response_finish(&response, conn, head_only ? NULL : body, (size_t)body_len) < 0)
         return;
 
-    // Combine headers and body, if not HEAD
-    if (!method || str_case_cmp(method, "HEAD") != 0)
-    {
-        size_t body_len = strlen(body);
-        if (offset + body_len < sizeof(headers))
-        {
-            memcpy(headers + offset, body, body_len);
-            offset += body_len;
-        }
-        else
-        {
-            return;
-        }
-    }
-
-    if (send(client_fd, headers, offset, 0) < 0)
-    {
-        perror("send failed");
-    }
-    printf("Sent %d %s response\n", status_code, status_text);
+    LOG_DEBUG("Sent %d %s response", status_code, status_text);
 }
 
 // ----- Phase-specific helpers -----
 
-int handle_read_headers_status(int rc, int client_fd, const char *method)
+int handle_read_headers_status(int rc, connection_t *conn, const char *method)
 {
     if (rc > 0)
         return 1;
@@ -130,22 +59,22 @@ int handle_read_headers_status(int rc, int client_fd, const char *method)
     switch (rc)
     {
     case HTTP_IO_EOF:
-        printf("Client closed connection\n");
+        LOG_DEBUG("Client closed connection");
         return 0;
     case HTTP_IO_TIMEOUT:
-        printf("Keep-alive timeout expired\n");
+        LOG_DEBUG("Keep-alive timeout expired");
         return 0; // quiet close (no 408)
     case HTTP_IO_TIMEOUT_PARTIAL:
-        send_error_response(client_fd, 408, "Request Timeout", "close", method);
+        send_error_response(conn, 408, "Request Timeout", "close", method);
         return 0;
     case HTTP_IO_EOF_PARTIAL:
-        send_error_response(client_fd, 400, "Bad Request", "close", method);
+        send_error_response(conn, 400, "Bad Request", "close", method);
         return 0;
     case HTTP_HEADERS_TOO_LARGE:
-        send_error_response(client_fd, 431, "Request Header Fields Too Large", "close", method);
+        send_error_response(conn, 431, "Request Header Fields Too Large", "close", method);
         return 0;
     case HTTP_PARSE_ERROR:
-        send_error_response(client_fd, 400, "Bad Request", "close", method);
+        send_error_response(conn, 400, "Bad Request", "close", method);
         return 0;
     case HTTP_IO_ERROR:
     default:
@@ -154,7 +83,7 @@ int handle_read_headers_status(int rc, int client_fd, const char *method)
     }
 }
 
-int handle_request_line_status(int rc, int client_fd, const char *method)
+int handle_request_line_status(int rc, connection_t *conn, const char *method)
 {
     if (rc > 0)
         return 1;
@@ -162,25 +91,25 @@ int handle_request_line_status(int rc, int client_fd, const char *method)
     switch (rc)
     {
     case HTTP_URI_TOO_LONG:
-        send_error_response(client_fd, 414, "URI Too Long", "close", method);
+        send_error_response(conn, 414, "URI Too Long", "close", method);
         return 0;
     case HTTP_VERSION_UNSUPPORTED:
-        send_error_response(client_fd, 505, "HTTP Version Not Supported", "close", method);
+        send_error_response(conn, 505, "HTTP Version Not Supported", "close", method);
         return 0;
     case HTTP_METHOD_NOT_ALLOWED:
-        send_error_response_with_headers(client_fd, 405, "Method Not Allowed", "close", build_allow_header(), method);
+        send_error_response(conn, 405, "Method Not Allowed", "close", method);
         return 0;
     case HTTP_NOT_IMPLEMENTED:
-        send_error_response(client_fd, 501, "Not Implemented", "close", method);
+        send_error_response(conn, 501, "Not Implemented", "close", method);
         return 0;
     case HTTP_PARSE_ERROR:
     default:
-        send_error_response(client_fd, 400, "Bad Request", "close", method);
+        send_error_response(conn, 400, "Bad Request", "close", method);
         return 0;
     }
 }
 
-int handle_parse_headers_status(int rc, int client_fd, const char *method)
+int handle_parse_headers_status(int rc, connection_t *conn, const char *method)
 {
     if (rc > 0)
         return 1;
@@ -188,16 +117,16 @@ int handle_parse_headers_status(int rc, int client_fd, const char *method)
     switch (rc)
     {
     case HTTP_HEADERS_TOO_LARGE:
-        send_error_response(client_fd, 431, "Request Header Fields Too Large", "close", method);
+        send_error_response(conn, 431, "Request Header Fields Too Large", "close", method);
         return 0;
     case HTTP_PARSE_ERROR:
     default:
-        send_error_response(client_fd, 400, "Bad Request", "close", method);
+        send_error_response(conn, 400, "Bad Request", "close", method);
         return 0;
     }
 }
 
-int handle_validate_status(int rc, int client_fd, const char *method)
+int handle_validate_status(int rc, connection_t *conn, const char *method)
 {
     if (rc > 0)
         return 1;
@@ -205,22 +134,22 @@ int handle_validate_status(int rc, int client_fd, const char *method)
     switch (rc)
     {
     case HTTP_LENGTH_REQUIRED:
-        send_error_response(client_fd, 411, "Length Required", "close", method);
+        send_error_response(conn, 411, "Length Required", "close", method);
         return 0;
     case HTTP_NOT_IMPLEMENTED:
-        send_error_response(client_fd, 501, "Not Implemented", "close", method);
+        send_error_response(conn, 501, "Not Implemented", "close", method);
         return 0;
     case HTTP_METHOD_NOT_ALLOWED:
-        send_error_response_with_headers(client_fd, 405, "Method Not Allowed", "close", build_allow_header(), method);
+        send_error_response(conn, 405, "Method Not Allowed", "close", method);
         return 0;
     case HTTP_PARSE_ERROR:
     default:
-        send_error_response(client_fd, 400, "Bad Request", "close", method);
+        send_error_response(conn, 400, "Bad Request", "close", method);
         return 0;
     }
 }
 
-int handle_read_body_status(int rc, int client_fd, const char *connection_header, const char *method)
+int handle_read_body_status(int rc, connection_t *conn, const char *connection_header, const char *method)
 {
     if (rc >= 0)
         return 1; // 0 == success/no-body
@@ -228,14 +157,18 @@ int handle_read_body_status(int rc, int client_fd, const char *connection_header
     switch (rc)
     {
     case HTTP_BODY_TOO_LARGE:
-        send_error_response(client_fd, 413, "Payload Too Large",
+        send_error_response(conn, 413, "Payload Too Large",
                             connection_header ? connection_header : "close", method);
         return 0;
     case HTTP_IO_TIMEOUT_PARTIAL:
-        send_error_response(client_fd, 408, "Request Timeout", "close", method);
+        send_error_response(conn, 408, "Request Timeout", "close", method);
         return 0;
     case HTTP_IO_EOF_PARTIAL:
-        send_error_response(client_fd, 400, "Bad Request", "close", method);
+    case HTTP_PARSE_ERROR: // malformed chunked framing
+        send_error_response(conn, 400, "Bad Request", "close", method);
+        return 0;
+    case HTTP_HEADERS_TOO_LARGE: // trailer section
+        send_error_response(conn, 431, "Request Header Fields Too Large", "close", method);
         return 0;
     case HTTP_IO_ERROR:
     default:
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "error_pages.h"
+#include "compress.h"
+#include "http_encoding.h"
+#include "response_utils.h"
+#include "log.h"
+
+enum
+{
+    VARIANT_CLOSE,
+    VARIANT_KEEP_ALIVE,
+    VARIANT_COUNT
+};
+
+// Bodies of a page: identity first, then one per content coding
+#define BODY_COUNT (1 + HTTP_ENCODING_COUNT)
+#define BODY_INDEX(encoding) ((encoding) + 1) // HTTP_ENCODING_IDENTITY is -1
+
+typedef struct
+{
+    int status_code;
+    const char *status_line;
+    size_t status_line_len;
+    char *head[VARIANT_COUNT][BODY_COUNT]; // headers after Date, through the blank line
+    size_t head_len[VARIANT_COUNT][BODY_COUNT];
+    char *body[BODY_COUNT]; // NULL for codings the page was not compressed with
+    size_t body_len[BODY_COUNT];
+    unsigned encodings; // codings with a compressed body (bit 1 << coding)
+    int custom;         // body loaded from the error page directory
+} error_page_t;
+
+// Every error status the server emits
+static error_page_t error_pages[] = {
+    {.status_code = 400}, {.status_code = 404}, {.status_code = 405}, {.status_code = 408},
+    {.status_code = 411}, {.status_code = 412}, {.status_code = 413}, {.status_code = 414},
+    {.status_code = 415}, {.status_code = 416}, {.status_code = 431}, {.status_code = 500},
+    {.status_code = 501}, {.status_code = 505},
+};
+
+#define ERROR_PAGE_COUNT (sizeof(error_pages) / sizeof(error_pages[0]))
+
+static const char *const variant_connection[VARIANT_COUNT] = {
+    [VARIANT_CLOSE] = "close",
+    [VARIANT_KEEP_ALIVE] = "keep-alive",
+};
+
+// Read `<dir>/<status>.html`. Returns the contents or NULL if there is no
+// usable file.
+static char *load_custom_page(const char *dir, int status_code, size_t *len)
+{
+    char path[1024];
+    int written = snprintf(path, sizeof(path), "%s/%d.html", dir, status_code);
+    if (written < 0 || (size_t)written >= sizeof(path))
+        return NULL;
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        if (errno != ENOENT)
+            LOG_WARN("Cannot open error page %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    char *body = malloc(ERROR_PAGE_MAX_SIZE + 1);
+    size_t read = body ? fread(body, 1, ERROR_PAGE_MAX_SIZE + 1, file) : 0;
+    int failed = ferror(file);
+    fclose(file);
+
+    if (!body || failed || read == 0 || read > ERROR_PAGE_MAX_SIZE)
+    {
+        LOG_WARN("Ignoring error page %s (unreadable, empty or over %d bytes)", path, ERROR_PAGE_MAX_SIZE);
+        free(body);
+        return NULL;
+    }
+
+    *len = read;
+    return body;
+}
+
+static int render_page(error_page_t *page, const char *dir)
+{
+    page->status_line = response_status_line(page->status_code, &page->status_line_len);
+    const char *status_text = response_status_text(page->status_code);
+    if (!page->status_line || !status_text)
+        return -1;
+
+    char **body = &page->body[BODY_INDEX(HTTP_ENCODING_IDENTITY)];
+    size_t *body_len = &page->body_len[BODY_INDEX(HTTP_ENCODING_IDENTITY)];
+    *body = dir ? load_custom_page(dir, page->status_code, body_len) : NULL;
+    page->custom = *body != NULL;
+    if (!*body)
+    {
+        char text[256];
+        int len = snprintf(text, sizeof(text), "<html><body><h1>%d %s</h1></body></html>",
+                           page->status_code, status_text);
+        *body = malloc((size_t)len);
+        if (!*body)
+            return -1;
+        memcpy(*body, text, (size_t)len);
+        *body_len = (size_t)len;
+    }
+
+    // Pages big enough to be worth it (custom ones, in practice) are also
+    // compressed here, once, with every coding available
+    if (compress_eligible("text/html", *body_len))
+    {
+        for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+        {
+            if (!(compress_supported() & (1u << i)))
+                continue;
+            size_t len;
+            char *compressed = compress_buffer((http_encoding_t)i, *body, *body_len, &len);
+            if (compressed && len < *body_len)
+            {
+                page->body[BODY_INDEX(i)] = compressed;
+                page->body_len[BODY_INDEX(i)] = len;
+                page->encodings |= 1u << i;
+            }
+            else
+                free(compressed);
+        }
+    }
+
+    // 405 always advertises the allowed methods
+    const char *allow = page->status_code == 405 ? build_allow_header() : "";
+    const char *vary = page->encodings ? HTTP_VARY_ACCEPT_ENCODING : "";
+
+    for (int variant = 0; variant < VARIANT_COUNT; variant++)
+    {
+        size_t connection_len;
+        const char *connection = response_connection_line(variant_connection[variant], &connection_len);
+        for (int b = 0; b < BODY_COUNT; b++)
+        {
+            if (!page->body[b])
+                continue;
+            size_t encoding_len = 0;
+            const char *encoding = b == BODY_INDEX(HTTP_ENCODING_IDENTITY)
+                                       ? ""
+                                       : http_content_encoding_line((http_encoding_t)(b - 1), &encoding_len);
+            char head[512];
+            int len = snprintf(head, sizeof(head),
+                               "%sContent-Type: text/html\r\n"
+                               "%.*s%s"
+                               "Content-Length: %zu\r\n"
+                               "%.*s\r\n",
+                               allow, (int)encoding_len, encoding, vary, page->body_len[b], (int)connection_len,
+                               connection);
+            if (len < 0 || (size_t)len >= sizeof(head))
+                return -1;
+            page->head[variant][b] = malloc((size_t)len);
+            if (!page->head[variant][b])
+                return -1;
+            memcpy(page->head[variant][b], head, (size_t)len);
+            page->head_len[variant][b] = (size_t)len;
+        }
+    }
+    return 0;
+}
+
+int error_pages_init(const char *dir)
+{
+    int custom = 0;
+    for (size_t i = 0; i < ERROR_PAGE_COUNT; i++)
+    {
+        if (render_page(&error_pages[i], dir) < 0)
+        {
+            LOG_ERROR("Failed to render the %d error response", error_pages[i].status_code);
+            return -1;
+        }
+        custom += error_pages[i].custom;
+    }
+
+    if (dir)
+        LOG_INFO("Loaded %d custom error page%s from %s", custom, custom == 1 ? "" : "s", dir);
+    return 0;
+}
+
+static const error_page_t *find_page(int status_code)
+{
+    for (size_t i = 0; i < ERROR_PAGE_COUNT; i++)
+    {
+        if (error_pages[i].status_code == status_code)
+            return error_pages[i].head[0][0] ? &error_pages[i] : NULL;
+    }
+    return NULL;
+}
+
+int error_page_send(connection_t *conn, int status_code, const char *connection_header, int head_only)
+{
+    int variant;
+    if (strcmp(connection_header, variant_connection[VARIANT_CLOSE]) == 0)
+        variant = VARIANT_CLOSE;
+    else if (strcmp(connection_header, variant_connection[VARIANT_KEEP_ALIVE]) == 0)
+        variant = VARIANT_KEEP_ALIVE;
+    else
+        return 0;
+
+    const error_page_t *page = find_page(status_code);
+    if (!page)
+        return 0;
+
+    // A compressed body if the request (as far as it was parsed) accepts one
+    int b = BODY_INDEX(HTTP_ENCODING_IDENTITY);
+    if (page->encodings && conn->request)
+    {
+        http_accept_encoding_t accept;
+        http_accept_encoding_parse(http_request_header(conn->request, HTTP_HEADER_ACCEPT_ENCODING), &accept);
+        b = BODY_INDEX(http_accept_encoding_select(&accept, page->encodings));
+    }
+
+    // Only the Date line changes between responses
+    size_t date_len;
+    const char *date = response_date_line(&date_len);
+    struct iovec parts[3] = {
+        {(void *)page->status_line, page->status_line_len},
+        {(void *)date, date_len},
+        {page->head[variant][b], page->head_len[variant][b]},
+    };
+    connection_set_response(conn, status_code, head_only ? 0 : page->body_len[b]);
+    if (connection_sendv(conn, parts, 3) < 0)
+        return 1; // connection is marked for closing, nothing more to send
+
+    if (!head_only)
+        connection_send_ref(conn, page->body[b], page->body_len[b], NULL, NULL);
+    return 1;
+}
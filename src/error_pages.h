@@ -0,0 +1,25 @@
+#ifndef ERROR_PAGES_H
+#define ERROR_PAGES_H
+
+#include "connection.h"
+
+#define ERROR_PAGE_MAX_SIZE (64 * 1024) // larger custom pages are ignored
+
+// Error responses rendered once at startup. Every 4xx/5xx status the server
+// emits gets its body and, for Connection: close and keep-alive, everything
+// after the Date line pre-rendered into immutable buffers. Sending one copies
+// the short head and queues the body by reference.
+//
+// If `dir` is set, `<dir>/<status>.html` replaces the built-in body for that
+// status. Files are read here, once; later edits need a restart. Pages large
+// enough to compress are also kept gzip/zstd-compressed, chosen per request
+// by Accept-Encoding.
+// Call before the workers start. Returns 0, or -1 on allocation failure.
+int error_pages_init(const char *dir);
+
+// Queue the pre-rendered response for `status_code`. HEAD responses carry the
+// same head without the body. Returns 1 if sent, 0 if there is no
+// pre-rendered variant (unknown status or an unusual Connection value).
+int error_page_send(connection_t *conn, int status_code, const char *connection_header, int head_only);
+
+#endif
@@ -0,0 +1,158 @@
+#define _GNU_SOURCE // accept4()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "event_loop.h"
+#include "server_config.h"
+#include "log.h"
+
+#define MAX_EVENTS 256
+
+// Re-arm the connection's timeout on the list matching its state
+static void touch_connection(event_loop_t *loop, connection_t *conn)
+{
+    timer_touch(connection_is_idle(conn) ? &loop->keep_alive_timers : &loop->read_timers, conn);
+}
+
+static void close_connection(event_loop_t *loop, connection_t *conn)
+{
+    timer_unlink(conn);
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    connection_destroy(conn);
+    loop->connection_count--;
+    LOG_DEBUG("Connection closed");
+}
+
+static void expire_timers(event_loop_t *loop, timer_list_t *list, long long now)
+{
+    while (list->head && list->head->deadline <= now)
+    {
+        connection_t *conn = list->head;
+        connection_on_timeout(conn);
+        close_connection(loop, conn);
+    }
+}
+
+// ----- Accept -----
+
+static void accept_clients(event_loop_t *loop)
+{
+    for (;;)
+    {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+
+        int client_fd = accept4(loop->listen_fd, (struct sockaddr *)&client_addr, &client_len,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            LOG_WARN("accept() failed: %s", strerror(errno));
+            return; // e.g. EMFILE: retry on the next readiness notification
+        }
+
+        connection_t *conn = connection_create(client_fd);
+        if (!conn)
+        {
+            LOG_ERROR("Failed to allocate connection");
+            close(client_fd);
+            continue;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0)
+        {
+            LOG_WARN("epoll_ctl() failed: %s", strerror(errno));
+            connection_destroy(conn);
+            continue;
+        }
+
+        conn->peer = client_addr;
+        loop->connection_count++;
+        touch_connection(loop, conn);
+
+        LOG_DEBUG("New connection from %s:%d",
+                  inet_ntoa(client_addr.sin_addr),
+                  ntohs(client_addr.sin_port));
+    }
+}
+
+// ----- Loop -----
+
+int event_loop_init(event_loop_t *loop, int listen_fd)
+{
+    memset(loop, 0, sizeof(*loop));
+    loop->listen_fd = listen_fd;
+    loop->read_timers.timeout_sec = READ_TIMEOUT_SEC;
+    loop->keep_alive_timers.timeout_sec = KEEP_ALIVE_TIMEOUT_SEC;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0)
+    {
+        perror("epoll_create1() failed");
+        return -1;
+    }
+
+    // The listening socket is identified by a NULL data pointer
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+    {
+        perror("epoll_ctl() failed");
+        close(loop->epoll_fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+void event_loop_run(event_loop_t *loop)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    while (1)
+    {
+        // Wake up at least once a second to expire timed out connections
+        int n = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, 1000);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("epoll_wait() failed: %s", strerror(errno));
+            return;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            connection_t *conn = events[i].data.ptr;
+            if (!conn)
+            {
+                accept_clients(loop);
+                continue;
+            }
+
+            if (!connection_on_events(conn, events[i].events))
+                close_connection(loop, conn);
+            else
+                touch_connection(loop, conn);
+        }
+
+        long long now = monotonic_seconds();
+        expire_timers(loop, &loop->read_timers, now);
+        expire_timers(loop, &loop->keep_alive_timers, now);
+    }
+}
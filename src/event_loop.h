@@ -0,0 +1,26 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stddef.h>
+
+#include "connection.h"
+#include "timer_list.h"
+
+typedef struct
+{
+    int epoll_fd;
+    int listen_fd;
+    size_t connection_count;
+    timer_list_t read_timers;       // connections with a request in flight (READ_TIMEOUT_SEC)
+    timer_list_t keep_alive_timers; // idle connections between requests (KEEP_ALIVE_TIMEOUT_SEC)
+} event_loop_t;
+
+// Creates the epoll instance and registers the (non-blocking) listening socket.
+// Returns 0 on success, -1 on failure.
+int event_loop_init(event_loop_t *loop, int listen_fd);
+
+// Edge-triggered reactor: accepts clients and drives every connection's state
+// machine as its socket becomes readable/writable. Does not return.
+void event_loop_run(event_loop_t *loop);
+
+#endif
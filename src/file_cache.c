@@ -0,0 +1,509 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "file_cache.h"
+#include "compress.h"
+#include "http_handlers.h"
+#include "log.h"
+#include "server_config.h"
+#include "timer_list.h"
+
+#define FILE_CACHE_MIN_BUCKETS 1024
+#define SIBLING_PATH_MAX 1040 // request paths are at most 1024 bytes, plus a coding suffix
+
+typedef struct
+{
+    file_cache_entry_t **buckets;
+    size_t bucket_count; // power of two
+    size_t entry_count;
+    size_t bytes_used;
+    size_t fd_count; // open files held by cached entries and their variants
+    size_t fd_limit; // per worker, from RLIMIT_NOFILE; 0 until first needed
+    file_cache_entry_t *lru_head; // most recently used
+    file_cache_entry_t *lru_tail; // eviction candidate
+} file_cache_t;
+
+// One cache per worker thread
+static _Thread_local file_cache_t cache;
+
+static uint64_t hash_path(const char *path)
+{
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void entry_free(file_cache_entry_t *entry)
+{
+    for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+    {
+        if (entry->variants[i])
+            file_cache_release(entry->variants[i]);
+    }
+    if (entry->fd >= 0)
+        close(entry->fd);
+    free(entry->body);
+    free(entry->path);
+    free(entry);
+}
+
+void file_cache_release(void *ptr)
+{
+    file_cache_entry_t *entry = ptr;
+    if (--entry->refcount == 0)
+        entry_free(entry);
+}
+
+// ----- Index and LRU -----
+
+static void lru_unlink(file_cache_entry_t *entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        cache.lru_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        cache.lru_tail = entry->lru_prev;
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void lru_push_front(file_cache_entry_t *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = cache.lru_head;
+    if (cache.lru_head)
+        cache.lru_head->lru_prev = entry;
+    else
+        cache.lru_tail = entry;
+    cache.lru_head = entry;
+}
+
+// Open files an entry keeps: its own for a large body, plus any large
+// precompressed siblings
+static size_t entry_fds(const file_cache_entry_t *entry)
+{
+    size_t fds = entry->fd >= 0;
+    for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+        fds += entry->variants[i] && entry->variants[i]->fd >= 0;
+    return fds;
+}
+
+// The workers share one descriptor table; most of it is left to sockets
+static size_t cache_fd_limit(void)
+{
+    if (cache.fd_limit == 0)
+    {
+        struct rlimit limit;
+        rlim_t files = (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+                           ? limit.rlim_cur
+                           : 1024;
+        int workers = server_config.workers > 0 ? server_config.workers : 1;
+        cache.fd_limit = (size_t)files / FILE_CACHE_FD_SHARE / (size_t)workers;
+        if (cache.fd_limit == 0)
+            cache.fd_limit = 1;
+    }
+    return cache.fd_limit;
+}
+
+static void cache_remove(file_cache_entry_t *entry)
+{
+    file_cache_entry_t **slot = &cache.buckets[entry->hash & (cache.bucket_count - 1)];
+    while (*slot && *slot != entry)
+        slot = &(*slot)->hash_next;
+    if (*slot)
+        *slot = entry->hash_next;
+
+    lru_unlink(entry);
+    cache.entry_count--;
+    cache.bytes_used -= entry->charge;
+    cache.fd_count -= entry_fds(entry);
+    entry->cached = 0;
+    file_cache_release(entry); // the cache's own reference
+}
+
+static file_cache_entry_t *cache_find(const char *path, uint64_t hash)
+{
+    if (!cache.buckets)
+        return NULL;
+
+    for (file_cache_entry_t *entry = cache.buckets[hash & (cache.bucket_count - 1)]; entry; entry = entry->hash_next)
+    {
+        if (entry->hash == hash && strcmp(entry->path, path) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+static int cache_grow(void)
+{
+    size_t new_count = cache.bucket_count ? cache.bucket_count * 2 : FILE_CACHE_MIN_BUCKETS;
+    file_cache_entry_t **buckets = calloc(new_count, sizeof(*buckets));
+    if (!buckets)
+        return -1;
+
+    for (size_t i = 0; i < cache.bucket_count; i++)
+    {
+        file_cache_entry_t *entry = cache.buckets[i];
+        while (entry)
+        {
+            file_cache_entry_t *next = entry->hash_next;
+            size_t slot = entry->hash & (new_count - 1);
+            entry->hash_next = buckets[slot];
+            buckets[slot] = entry;
+            entry = next;
+        }
+    }
+
+    free(cache.buckets);
+    cache.buckets = buckets;
+    cache.bucket_count = new_count;
+    return 0;
+}
+
+static void cache_insert(file_cache_entry_t *entry)
+{
+    size_t budget = server_config.file_cache_size;
+    size_t fds = entry_fds(entry);
+    size_t fd_limit = cache_fd_limit();
+
+    // Never cached: served once and dropped, without evicting anything for it
+    if (entry->charge > budget || fds > fd_limit)
+        return;
+
+    // Make room: evict least recently used entries until the new one fits
+    while (cache.lru_tail && (cache.bytes_used + entry->charge > budget || cache.fd_count + fds > fd_limit))
+        cache_remove(cache.lru_tail);
+
+    if (cache.entry_count >= cache.bucket_count && cache_grow() < 0)
+        return;
+
+    size_t slot = entry->hash & (cache.bucket_count - 1);
+    entry->hash_next = cache.buckets[slot];
+    cache.buckets[slot] = entry;
+    lru_push_front(entry);
+    cache.entry_count++;
+    cache.bytes_used += entry->charge;
+    cache.fd_count += fds;
+    entry->cached = 1;
+    entry->refcount++; // the cache's own reference
+}
+
+// ----- Loading -----
+
+static int same_file(const file_cache_entry_t *entry, const struct stat *st)
+{
+    return entry->dev == st->st_dev &&
+           entry->ino == st->st_ino &&
+           entry->size == (size_t)st->st_size &&
+           entry->mtime.tv_sec == st->st_mtim.tv_sec &&
+           entry->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// Read the whole file into memory. Returns 0 or -1.
+static int read_body(file_cache_entry_t *entry)
+{
+    entry->body = malloc(entry->size ? entry->size : 1);
+    if (!entry->body)
+        return -1;
+
+    size_t done = 0;
+    while (done < entry->size)
+    {
+        ssize_t bytes = pread(entry->fd, entry->body + done, entry->size - done, (off_t)done);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes <= 0)
+        {
+            free(entry->body);
+            entry->body = NULL;
+            return -1;
+        }
+        done += (size_t)bytes;
+    }
+    return 0;
+}
+
+// Open `path` and fill in its metadata and validators; the header block is
+// rendered once the variants are known. Returns NULL (errno set) if it is
+// not a readable regular file.
+static file_cache_entry_t *open_entry(const char *path, uint64_t hash)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        errno = ENOENT;
+        return NULL;
+    }
+
+    file_cache_entry_t *entry = calloc(1, sizeof(*entry));
+    if (!entry || !(entry->path = strdup(path)))
+    {
+        free(entry);
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    entry->hash = hash;
+    entry->refcount = 1; // the caller's reference
+    entry->fd = fd;
+    entry->size = (size_t)st.st_size;
+    entry->mime_type = get_mime_type(path);
+    entry->encoding = HTTP_ENCODING_IDENTITY;
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->mtime = st.st_mtim;
+    entry->validated_at = monotonic_seconds();
+
+    // Validators come from the metadata checked on revalidation, so they
+    // change whenever the cached entry is reloaded. Each variant is a file
+    // of its own and so gets an entity-tag of its own.
+    snprintf(entry->etag, sizeof(entry->etag), "\"%llx-%llx-%llx\"", (unsigned long long)entry->ino,
+             (unsigned long long)entry->size,
+             (unsigned long long)entry->mtime.tv_sec * 1000000000ull + (unsigned long long)entry->mtime.tv_nsec);
+
+    entry->charge = sizeof(*entry) + strlen(path) + 1;
+    return entry;
+}
+
+static void render_headers(file_cache_entry_t *entry, int vary)
+{
+    char last_modified[32];
+    struct tm tm;
+    gmtime_r(&entry->mtime.tv_sec, &tm);
+    strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    char *out = entry->headers;
+    size_t room = sizeof(entry->headers);
+    int type_len = snprintf(out, room, "Content-Type: %s\r\n", entry->mime_type);
+    if (entry->encoding != HTTP_ENCODING_IDENTITY)
+        type_len += snprintf(out + type_len, room - (size_t)type_len, "Content-Encoding: %s\r\n",
+                             http_encoding_names[entry->encoding]);
+
+    int validators_len = snprintf(out + type_len, room - (size_t)type_len,
+                                  "%s"
+                                  "ETag: %s\r\n"
+                                  "Last-Modified: %s\r\n",
+                                  vary ? "Vary: Accept-Encoding\r\n" : "", entry->etag, last_modified);
+    int written = type_len + validators_len;
+    written += snprintf(out + written, room - (size_t)written,
+                        "Accept-Ranges: bytes\r\n"
+                        "Content-Length: %zu\r\n",
+                        entry->size);
+    entry->headers_len = (written > 0 && (size_t)written < room) ? (size_t)written : 0;
+    entry->type_line_len = (size_t)type_len;
+    entry->validators_len = (size_t)validators_len;
+}
+
+// Small files live in memory so hits need no file descriptor at all
+static void load_body(file_cache_entry_t *entry, int cacheable)
+{
+    if (cacheable && entry->size <= FILE_CACHE_MAX_BODY &&
+        entry->size <= server_config.file_cache_size / 4 && read_body(entry) == 0)
+    {
+        close(entry->fd);
+        entry->fd = -1;
+        entry->charge += entry->size;
+    }
+}
+
+// "<path><suffix of encoding>" into `out` (SIBLING_PATH_MAX bytes). Returns 0, or -1 if too long.
+static int sibling_path(const char *path, int encoding, char *out)
+{
+    int len = snprintf(out, SIBLING_PATH_MAX, "%s%s", path, http_encoding_suffixes[encoding]);
+    return (len > 0 && len < SIBLING_PATH_MAX) ? 0 : -1;
+}
+
+// A precompressed sibling is served only while it is no older than the
+// file it was made from and actually smaller
+static int usable_variant(const file_cache_entry_t *entry, const struct stat *st)
+{
+    if (!S_ISREG(st->st_mode) || (size_t)st->st_size >= entry->size)
+        return 0;
+    if (st->st_mtim.tv_sec != entry->mtime.tv_sec)
+        return st->st_mtim.tv_sec > entry->mtime.tv_sec;
+    return st->st_mtim.tv_nsec >= entry->mtime.tv_nsec;
+}
+
+static void load_variants(file_cache_entry_t *entry, int cacheable)
+{
+    char sibling[SIBLING_PATH_MAX];
+    for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+    {
+        if (sibling_path(entry->path, i, sibling) < 0)
+            continue;
+
+        file_cache_entry_t *variant = open_entry(sibling, 0);
+        if (!variant)
+            continue;
+
+        struct stat st;
+        if (fstat(variant->fd, &st) < 0 || !usable_variant(entry, &st))
+        {
+            LOG_DEBUG("Ignoring stale or oversized %s", sibling);
+            file_cache_release(variant);
+            continue;
+        }
+
+        variant->mime_type = entry->mime_type;
+        variant->encoding = (http_encoding_t)i;
+        render_headers(variant, 1);
+        load_body(variant, cacheable);
+        entry->variants[i] = variant;
+        entry->charge += variant->charge;
+    }
+}
+
+// Siblings on disk still match the variants loaded: none appeared, went
+// away or changed
+static int variants_unchanged(const file_cache_entry_t *entry)
+{
+    char sibling[SIBLING_PATH_MAX];
+    for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+    {
+        struct stat st;
+        int present = sibling_path(entry->path, i, sibling) == 0 && stat(sibling, &st) == 0 &&
+                      usable_variant(entry, &st);
+        if (entry->variants[i] && entry->variants[i]->generated)
+        {
+            if (present)
+                return 0; // a precompressed file now takes over
+            continue;
+        }
+        if (present != (entry->variants[i] != NULL))
+            return 0;
+        if (present && !same_file(entry->variants[i], &st))
+            return 0;
+    }
+    return 1;
+}
+
+static file_cache_entry_t *load_entry(const char *path, uint64_t hash, int cacheable)
+{
+    file_cache_entry_t *entry = open_entry(path, hash);
+    if (!entry)
+        return NULL;
+
+    load_variants(entry, cacheable);
+    load_body(entry, cacheable);
+
+    // Vary whenever another coding is or may later be on offer
+    int vary = entry->body && compress_eligible(entry->mime_type, entry->size);
+    for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+        vary |= entry->variants[i] != NULL;
+    render_headers(entry, vary);
+    return entry;
+}
+
+file_cache_entry_t *file_cache_compress(file_cache_entry_t *entry, http_encoding_t encoding)
+{
+    if (entry->variants[encoding])
+        return entry->variants[encoding];
+    if (!entry->cached || !entry->body || (entry->incompressible & (1u << encoding)))
+        return NULL;
+
+    size_t len;
+    char *body = compress_buffer(encoding, entry->body, entry->size, &len);
+    if (body && len >= entry->size)
+    {
+        free(body);
+        body = NULL;
+    }
+    file_cache_entry_t *variant = body ? calloc(1, sizeof(*variant)) : NULL;
+    if (!variant || !(variant->path = strdup(entry->path)))
+    {
+        free(variant);
+        free(body);
+        entry->incompressible |= 1u << encoding; // don't retry on every request
+        return NULL;
+    }
+
+    variant->refcount = 1; // held by the entry
+    variant->body = body;
+    variant->fd = -1;
+    variant->size = len;
+    variant->mime_type = entry->mime_type;
+    variant->encoding = encoding;
+    variant->generated = 1;
+    variant->dev = entry->dev;
+    variant->ino = entry->ino;
+    variant->mtime = entry->mtime;
+    variant->validated_at = entry->validated_at;
+
+    // A representation of its own needs an entity-tag of its own; the level
+    // is part of it, as it changes the bytes
+    snprintf(variant->etag, sizeof(variant->etag), "\"%.*s-%s%d\"", (int)strlen(entry->etag) - 2, entry->etag + 1,
+             http_encoding_names[encoding], server_config.compress_level);
+    render_headers(variant, 1);
+    variant->charge = sizeof(*variant) + strlen(variant->path) + 1 + len;
+
+    entry->variants[encoding] = variant;
+    entry->charge += variant->charge;
+    cache.bytes_used += variant->charge;
+
+    // Stay within budget; the entry itself was just used and is not the tail
+    while (cache.bytes_used > server_config.file_cache_size && cache.lru_tail && cache.lru_tail != entry)
+        cache_remove(cache.lru_tail);
+
+    LOG_DEBUG("Compressed %s with %s: %zu -> %zu bytes", entry->path, http_encoding_names[encoding], entry->size, len);
+    return variant;
+}
+
+file_cache_entry_t *file_cache_get(const char *path)
+{
+    if (server_config.file_cache_size == 0)
+        return load_entry(path, 0, 0);
+
+    uint64_t hash = hash_path(path);
+    file_cache_entry_t *entry = cache_find(path, hash);
+
+    if (entry)
+    {
+        long long now = monotonic_seconds();
+        if (now - entry->validated_at >= server_config.file_cache_revalidate_sec)
+        {
+            struct stat st;
+            if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && same_file(entry, &st) && variants_unchanged(entry))
+            {
+                entry->validated_at = now;
+            }
+            else
+            {
+                cache_remove(entry); // changed or gone: reload below
+                entry = NULL;
+            }
+        }
+    }
+
+    if (entry)
+    {
+        lru_unlink(entry);
+        lru_push_front(entry);
+        entry->refcount++;
+        return entry;
+    }
+
+    entry = load_entry(path, hash, 1);
+    if (entry)
+        cache_insert(entry);
+    return entry;
+}
@@ -0,0 +1,92 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "http_encoding.h"
+
+#define FILE_CACHE_MAX_BODY (1024 * 1024) // files up to 1MB are held in memory, larger ones as an open fd
+#define FILE_CACHE_FD_SHARE 4             // cached fds take at most 1/4 of RLIMIT_NOFILE, split across workers
+
+// Cached static file, keyed by the path map_path_to_file() produced.
+// Entries are reference counted: the cache holds one reference while the
+// entry is indexed and every queued response holds another, so eviction
+// never pulls a body out from under a response that is still sending it.
+typedef struct file_cache_entry
+{
+    char *path;
+    uint64_t hash;
+    struct file_cache_entry *hash_next;
+    struct file_cache_entry *lru_prev; // more recently used
+    struct file_cache_entry *lru_next; // less recently used
+    int refcount;
+    int cached; // still indexed by the cache
+
+    char *body;  // file contents (small files), NULL when served from fd
+    int fd;      // open file (large files), -1 when the body is in memory
+    size_t size; // body size in bytes
+    const char *mime_type;
+    http_encoding_t encoding; // content coding of the body
+
+    // Precompressed siblings (<path>.br, .zst, .gz) found at load time, or
+    // the body compressed on the fly by file_cache_compress(). Each is an
+    // entry of its own held by this one; NULL where absent.
+    struct file_cache_entry *variants[HTTP_ENCODING_COUNT];
+    int generated;           // this variant was compressed here, not loaded from a sibling
+    unsigned incompressible; // codings that did not shrink the body (bit 1 << coding)
+
+    // Strong entity-tag, quoted: "<inode>-<size>-<mtime ns>" in hex
+    char etag[64];
+
+    // Pre-rendered header block, in this order:
+    //   Content-Type and Content-Encoding, then Vary and the validators
+    //   (ETag, Last-Modified), then Accept-Ranges and Content-Length.
+    // Partial responses reuse it up to the validators, 304s the validators only.
+    char headers[384];
+    size_t headers_len;
+    size_t type_line_len;  // Content-Type and Content-Encoding lines
+    size_t validators_len; // Vary, ETag and Last-Modified lines, right after them
+
+    // Validators checked on revalidation
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    long long validated_at; // monotonic seconds of the last stat()
+
+    size_t charge; // bytes counted against the cache budget
+} file_cache_entry_t;
+
+// Returns a referenced entry for `path`. Fresh hits cost no filesystem
+// syscalls; entries older than the revalidation interval are stat()ed, along
+// with their precompressed siblings, and reloaded if the inode, size or mtime
+// of either changed. Returns NULL (errno set) if
+// the path is not a readable regular file. With the cache disabled the entry
+// is loaded uncached and freed on release.
+// Each worker thread has its own cache, so no locking is involved.
+file_cache_entry_t *file_cache_get(const char *path);
+
+// Take another reference, for one more queued response chunk
+static inline void file_cache_retain(file_cache_entry_t *entry)
+{
+    entry->refcount++;
+}
+
+// The variant entry holding the body of `entry` compressed with `encoding`:
+// a precompressed sibling, or the in-memory body compressed on the first call.
+// The variant is owned by `entry` (held in entry->variants[]) and stays valid
+// while the caller holds its reference to `entry`; take a reference of its
+// own with file_cache_retain() to queue it. Compressed bodies count against
+// the cache budget and go when the entry is evicted or the file changes, so
+// each version of a file is compressed once per coding. Returns NULL if there
+// is no such variant and the entry is not held in memory by the cache, or if
+// the coding does not make the body smaller.
+file_cache_entry_t *file_cache_compress(file_cache_entry_t *entry, http_encoding_t encoding);
+
+// Drop a reference obtained from file_cache_get(). Takes void * so it can be
+// used directly as a response chunk release callback.
+void file_cache_release(void *entry);
+
+#endif
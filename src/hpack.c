@@ -0,0 +1,584 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hpack.h"
+
+// ----- Static table (RFC 7541 Appendix A) -----
+
+typedef struct
+{
+    const char *name;
+    const char *value;
+    uint8_t name_len;
+    uint8_t value_len;
+} static_field_t;
+
+#define FIELD(name, value) {name, value, sizeof(name) - 1, sizeof(value) - 1}
+
+static const static_field_t static_table[] = {
+    FIELD(":authority", ""),
+    FIELD(":method", "GET"),
+    FIELD(":method", "POST"),
+    FIELD(":path", "/"),
+    FIELD(":path", "/index.html"),
+    FIELD(":scheme", "http"),
+    FIELD(":scheme", "https"),
+    FIELD(":status", "200"),
+    FIELD(":status", "204"),
+    FIELD(":status", "206"),
+    FIELD(":status", "304"),
+    FIELD(":status", "400"),
+    FIELD(":status", "404"),
+    FIELD(":status", "500"),
+    FIELD("accept-charset", ""),
+    FIELD("accept-encoding", "gzip, deflate"),
+    FIELD("accept-language", ""),
+    FIELD("accept-ranges", ""),
+    FIELD("accept", ""),
+    FIELD("access-control-allow-origin", ""),
+    FIELD("age", ""),
+    FIELD("allow", ""),
+    FIELD("authorization", ""),
+    FIELD("cache-control", ""),
+    FIELD("content-disposition", ""),
+    FIELD("content-encoding", ""),
+    FIELD("content-language", ""),
+    FIELD("content-length", ""),
+    FIELD("content-location", ""),
+    FIELD("content-range", ""),
+    FIELD("content-type", ""),
+    FIELD("cookie", ""),
+    FIELD("date", ""),
+    FIELD("etag", ""),
+    FIELD("expect", ""),
+    FIELD("expires", ""),
+    FIELD("from", ""),
+    FIELD("host", ""),
+    FIELD("if-match", ""),
+    FIELD("if-modified-since", ""),
+    FIELD("if-none-match", ""),
+    FIELD("if-range", ""),
+    FIELD("if-unmodified-since", ""),
+    FIELD("last-modified", ""),
+    FIELD("link", ""),
+    FIELD("location", ""),
+    FIELD("max-forwards", ""),
+    FIELD("proxy-authenticate", ""),
+    FIELD("proxy-authorization", ""),
+    FIELD("range", ""),
+    FIELD("referer", ""),
+    FIELD("refresh", ""),
+    FIELD("retry-after", ""),
+    FIELD("server", ""),
+    FIELD("set-cookie", ""),
+    FIELD("strict-transport-security", ""),
+    FIELD("transfer-encoding", ""),
+    FIELD("user-agent", ""),
+    FIELD("vary", ""),
+    FIELD("via", ""),
+    FIELD("www-authenticate", ""),
+};
+
+#define STATIC_COUNT (sizeof(static_table) / sizeof(static_table[0]))
+
+_Static_assert(STATIC_COUNT == 61, "HPACK static table has 61 entries");
+
+// ----- Huffman code (RFC 7541 Appendix B) -----
+
+// The code is canonical: codes of one length are consecutive and follow the
+// symbol order, and each length continues from the last code of the one
+// before. So besides the codes the encoder uses, decoding needs nothing but
+// the symbols in code order and the number of codes of each length.
+
+typedef struct
+{
+    uint32_t code; // right-aligned
+    uint8_t bits;
+} huffman_code_t;
+
+#define HUFFMAN_EOS 256
+#define HUFFMAN_MAX_BITS 30
+
+static const huffman_code_t huffman_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6},
+    {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6},
+    {0x1f, 6}, {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7},
+    {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19},
+    {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6}, {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7},
+    {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20},
+    {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22},
+    {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22},
+    {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23},
+    {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22},
+    {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23},
+    {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20},
+    {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24},
+    {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26},
+    {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21},
+    {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24},
+    {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26},
+    {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27},
+    {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27},
+    {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+static const uint16_t huffman_symbols[257] = {
+    48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51, 52, 53, 54, 55, 56, 57, 61, 65, 95, 98,
+    100, 102, 103, 104, 108, 109, 110, 112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78,
+    79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118, 119, 120, 121, 122, 38, 42, 44, 59, 88, 90, 33,
+    34, 40, 41, 63, 39, 43, 124, 35, 62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92, 195, 208, 128, 130,
+    131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177, 179, 209, 216, 217, 227, 229, 230, 129, 132,
+    133, 134, 136, 146, 154, 156, 160, 163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198,
+    228, 232, 233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157, 158, 165, 166, 168,
+    174, 175, 180, 182, 183, 188, 191, 197, 231, 239, 9, 142, 144, 145, 148, 159, 171, 206, 215, 225, 236, 237,
+    199, 207, 234, 235, 192, 193, 200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204,
+    211, 212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254, 2, 3, 4, 5, 6, 7, 8,
+    11, 12, 14, 15, 16, 17, 18, 19, 20, 21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220, 249, 10, 13, 22, 256,
+};
+
+static const uint8_t huffman_counts[31] = {0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3, 0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4};
+
+// Decode `len` Huffman coded bytes into `out` (room for len * 8 / 5 bytes).
+// Returns the decoded length, or -1 if the input is not a valid code: the
+// EOS symbol, or padding that is longer than 7 bits or not all ones.
+static long huffman_decode(const uint8_t *in, size_t len, char *out)
+{
+    size_t n = 0;
+    int code = 0;  // bits of the symbol being read
+    int first = 0; // first code of the current length
+    int index = 0; // huffman_symbols index of that code
+    int bits = 0;
+    int ones = 1; // every bit of the symbol so far was 1 (valid padding)
+
+    for (size_t i = 0; i < len; i++)
+    {
+        for (int shift = 7; shift >= 0; shift--)
+        {
+            int bit = (in[i] >> shift) & 1;
+            code |= bit;
+            ones &= bit;
+            bits++;
+
+            int count = huffman_counts[bits];
+            if (code - first < count)
+            {
+                int symbol = huffman_symbols[index + code - first];
+                if (symbol == HUFFMAN_EOS)
+                    return -1;
+                out[n++] = (char)symbol;
+                code = first = index = bits = 0;
+                ones = 1;
+                continue;
+            }
+            if (bits == HUFFMAN_MAX_BITS)
+                return -1;
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+    }
+    return bits < 8 && ones ? (long)n : -1;
+}
+
+static size_t huffman_length(const char *s, size_t len)
+{
+    size_t bits = 0;
+    for (size_t i = 0; i < len; i++)
+        bits += huffman_codes[(uint8_t)s[i]].bits;
+    return (bits + 7) / 8;
+}
+
+// Encode `len` bytes into `out`, padding the last byte with ones (the EOS
+// prefix). Returns the bytes written, huffman_length() of the input.
+static size_t huffman_encode(const char *s, size_t len, uint8_t *out)
+{
+    uint64_t pending = 0;
+    unsigned bits = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        const huffman_code_t *code = &huffman_codes[(uint8_t)s[i]];
+        pending = (pending << code->bits) | code->code;
+        bits += code->bits;
+        while (bits >= 8)
+        {
+            bits -= 8;
+            out[n++] = (uint8_t)(pending >> bits);
+        }
+    }
+    if (bits > 0)
+        out[n++] = (uint8_t)((pending << (8 - bits)) | (0xffu >> bits));
+    return n;
+}
+
+// ----- Primitives (RFC 7541 section 5) -----
+
+// Integer with an N-bit prefix in the first byte, whose high bits are
+// `first`. Returns the bytes written (at most 6 for a size_t below 2^32).
+static size_t encode_integer(uint8_t *out, uint8_t first, unsigned prefix_bits, size_t value)
+{
+    size_t max = (1u << prefix_bits) - 1;
+    if (value < max)
+    {
+        out[0] = (uint8_t)(first | value);
+        return 1;
+    }
+
+    size_t n = 0;
+    out[n++] = (uint8_t)(first | max);
+    value -= max;
+    while (value >= 0x80)
+    {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Integers above 2^28 are rejected: nothing in a header block gets that large
+static int decode_integer(const uint8_t **p, const uint8_t *end, unsigned prefix_bits, size_t *value)
+{
+    size_t max = (1u << prefix_bits) - 1;
+    size_t result = *(*p)++ & max;
+    if (result == max)
+    {
+        for (unsigned shift = 0;; shift += 7)
+        {
+            if (*p == end || shift > 21)
+                return -1;
+            uint8_t byte = *(*p)++;
+            result += (size_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+    }
+    *value = result;
+    return 0;
+}
+
+// String literal, Huffman coded when that is shorter
+static size_t encode_string(uint8_t *out, const char *s, size_t len)
+{
+    size_t huffman_len = huffman_length(s, len);
+    if (huffman_len < len)
+    {
+        size_t n = encode_integer(out, 0x80, 7, huffman_len);
+        return n + huffman_encode(s, len, out + n);
+    }
+    size_t n = encode_integer(out, 0, 7, len);
+    memcpy(out + n, s, len);
+    return n + len;
+}
+
+// String literal at *p: raw strings are referenced in place, Huffman coded
+// ones decoded at *scratch, which advances past them
+static int decode_string(const uint8_t **p, const uint8_t *end, char **scratch, const char **s, size_t *len)
+{
+    if (*p == end)
+        return -1;
+    int huffman = **p & 0x80;
+    size_t encoded;
+    if (decode_integer(p, end, 7, &encoded) < 0 || encoded > (size_t)(end - *p))
+        return -1;
+
+    if (!huffman)
+    {
+        *s = (const char *)*p;
+        *len = encoded;
+    }
+    else
+    {
+        long decoded = huffman_decode(*p, encoded, *scratch);
+        if (decoded < 0)
+            return -1;
+        *s = *scratch;
+        *len = (size_t)decoded;
+        *scratch += decoded;
+    }
+    *p += encoded;
+    return 0;
+}
+
+// ----- Dynamic table -----
+
+void hpack_table_init(hpack_table_t *table)
+{
+    memset(table, 0, sizeof(*table));
+    table->max_size = HPACK_TABLE_SIZE;
+}
+
+static hpack_entry_t *table_entry(hpack_table_t *table, size_t i)
+{
+    return &table->entries[(table->first + i) % HPACK_MAX_ENTRIES];
+}
+
+static size_t entry_size(const hpack_entry_t *entry)
+{
+    return entry->name_len + entry->value_len + HPACK_ENTRY_OVERHEAD;
+}
+
+static void evict_to(hpack_table_t *table, size_t size)
+{
+    while (table->count > 0 && table->size > size)
+    {
+        hpack_entry_t *oldest = table_entry(table, table->count - 1);
+        table->size -= entry_size(oldest);
+        free(oldest->data);
+        oldest->data = NULL;
+        table->count--;
+    }
+}
+
+void hpack_table_free(hpack_table_t *table)
+{
+    evict_to(table, 0);
+}
+
+// Add a field as the newest entry, taking ownership of `data` (name then
+// value). An entry larger than the whole table empties it and is dropped.
+static void table_insert(hpack_table_t *table, char *data, size_t name_len, size_t value_len)
+{
+    size_t size = name_len + value_len + HPACK_ENTRY_OVERHEAD;
+    if (size > table->max_size)
+    {
+        evict_to(table, 0);
+        free(data);
+        return;
+    }
+    evict_to(table, table->max_size - size);
+
+    table->first = (table->first + HPACK_MAX_ENTRIES - 1) % HPACK_MAX_ENTRIES;
+    hpack_entry_t *entry = &table->entries[table->first];
+    entry->data = data;
+    entry->name_len = (uint32_t)name_len;
+    entry->value_len = (uint32_t)value_len;
+    table->count++;
+    table->size += size;
+}
+
+// Name and value of index `i` (1-based: static table first, then dynamic).
+// Returns 0, or -1 if there is no such entry.
+static int lookup_index(hpack_table_t *table, size_t i, const char **name, size_t *name_len,
+                        const char **value, size_t *value_len)
+{
+    if (i >= 1 && i <= STATIC_COUNT)
+    {
+        const static_field_t *field = &static_table[i - 1];
+        *name = field->name;
+        *name_len = field->name_len;
+        *value = field->value;
+        *value_len = field->value_len;
+        return 0;
+    }
+    if (i <= STATIC_COUNT || i - STATIC_COUNT > table->count)
+        return -1;
+
+    const hpack_entry_t *entry = table_entry(table, i - STATIC_COUNT - 1);
+    *name = entry->data;
+    *name_len = entry->name_len;
+    *value = entry->data + entry->name_len;
+    *value_len = entry->value_len;
+    return 0;
+}
+
+// ----- Decoder -----
+
+int hpack_decode(hpack_table_t *table, const uint8_t *block, size_t len, hpack_field_fn on_field, void *ctx)
+{
+    // Huffman coding shrinks strings to no less than 5/8 of their length
+    char *scratch = malloc(len * 2 + 1);
+    if (!scratch)
+        return -1;
+
+    const uint8_t *p = block;
+    const uint8_t *end = block + len;
+    int fields = 0;
+    int rc = 0;
+    while (p < end && rc == 0)
+    {
+        char *strings = scratch;
+        const char *name;
+        const char *value;
+        size_t name_len;
+        size_t value_len;
+        size_t index;
+        uint8_t first = *p;
+
+        if (first & 0x80) // indexed field
+        {
+            if (decode_integer(&p, end, 7, &index) < 0 ||
+                lookup_index(table, index, &name, &name_len, &value, &value_len) < 0)
+            {
+                rc = -1;
+                break;
+            }
+            on_field(ctx, name, name_len, value, value_len);
+            fields++;
+            continue;
+        }
+
+        if ((first & 0xe0) == 0x20) // dynamic table size update
+        {
+            // Only at the start of a block, and within what we advertised
+            size_t size;
+            if (fields > 0 || decode_integer(&p, end, 5, &size) < 0 || size > HPACK_TABLE_SIZE)
+            {
+                rc = -1;
+                break;
+            }
+            table->max_size = size;
+            evict_to(table, size);
+            continue;
+        }
+
+        // Literal field: with incremental indexing (01), without (0000) or
+        // never indexed (0001), its name indexed or a literal as well
+        int indexing = (first & 0xc0) == 0x40;
+        if (decode_integer(&p, end, indexing ? 6 : 4, &index) < 0)
+        {
+            rc = -1;
+            break;
+        }
+        if (index > 0)
+        {
+            const char *unused_value;
+            size_t unused_len;
+            if (lookup_index(table, index, &name, &name_len, &unused_value, &unused_len) < 0)
+            {
+                rc = -1;
+                break;
+            }
+        }
+        else if (decode_string(&p, end, &strings, &name, &name_len) < 0)
+        {
+            rc = -1;
+            break;
+        }
+        if (decode_string(&p, end, &strings, &value, &value_len) < 0)
+        {
+            rc = -1;
+            break;
+        }
+
+        if (!indexing)
+        {
+            on_field(ctx, name, name_len, value, value_len);
+            fields++;
+            continue;
+        }
+
+        // Copy before inserting: the name may refer to an entry the
+        // insertion evicts
+        char *data = malloc(name_len + value_len + 1);
+        if (!data)
+        {
+            rc = -1;
+            break;
+        }
+        memcpy(data, name, name_len);
+        memcpy(data + name_len, value, value_len);
+        on_field(ctx, data, name_len, data + name_len, value_len);
+        fields++;
+        table_insert(table, data, name_len, value_len);
+    }
+
+    free(scratch);
+    return rc;
+}
+
+// ----- Encoder -----
+
+void hpack_encoder_set_max_size(hpack_table_t *table, size_t size)
+{
+    if (size > HPACK_TABLE_SIZE)
+        size = HPACK_TABLE_SIZE;
+    if (size == table->max_size)
+        return;
+    if (!table->size_update || size < table->min_size)
+        table->min_size = size;
+    table->max_size = size;
+    evict_to(table, size);
+    table->size_update = 1;
+}
+
+size_t hpack_encode_begin(hpack_table_t *table, uint8_t *out)
+{
+    if (!table->size_update)
+        return 0;
+    table->size_update = 0;
+
+    // A limit lowered and raised again since the last block: the decoder
+    // has to evict down to the lowest one too (RFC 7541 section 4.2)
+    size_t n = 0;
+    if (table->min_size < table->max_size)
+        n = encode_integer(out, 0x20, 5, table->min_size);
+    return n + encode_integer(out + n, 0x20, 5, table->max_size);
+}
+
+// Fields whose values rarely repeat would only push useful entries out
+static int worth_indexing(const char *name, size_t name_len)
+{
+    return !(name_len == 14 && memcmp(name, "content-length", 14) == 0) &&
+           !(name_len == 13 && memcmp(name, "content-range", 13) == 0);
+}
+
+size_t hpack_encode_field(hpack_table_t *table, uint8_t *out, const char *name, size_t name_len,
+                          const char *value, size_t value_len)
+{
+    size_t name_index = 0;
+    for (size_t i = 0; i < STATIC_COUNT; i++)
+    {
+        const static_field_t *field = &static_table[i];
+        if (field->name_len != name_len || memcmp(field->name, name, name_len) != 0)
+            continue;
+        if (field->value_len == value_len && memcmp(field->value, value, value_len) == 0)
+            return encode_integer(out, 0x80, 7, i + 1);
+        if (!name_index)
+            name_index = i + 1;
+    }
+    for (size_t i = 0; i < table->count; i++)
+    {
+        const hpack_entry_t *entry = table_entry(table, i);
+        if (entry->name_len != name_len || memcmp(entry->data, name, name_len) != 0)
+            continue;
+        if (entry->value_len == value_len && memcmp(entry->data + name_len, value, value_len) == 0)
+            return encode_integer(out, 0x80, 7, STATIC_COUNT + 1 + i);
+        if (!name_index)
+            name_index = STATIC_COUNT + 1 + i;
+    }
+
+    // The entry is copied first: without memory for it, the field is not
+    // indexed, so that both tables stay the same
+    char *data = worth_indexing(name, name_len) ? malloc(name_len + value_len + 1) : NULL;
+    size_t n = data ? encode_integer(out, 0x40, 6, name_index) : encode_integer(out, 0, 4, name_index);
+    if (!name_index)
+        n += encode_string(out + n, name, name_len);
+    n += encode_string(out + n, value, value_len);
+
+    if (data)
+    {
+        memcpy(data, name, name_len);
+        memcpy(data + name_len, value, value_len);
+        table_insert(table, data, name_len, value_len);
+    }
+    return n;
+}
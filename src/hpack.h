@@ -0,0 +1,70 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// HPACK header compression for HTTP/2 (RFC 7541). Each connection keeps two
+// tables: one for decoding the client's header blocks and one for encoding
+// ours. A field is sent as an index into the static table (61 common
+// fields) or the dynamic table (fields recently sent on the connection), or
+// as a literal, its strings Huffman coded when that is shorter. Both ends
+// update their copy of a dynamic table in the same order, so header blocks
+// must be decoded, and encoded, in the order they travel.
+
+#define HPACK_TABLE_SIZE 4096 // dynamic table size used in both directions (the protocol default)
+#define HPACK_ENTRY_OVERHEAD 32
+#define HPACK_MAX_ENTRIES (HPACK_TABLE_SIZE / HPACK_ENTRY_OVERHEAD)
+
+typedef struct
+{
+    char *data; // name followed by value, not NUL-terminated
+    uint32_t name_len;
+    uint32_t value_len;
+} hpack_entry_t;
+
+// Dynamic table: a ring with the newest entry (index 62) at `first`
+typedef struct
+{
+    hpack_entry_t entries[HPACK_MAX_ENTRIES];
+    unsigned first;
+    unsigned count;
+    size_t size;     // sum of name + value + 32 over the entries
+    size_t max_size; // current limit, at most HPACK_TABLE_SIZE
+    int size_update; // encoder: max_size changed, announce it in the next block
+    size_t min_size; // encoder: lowest max_size since the last block
+} hpack_table_t;
+
+void hpack_table_init(hpack_table_t *table);
+void hpack_table_free(hpack_table_t *table);
+
+// Receives each decoded field. Strings are not NUL-terminated and stay valid
+// only for the call. Pseudo-header names keep their leading ':'.
+typedef void (*hpack_field_fn)(void *ctx, const char *name, size_t name_len, const char *value, size_t value_len);
+
+// Decode a complete header block, passing every field to `on_field` in
+// order. Returns 0, or -1 if the block is malformed (a COMPRESSION_ERROR:
+// the table can no longer be trusted, nor the connection).
+int hpack_decode(hpack_table_t *table, const uint8_t *block, size_t len, hpack_field_fn on_field, void *ctx);
+
+// Upper bound of the encoded size of a field
+static inline size_t hpack_field_bound(size_t name_len, size_t value_len)
+{
+    return name_len + value_len + 16;
+}
+
+// The peer's SETTINGS_HEADER_TABLE_SIZE: the encoder shrinks its table to
+// fit and announces the new size at the start of its next block
+void hpack_encoder_set_max_size(hpack_table_t *table, size_t size);
+
+// Start a header block at `out`. Returns the bytes written (a pending table
+// size update, at most 12).
+size_t hpack_encode_begin(hpack_table_t *table, uint8_t *out);
+
+// Append one field (name in lowercase) at `out`, which must have room for
+// hpack_field_bound() bytes. Fields worth repeating are added to the table.
+// Returns the bytes written.
+size_t hpack_encode_field(hpack_table_t *table, uint8_t *out, const char *name, size_t name_len,
+                          const char *value, size_t value_len);
+
+#endif
@@ -0,0 +1,1422 @@
+#define _GNU_SOURCE // memmem()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+
+#include "http2.h"
+#include "hpack.h"
+#include "http_errors.h"
+#include "error_handlers.h"
+#include "http_handlers.h"
+#include "server_config.h"
+#include "metrics.h"
+#include "log.h"
+
+#define FRAME_HEADER_LEN 9
+#define DEFAULT_WINDOW 65535   // flow control window before SETTINGS say otherwise
+#define MAX_WINDOW 0x7fffffff  // 2^31 - 1
+#define MAX_FRAME_LIMIT 0xffffff // largest SETTINGS_MAX_FRAME_SIZE
+
+static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+_Static_assert(sizeof(preface) - 1 == HTTP2_PREFACE_LEN, "client preface is 24 bytes");
+_Static_assert(HTTP2_FRAME_SIZE + FRAME_HEADER_LEN <= MAX_REQUEST_SIZE, "a whole frame must fit the receive buffer");
+
+typedef enum
+{
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9,
+} frame_type_t;
+
+#define FLAG_END_STREAM 0x1
+#define FLAG_ACK 0x1
+#define FLAG_END_HEADERS 0x4
+#define FLAG_PADDED 0x8
+#define FLAG_PRIORITY 0x20
+
+// Error codes of RST_STREAM and GOAWAY (RFC 9113 section 7)
+typedef enum
+{
+    H2_NO_ERROR = 0x0,
+    H2_PROTOCOL_ERROR = 0x1,
+    H2_INTERNAL_ERROR = 0x2,
+    H2_FLOW_CONTROL_ERROR = 0x3,
+    H2_STREAM_CLOSED = 0x5,
+    H2_FRAME_SIZE_ERROR = 0x6,
+    H2_REFUSED_STREAM = 0x7,
+    H2_COMPRESSION_ERROR = 0x9,
+    H2_ENHANCE_YOUR_CALM = 0xb,
+} h2_error_t;
+
+typedef enum
+{
+    SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    SETTINGS_ENABLE_PUSH = 0x2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    SETTINGS_MAX_FRAME_SIZE = 0x5,
+    SETTINGS_MAX_HEADER_LIST_SIZE = 0x6,
+} settings_id_t;
+
+// One request/response exchange. The request is built in the receive
+// buffer of `shadow`, a connection_t that never touches a socket: handlers
+// queue the response on it as they would for HTTP/1.1.
+typedef struct http2_stream
+{
+    struct http2_stream *next; // open streams of the session, oldest first
+    uint32_t id;
+    int remote_closed; // END_STREAM received: the request is complete
+    int responded;     // response HEADERS queued, DATA may follow
+    int discard_body;  // answered before the request ended: drop the rest of the body
+    int closed;        // out of the session, freed once refs drops to 0
+    int refs;          // queued DATA frames borrowing the shadow's chunks
+    int64_t send_window;
+    int64_t recv_window;
+    size_t recv_unacked;  // body bytes taken but not yet credited to the client
+    size_t body_received; // request body bytes so far
+    uint64_t start;       // request headers complete (metrics_now())
+    connection_t *shadow;
+    out_chunk_t *body; // shadow chunk holding the next response bytes
+} http2_stream_t;
+
+typedef struct http2_session
+{
+    connection_t *conn;
+    http2_stream_t *streams;
+    http2_stream_t *streams_tail;
+    int stream_count;
+    unsigned int streams_served;
+    uint32_t last_stream_id; // highest stream the client opened
+    int preface_received;
+    int settings_received; // the client's first SETTINGS, which must come first
+    int goaway;            // GOAWAY sent or received: no new streams, close once the open ones are done
+    int failed;            // connection error: nothing more is read
+
+    hpack_table_t decoder;
+    hpack_table_t encoder;
+
+    // Header block split over HEADERS and CONTINUATION frames
+    uint8_t *header_block;
+    size_t header_block_len;
+    size_t header_block_cap;
+    uint32_t header_stream; // stream the block belongs to, 0 if none is open
+    uint8_t header_flags;   // flags of its HEADERS frame
+
+    // Client settings
+    uint32_t peer_initial_window;
+    uint32_t peer_max_frame;
+
+    int64_t send_window; // connection flow control
+    int64_t recv_window;
+    size_t recv_unacked;
+} http2_session_t;
+
+// Request fields as the header block is decoded: pseudo-headers and headers
+// are copied NUL-terminated into the stream's request buffer
+typedef struct
+{
+    connection_t *shadow;
+    http_slice_t method;
+    http_slice_t path;
+    http_slice_t authority;
+    unsigned pseudo; // pseudo-headers seen, a bit each
+    http_slice_t names[MAX_HEADERS];
+    http_slice_t values[MAX_HEADERS];
+    int header_count;
+    int has_host;
+    const char *malformed; // why the request is malformed (a stream error), NULL if it is not
+    int too_large;         // more than the request buffer or MAX_HEADERS: 431
+} request_fields_t;
+
+#define PSEUDO_METHOD 0x1
+#define PSEUDO_SCHEME 0x2
+#define PSEUDO_PATH 0x4
+#define PSEUDO_AUTHORITY 0x8
+
+#define NAME_IS(name, len, literal) ((len) == sizeof(literal) - 1 && memcmp((name), (literal), (len)) == 0)
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void put32(uint8_t *p, uint32_t value)
+{
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+int http2_check_preface(const char *data, size_t len)
+{
+    size_t n = len < HTTP2_PREFACE_LEN ? len : HTTP2_PREFACE_LEN;
+    if (memcmp(data, preface, n) != 0)
+        return -1;
+    return n == HTTP2_PREFACE_LEN ? 1 : 0;
+}
+
+// ----- Frame output -----
+
+static void write_frame_header(uint8_t *out, size_t len, uint8_t type, uint8_t flags, uint32_t stream_id)
+{
+    out[0] = (uint8_t)(len >> 16);
+    out[1] = (uint8_t)(len >> 8);
+    out[2] = (uint8_t)len;
+    out[3] = type;
+    out[4] = flags;
+    put32(out + 5, stream_id);
+}
+
+// Queue a frame with its payload (copied)
+static void queue_frame(http2_session_t *session, uint8_t type, uint8_t flags, uint32_t stream_id,
+                        const void *payload, size_t len)
+{
+    uint8_t header[FRAME_HEADER_LEN];
+    write_frame_header(header, len, type, flags, stream_id);
+    struct iovec iov[2] = {{header, sizeof(header)}, {(void *)payload, len}};
+    connection_sendv(session->conn, iov, len ? 2 : 1);
+}
+
+static void send_window_update(http2_session_t *session, uint32_t stream_id, uint32_t increment)
+{
+    uint8_t payload[4];
+    put32(payload, increment);
+    queue_frame(session, FRAME_WINDOW_UPDATE, 0, stream_id, payload, sizeof(payload));
+}
+
+static void send_rst_stream(http2_session_t *session, uint32_t stream_id, h2_error_t error)
+{
+    uint8_t payload[4];
+    put32(payload, error);
+    queue_frame(session, FRAME_RST_STREAM, 0, stream_id, payload, sizeof(payload));
+    metrics_count_http2_reset();
+}
+
+static void send_goaway(http2_session_t *session, h2_error_t error)
+{
+    uint8_t payload[8];
+    put32(payload, session->last_stream_id);
+    put32(payload + 4, error);
+    queue_frame(session, FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+    session->goaway = 1;
+}
+
+// Connection error (RFC 9113 section 5.4.1): say why in a GOAWAY, stop
+// reading and close once the queue drains
+static void connection_error(http2_session_t *session, h2_error_t error, const char *why)
+{
+    if (session->failed)
+        return;
+    LOG_INFO("HTTP/2 connection error %d: %s", error, why);
+    send_goaway(session, error);
+    session->failed = 1;
+}
+
+// ----- Streams -----
+
+static http2_stream_t *find_stream(http2_session_t *session, uint32_t id)
+{
+    for (http2_stream_t *stream = session->streams; stream; stream = stream->next)
+    {
+        if (stream->id == id)
+            return stream;
+    }
+    return NULL;
+}
+
+static http2_stream_t *open_stream(http2_session_t *session, uint32_t id)
+{
+    http2_stream_t *stream = calloc(1, sizeof(*stream));
+    connection_t *shadow = calloc(1, sizeof(*shadow));
+    if (!stream || !shadow)
+    {
+        LOG_ERROR("Failed to allocate HTTP/2 stream");
+        free(stream);
+        free(shadow);
+        return NULL;
+    }
+
+    shadow->fd = -1;
+    shadow->state = CONN_READ_HEADERS;
+    shadow->peer = session->conn->peer;
+    shadow->pipe_fds[0] = -1;
+    shadow->pipe_fds[1] = -1;
+    shadow->body_fd = -1;
+
+    stream->id = id;
+    stream->send_window = session->peer_initial_window;
+    stream->recv_window = HTTP2_WINDOW;
+    stream->start = metrics_now();
+    stream->shadow = shadow;
+
+    if (session->streams_tail)
+        session->streams_tail->next = stream;
+    else
+        session->streams = stream;
+    session->streams_tail = stream;
+    session->stream_count++;
+    session->streams_served++;
+    metrics_count_http2_stream();
+    return stream;
+}
+
+static void free_stream(http2_stream_t *stream)
+{
+    connection_t *shadow = stream->shadow;
+    while (shadow->out_head)
+        connection_pop_chunk(shadow);
+    free(shadow->request);
+    connection_release_buffer(shadow);
+    free(shadow);
+    free(stream);
+}
+
+// A DATA frame borrowing from the stream was sent or dropped
+static void release_data(void *owner)
+{
+    http2_stream_t *stream = owner;
+    if (--stream->refs == 0 && stream->closed)
+        free_stream(stream);
+}
+
+// Give up on a request body being streamed to a file
+static void abandon_upload(http2_stream_t *stream, int status)
+{
+    connection_t *shadow = stream->shadow;
+    void *upload = shadow->body_upload;
+    shadow->body_fd = -1;
+    shadow->body_upload = NULL;
+    finish_streamed_body(shadow, shadow->request, upload, status);
+}
+
+// Take the stream out of the session. Its memory lives on while queued DATA
+// frames still point into it.
+static void close_stream(http2_session_t *session, http2_stream_t *stream)
+{
+    http2_stream_t **link = &session->streams;
+    http2_stream_t *prev = NULL;
+    while (*link != stream)
+    {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = stream->next;
+    if (session->streams_tail == stream)
+        session->streams_tail = prev;
+    session->stream_count--;
+
+    if (connection_is_streaming(stream->shadow))
+        abandon_upload(stream, HTTP_IO_ERROR);
+    stream->closed = 1;
+    if (stream->refs == 0)
+        free_stream(stream);
+}
+
+// Stream error (RFC 9113 section 5.4.2): reset just this stream
+static void stream_error(http2_session_t *session, uint32_t stream_id, h2_error_t error, const char *why)
+{
+    LOG_DEBUG("HTTP/2 stream %u error %d: %s", stream_id, error, why);
+    send_rst_stream(session, stream_id, error);
+    http2_stream_t *stream = find_stream(session, stream_id);
+    if (stream)
+        close_stream(session, stream);
+}
+
+// ----- Responses -----
+
+// END_STREAM went out. A request still sending its body is told to stop.
+static void finish_response(http2_session_t *session, http2_stream_t *stream)
+{
+    if (!stream->remote_closed)
+        send_rst_stream(session, stream->id, H2_NO_ERROR);
+    close_stream(session, stream);
+}
+
+// Queue a header block as HEADERS followed by as many CONTINUATION frames as
+// the client's frame size requires
+static void send_header_block(http2_session_t *session, uint32_t stream_id, const uint8_t *block, size_t len,
+                              int end_stream)
+{
+    size_t max = session->peer_max_frame;
+    size_t first = len < max ? len : max;
+    uint8_t flags = (end_stream ? FLAG_END_STREAM : 0) | (first == len ? FLAG_END_HEADERS : 0);
+    queue_frame(session, FRAME_HEADERS, flags, stream_id, block, first);
+
+    for (size_t offset = first; offset < len;)
+    {
+        size_t n = len - offset < max ? len - offset : max;
+        queue_frame(session, FRAME_CONTINUATION, offset + n == len ? FLAG_END_HEADERS : 0, stream_id,
+                    block + offset, n);
+        offset += n;
+    }
+}
+
+// Connection-specific fields have no place in HTTP/2 (RFC 9113 section 8.2.2)
+static int connection_specific(const char *name, size_t len)
+{
+    return NAME_IS(name, len, "connection") || NAME_IS(name, len, "keep-alive") ||
+           NAME_IS(name, len, "proxy-connection") || NAME_IS(name, len, "transfer-encoding") ||
+           NAME_IS(name, len, "upgrade");
+}
+
+// Translate the HTTP/1.1 head the handler queued on the shadow into a
+// HEADERS frame: the status line becomes :status, header names are
+// lowercased and connection-specific headers dropped. The body chunks
+// behind the head stay queued on the shadow for DATA frames to borrow.
+static void send_response_headers(http2_session_t *session, http2_stream_t *stream)
+{
+    connection_t *shadow = stream->shadow;
+    out_chunk_t *head = shadow->out_head;
+    if (shadow->close_after_write || !head || head->fd >= 0)
+    {
+        stream_error(session, stream->id, H2_INTERNAL_ERROR, "no response queued");
+        return;
+    }
+
+    // The builder queues the whole head as the first chunk
+    const char *start = head->base + head->offset;
+    const char *end = memmem(start, head->remain, "\r\n\r\n", 4);
+    if (!end || end - start < 12 || memcmp(start, "HTTP/1.", 7) != 0)
+    {
+        stream_error(session, stream->id, H2_INTERNAL_ERROR, "malformed response head");
+        return;
+    }
+    size_t head_len = (size_t)(end - start) + 4;
+
+    // A line of n >= 4 bytes ("Name: value\r\n") encodes to at most
+    // hpack_field_bound() = n + 12 <= 4n; the status line pays for :status
+    uint8_t *block = malloc(head_len * 4 + 32);
+    if (!block)
+    {
+        stream_error(session, stream->id, H2_INTERNAL_ERROR, "out of memory");
+        return;
+    }
+    size_t len = hpack_encode_begin(&session->encoder, block);
+    len += hpack_encode_field(&session->encoder, block + len, ":status", 7, start + 9, 3);
+
+    const char *line = memchr(start, '\n', head_len) + 1;
+    while (line < end)
+    {
+        const char *line_end = memchr(line, '\r', (size_t)(end + 2 - line));
+        const char *colon = memchr(line, ':', (size_t)(line_end - line));
+        char name[64];
+        size_t name_len = colon ? (size_t)(colon - line) : 0;
+        if (name_len > 0 && name_len < sizeof(name))
+        {
+            for (size_t i = 0; i < name_len; i++)
+                name[i] = (line[i] >= 'A' && line[i] <= 'Z') ? (char)(line[i] + 'a' - 'A') : line[i];
+
+            const char *value = colon + 1;
+            const char *value_end = line_end;
+            while (value < value_end && (*value == ' ' || *value == '\t'))
+                value++;
+            while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+                value_end--;
+
+            if (!connection_specific(name, name_len))
+                len += hpack_encode_field(&session->encoder, block + len, name, name_len, value,
+                                          (size_t)(value_end - value));
+        }
+        line = line_end + 2;
+    }
+
+    head->offset += (off_t)head_len;
+    head->remain -= head_len;
+    out_chunk_t *body = head;
+    while (body && body->remain == 0)
+        body = body->next;
+    stream->body = body;
+    stream->responded = 1;
+
+    send_header_block(session, stream->id, block, len, body == NULL);
+    free(block);
+    if (!body)
+        finish_response(session, stream);
+}
+
+// The handler queued its response on the shadow: account for it like an
+// HTTP/1.x request and start sending it
+static void respond(http2_session_t *session, http2_stream_t *stream)
+{
+    connection_t *shadow = stream->shadow;
+    metrics_record_since(METRICS_PHASE_TOTAL, stream->start);
+    connection_request_completed(shadow);
+
+    if (!stream->remote_closed)
+        stream->discard_body = 1;
+    if (connection_is_streaming(shadow))
+        abandon_upload(stream, HTTP_IO_ERROR);
+
+    // Responses never refer to the request: it can go now
+    free(shadow->request);
+    shadow->request = NULL;
+    connection_release_buffer(shadow);
+    shadow->buffer_len = 0;
+
+    send_response_headers(session, stream);
+}
+
+// Queue the stream's next DATA frame, of at most `budget` bytes, within the
+// flow control windows. The frame borrows the shadow's chunk: a file body
+// is still sent with sendfile(). Returns the payload bytes queued; 0 if the
+// windows are closed.
+static size_t send_data_frame(http2_session_t *session, http2_stream_t *stream, size_t budget)
+{
+    connection_t *conn = session->conn;
+    out_chunk_t *chunk = stream->body;
+    while (chunk && chunk->remain == 0)
+        chunk = chunk->next;
+    stream->body = chunk;
+    if (!chunk)
+    {
+        queue_frame(session, FRAME_DATA, FLAG_END_STREAM, stream->id, NULL, 0);
+        finish_response(session, stream);
+        return 0;
+    }
+
+    int64_t window = stream->send_window < session->send_window ? stream->send_window : session->send_window;
+    if (window <= 0)
+        return 0;
+    size_t len = chunk->remain;
+    if (len > session->peer_max_frame)
+        len = session->peer_max_frame;
+    if ((int64_t)len > window)
+        len = (size_t)window;
+    if (len > budget)
+        len = budget;
+
+    out_chunk_t *after = chunk->next;
+    while (after && after->remain == 0)
+        after = after->next;
+    int last = len == chunk->remain && !after;
+
+    uint8_t header[FRAME_HEADER_LEN];
+    write_frame_header(header, len, FRAME_DATA, last ? FLAG_END_STREAM : 0, stream->id);
+    connection_send(conn, header, sizeof(header));
+    stream->refs++;
+    if (chunk->fd < 0)
+        connection_send_ref(conn, chunk->base + chunk->offset, len, release_data, stream);
+    else
+        connection_send_file_ref(conn, chunk->fd, chunk->offset, len, release_data, stream);
+
+    chunk->offset += (off_t)len;
+    chunk->remain -= len;
+    stream->send_window -= (int64_t)len;
+    session->send_window -= (int64_t)len;
+    if (last)
+        finish_response(session, stream);
+    return len;
+}
+
+// Queue up to HTTP2_WRITE_BATCH bytes of DATA, a frame per stream in turn
+static void produce_data(http2_session_t *session)
+{
+    if (session->failed)
+        return;
+
+    size_t budget = HTTP2_WRITE_BATCH;
+    int progress = 1;
+    while (progress && budget > 0)
+    {
+        progress = 0;
+        http2_stream_t *next;
+        for (http2_stream_t *stream = session->streams; stream && budget > 0; stream = next)
+        {
+            next = stream->next;
+            if (!stream->responded)
+                continue;
+            size_t sent = send_data_frame(session, stream, budget);
+            if (sent > 0)
+            {
+                budget -= sent;
+                progress = 1;
+            }
+        }
+    }
+}
+
+// ----- Requests -----
+
+// Copy `len` bytes and a NUL to the end of the request buffer
+static int store_field(request_fields_t *fields, const char *data, size_t len, http_slice_t *slice)
+{
+    connection_t *shadow = fields->shadow;
+    size_t need = shadow->buffer_len + len + 1;
+    if (need > MAX_REQUEST_SIZE || connection_reserve_buffer(shadow, need) < 0)
+    {
+        fields->too_large = 1;
+        return -1;
+    }
+    memcpy(shadow->buffer + shadow->buffer_len, data, len);
+    slice->offset = (uint32_t)shadow->buffer_len;
+    slice->length = (uint32_t)len;
+    shadow->buffer_len += len;
+    shadow->buffer[shadow->buffer_len++] = '\0';
+    return 0;
+}
+
+// hpack_field_fn building a request. A malformed field only marks the
+// request: decoding goes on, the table has to stay in step.
+static void on_request_field(void *ctx, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+    request_fields_t *fields = ctx;
+    if (fields->malformed || fields->too_large)
+        return;
+
+    if (memchr(value, '\0', value_len) || memchr(value, '\r', value_len) || memchr(value, '\n', value_len))
+    {
+        fields->malformed = "invalid character in field value";
+        return;
+    }
+
+    if (name_len > 0 && name[0] == ':')
+    {
+        http_slice_t unused;
+        http_slice_t *slice = &unused;
+        unsigned bit;
+        if (NAME_IS(name, name_len, ":method"))
+            bit = PSEUDO_METHOD, slice = &fields->method;
+        else if (NAME_IS(name, name_len, ":scheme"))
+            bit = PSEUDO_SCHEME;
+        else if (NAME_IS(name, name_len, ":path"))
+            bit = PSEUDO_PATH, slice = &fields->path;
+        else if (NAME_IS(name, name_len, ":authority"))
+            bit = PSEUDO_AUTHORITY, slice = &fields->authority;
+        else
+        {
+            fields->malformed = "unknown pseudo-header";
+            return;
+        }
+
+        if (fields->header_count > 0 || (fields->pseudo & bit))
+        {
+            fields->malformed = "misplaced or repeated pseudo-header";
+            return;
+        }
+        fields->pseudo |= bit;
+        if (slice != &unused)
+            store_field(fields, value, value_len, slice);
+        return;
+    }
+
+    if (name_len == 0)
+    {
+        fields->malformed = "empty field name";
+        return;
+    }
+    for (size_t i = 0; i < name_len; i++)
+    {
+        unsigned char c = (unsigned char)name[i];
+        if ((c >= 'A' && c <= 'Z') || c <= ' ' || c == ':' || c >= 0x7f)
+        {
+            fields->malformed = "invalid field name";
+            return;
+        }
+    }
+    if (connection_specific(name, name_len) ||
+        (NAME_IS(name, name_len, "te") && !NAME_IS(value, value_len, "trailers")))
+    {
+        fields->malformed = "connection-specific field";
+        return;
+    }
+
+    // One slot stays free for a Host taken from :authority
+    if (fields->header_count == MAX_HEADERS - 1)
+    {
+        fields->too_large = 1;
+        return;
+    }
+    int i = fields->header_count;
+    if (store_field(fields, name, name_len, &fields->names[i]) < 0 ||
+        store_field(fields, value, value_len, &fields->values[i]) < 0)
+        return;
+    fields->header_count++;
+    if (NAME_IS(name, name_len, "host"))
+        fields->has_host = 1;
+}
+
+static void ignore_field(void *ctx, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+    (void)ctx;
+    (void)name;
+    (void)name_len;
+    (void)value;
+    (void)value_len;
+}
+
+// The request is complete: run its handler
+static void end_request(http2_session_t *session, http2_stream_t *stream)
+{
+    stream->remote_closed = 1;
+    if (stream->discard_body)
+        return; // answered already
+
+    connection_t *shadow = stream->shadow;
+    http_request *request = shadow->request;
+    if (request->known[HTTP_HEADER_CONTENT_LENGTH] && stream->body_received != request->content_length)
+    {
+        stream_error(session, stream->id, H2_PROTOCOL_ERROR, "body shorter than content-length");
+        return;
+    }
+    if (stream->body_received > 0)
+        metrics_record_since(METRICS_PHASE_READ_BODY, stream->start);
+
+    if (connection_is_streaming(shadow))
+    {
+        void *upload = shadow->body_upload;
+        shadow->body_fd = -1;
+        shadow->body_upload = NULL;
+        finish_streamed_body(shadow, request, upload, 1);
+    }
+    else
+    {
+        if (shadow->buffer_len > shadow->header_len)
+        {
+            request->body = shadow->buffer + shadow->header_len;
+            request->body_length = shadow->buffer_len - shadow->header_len;
+        }
+        dispatch_request(shadow, request);
+    }
+    respond(session, stream);
+}
+
+// Build the request from its decoded fields, as the HTTP/1.x parser
+// callbacks would from a request head, and check it the same way
+static void start_request(http2_session_t *session, http2_stream_t *stream, request_fields_t *fields, int end_stream)
+{
+    connection_t *shadow = stream->shadow;
+    const http_parser_callbacks_t *build = &http_request_parser_callbacks;
+    unsigned required = PSEUDO_METHOD | PSEUDO_SCHEME | PSEUDO_PATH;
+
+    if (!fields->malformed && !fields->too_large &&
+        ((fields->pseudo & required) != required || fields->path.length == 0))
+        fields->malformed = "missing pseudo-header";
+    if (fields->malformed)
+    {
+        stream_error(session, stream->id, H2_PROTOCOL_ERROR, fields->malformed);
+        return;
+    }
+    if (end_stream)
+        stream->remote_closed = 1;
+
+    http_request *request = malloc(sizeof(*request));
+    if (!request)
+    {
+        LOG_ERROR("Failed to allocate request");
+        stream_error(session, stream->id, H2_INTERNAL_ERROR, "out of memory");
+        return;
+    }
+    http_request_init(request, shadow->buffer);
+    shadow->request = request;
+
+    if (fields->too_large)
+    {
+        LOG_INFO("HTTP/2 request headers too large");
+        handle_parse_headers_status(HTTP_HEADERS_TOO_LARGE, shadow, NULL);
+        respond(session, stream);
+        return;
+    }
+
+    int rc = build->on_method(request, fields->method.offset, fields->method.length);
+    if (rc > 0 && fields->path.length > MAX_PATH)
+        rc = HTTP_URI_TOO_LONG;
+    if (rc < 0)
+    {
+        handle_request_line_status(rc, shadow, request->method[0] ? request->method : NULL);
+        respond(session, stream);
+        return;
+    }
+    const char *query = memchr(shadow->buffer + fields->path.offset, '?', fields->path.length);
+    build->on_target(request, fields->path.offset, fields->path.length,
+                     query ? (size_t)(query - shadow->buffer) : 0);
+    request->version = "HTTP/2.0";
+    request->connection_header = "keep-alive"; // the connection outlives every stream
+
+    for (int i = 0; i < fields->header_count; i++)
+        build->on_header(request, fields->names[i].offset, fields->names[i].length, fields->values[i].offset,
+                         fields->values[i].length);
+    if (!fields->has_host && (fields->pseudo & PSEUDO_AUTHORITY))
+    {
+        // :authority stands in for Host (RFC 9113 section 8.3.1)
+        http_slice_t host;
+        if (store_field(fields, "host", 4, &host) == 0)
+            build->on_header(request, host.offset, host.length, fields->authority.offset,
+                             fields->authority.length);
+    }
+    shadow->header_len = shadow->buffer_len;
+    LOG_DEBUG("HTTP/2 stream %u: %s %s", stream->id, request->method, request->path);
+
+    // A body without content-length is delimited by END_STREAM, which HTTP/1.1
+    // framing would express as chunked: limits apply as they do there
+    if (!end_stream && !request->known[HTTP_HEADER_CONTENT_LENGTH])
+        request->chunked = 1;
+
+    uint64_t validate_start = metrics_now();
+    rc = validate_http_request(request);
+    metrics_record_since(METRICS_PHASE_VALIDATE, validate_start);
+    if (!handle_validate_status(rc, shadow, request->method))
+    {
+        respond(session, stream);
+        return;
+    }
+
+    request->content_length = get_content_length(request);
+    if (end_stream && request->content_length > 0)
+    {
+        stream_error(session, stream->id, H2_PROTOCOL_ERROR, "content-length without a body");
+        return;
+    }
+    if (request->content_length > 0 || request->chunked)
+    {
+        if (!prepare_request_body(shadow, request))
+        {
+            respond(session, stream);
+            return;
+        }
+        if (!connection_is_streaming(shadow) && request->content_length > MAX_REQUEST_SIZE - shadow->header_len)
+        {
+            LOG_INFO("Content-Length too large: %zu bytes for %d", request->content_length, MAX_REQUEST_SIZE);
+            handle_read_body_status(HTTP_BODY_TOO_LARGE, shadow, request->connection_header, request->method);
+            respond(session, stream);
+            return;
+        }
+    }
+
+    shadow->state = CONN_READ_BODY;
+    if (end_stream)
+        end_request(session, stream);
+}
+
+// Write body bytes to the file a handler streams the body to
+static int store_upload(connection_t *shadow, const uint8_t *data, size_t len)
+{
+    for (size_t written = 0; written < len;)
+    {
+        ssize_t n = pwrite(shadow->body_fd, data + written, len - written, shadow->body_offset + (off_t)written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            LOG_ERROR("Failed to store request body: %s", n < 0 ? strerror(errno) : "short write");
+            return -1;
+        }
+        written += (size_t)n;
+    }
+    shadow->body_offset += (off_t)len;
+    return 0;
+}
+
+// Request body bytes from a DATA frame: buffered behind the request head,
+// or written out if the handler streams the body
+static void receive_body(http2_session_t *session, http2_stream_t *stream, const uint8_t *data, size_t len)
+{
+    connection_t *shadow = stream->shadow;
+    http_request *request = shadow->request;
+    stream->body_received += len;
+    if (stream->discard_body || len == 0)
+        return;
+
+    if (request->known[HTTP_HEADER_CONTENT_LENGTH] && stream->body_received > request->content_length)
+    {
+        stream_error(session, stream->id, H2_PROTOCOL_ERROR, "body longer than content-length");
+        return;
+    }
+
+    // Bodies of unknown length are checked against the route limit as they
+    // arrive, and buffered ones against the request buffer
+    int too_large = request->chunked && stream->body_received > server_config_max_body(request->path);
+    if (!connection_is_streaming(shadow) && len > MAX_REQUEST_SIZE - shadow->buffer_len)
+        too_large = 1;
+    if (too_large)
+    {
+        LOG_INFO("HTTP/2 request body too large: %zu bytes so far on %s", stream->body_received, request->path);
+        if (connection_is_streaming(shadow))
+            abandon_upload(stream, HTTP_BODY_TOO_LARGE);
+        handle_read_body_status(HTTP_BODY_TOO_LARGE, shadow, "close", request->method);
+        respond(session, stream);
+        return;
+    }
+
+    if (connection_is_streaming(shadow))
+    {
+        if (store_upload(shadow, data, len) < 0)
+        {
+            abandon_upload(stream, HTTP_IO_ERROR);
+            send_error_response(shadow, 500, "Internal Server Error", "close", request->method);
+            respond(session, stream);
+        }
+        return;
+    }
+
+
+    // Sized for the whole body at once when its length is known
+    size_t need = shadow->buffer_len + len;
+    if (shadow->header_len + request->content_length > need)
+        need = shadow->header_len + request->content_length;
+    if (connection_reserve_buffer(shadow, need) < 0)
+    {
+        send_error_response(shadow, 500, "Internal Server Error", "close", request->method);
+        respond(session, stream);
+        return;
+    }
+    memcpy(shadow->buffer + shadow->buffer_len, data, len);
+    shadow->buffer_len += len;
+    shadow->buffer[shadow->buffer_len] = '\0';
+}
+
+// ----- Frames -----
+
+// Strip the padding of a PADDED frame. Returns 0 or -1 if it is malformed.
+static int strip_padding(uint8_t flags, const uint8_t **payload, size_t *len)
+{
+    if (!(flags & FLAG_PADDED))
+        return 0;
+    if (*len < 1 || (*payload)[0] >= *len)
+        return -1;
+    *len -= 1 + (size_t)(*payload)[0];
+    (*payload)++;
+    return 0;
+}
+
+// A complete header block arrived for stream `id`: a new request, or the
+// trailers of one whose body is being received
+static void decode_header_block(http2_session_t *session, uint32_t id, uint8_t flags, const uint8_t *block,
+                                size_t len)
+{
+    int end_stream = (flags & FLAG_END_STREAM) != 0;
+    if (id <= session->last_stream_id)
+    {
+        if (hpack_decode(&session->decoder, block, len, ignore_field, NULL) < 0)
+        {
+            connection_error(session, H2_COMPRESSION_ERROR, "undecodable header block");
+            return;
+        }
+        http2_stream_t *stream = find_stream(session, id);
+        if (!stream || stream->remote_closed)
+            stream_error(session, id, H2_STREAM_CLOSED, "headers on a closed stream");
+        else if (!end_stream)
+            stream_error(session, id, H2_PROTOCOL_ERROR, "trailers without END_STREAM");
+        else
+            end_request(session, stream);
+        return;
+    }
+
+    session->last_stream_id = id;
+    http2_stream_t *stream = NULL;
+    if (!session->goaway && session->stream_count < HTTP2_MAX_STREAMS)
+        stream = open_stream(session, id);
+    if (!stream)
+    {
+        if (hpack_decode(&session->decoder, block, len, ignore_field, NULL) < 0)
+            connection_error(session, H2_COMPRESSION_ERROR, "undecodable header block");
+        else
+            send_rst_stream(session, id, H2_REFUSED_STREAM);
+        return;
+    }
+
+    request_fields_t fields;
+    memset(&fields, 0, sizeof(fields));
+    fields.shadow = stream->shadow;
+    if (hpack_decode(&session->decoder, block, len, on_request_field, &fields) < 0)
+    {
+        connection_error(session, H2_COMPRESSION_ERROR, "undecodable header block");
+        return;
+    }
+    start_request(session, stream, &fields, end_stream);
+}
+
+// Collect a header block split over several frames
+static int append_header_block(http2_session_t *session, const uint8_t *data, size_t len)
+{
+    if (len > MAX_REQUEST_SIZE - session->header_block_len)
+    {
+        connection_error(session, H2_ENHANCE_YOUR_CALM, "header block too large");
+        return -1;
+    }
+    if (session->header_block_len + len > session->header_block_cap)
+    {
+        size_t cap = session->header_block_cap ? session->header_block_cap * 2 : HTTP2_FRAME_SIZE;
+        while (cap < session->header_block_len + len)
+            cap *= 2;
+        uint8_t *block = realloc(session->header_block, cap);
+        if (!block)
+        {
+            connection_error(session, H2_INTERNAL_ERROR, "out of memory");
+            return -1;
+        }
+        session->header_block = block;
+        session->header_block_cap = cap;
+    }
+    memcpy(session->header_block + session->header_block_len, data, len);
+    session->header_block_len += len;
+    return 0;
+}
+
+static void end_header_block(http2_session_t *session)
+{
+    uint32_t id = session->header_stream;
+    session->header_stream = 0;
+    decode_header_block(session, id, session->header_flags, session->header_block, session->header_block_len);
+    session->header_block_len = 0;
+}
+
+static void on_headers(http2_session_t *session, uint32_t id, uint8_t flags, const uint8_t *payload, size_t len)
+{
+    if (id == 0 || (id & 1) == 0)
+    {
+        connection_error(session, H2_PROTOCOL_ERROR, "HEADERS on an invalid stream");
+        return;
+    }
+    if (strip_padding(flags, &payload, &len) < 0)
+    {
+        connection_error(session, H2_PROTOCOL_ERROR, "bad padding");
+        return;
+    }
+    if (flags & FLAG_PRIORITY)
+    {
+        // Priorities are not honoured: streams are served round-robin
+        if (len < 5)
+        {
+            connection_error(session, H2_FRAME_SIZE_ERROR, "short HEADERS priority");
+            return;
+        }
+        payload += 5;
+        len -= 5;
+    }
+
+    if (flags & FLAG_END_HEADERS)
+    {
+        decode_header_block(session, id, flags, payload, len);
+        return;
+    }
+    if (append_header_block(session, payload, len) == 0)
+    {
+        session->header_stream = id;
+        session->header_flags = flags;
+    }
+}
+
+static void on_continuation(http2_session_t *session, uint32_t id, uint8_t flags, const uint8_t *payload,
+                            size_t len)
+{
+    if (id == 0 || id != session->header_stream)
+    {
+        connection_error(session, H2_PROTOCOL_ERROR, "unexpected CONTINUATION");
+        return;
+    }
+    if (append_header_block(session, payload, len) == 0 && (flags & FLAG_END_HEADERS))
+        end_header_block(session);
+}
+
+static void on_data(http2_session_t *session, uint32_t id, uint8_t flags, const uint8_t *payload, size_t len)
+{
+    if (id == 0)
+    {
+        connection_error(session, H2_PROTOCOL_ERROR, "DATA on stream 0");
+        return;
+    }
+
+    // The whole frame counts against the windows, padding included
+    size_t flow = len;
+    if ((int64_t)flow > session->recv_window)
+    {
+        connection_error(session, H2_FLOW_CONTROL_ERROR, "connection window exceeded");
+        return;
+    }
+    session->recv_window -= (int64_t)flow;
+    session->recv_unacked += flow;
+    if (strip_padding(flags, &payload, &len) < 0)
+    {
+        connection_error(session, H2_PROTOCOL_ERROR, "bad padding");
+        return;
+    }
+
+    http2_stream_t *stream = find_stream(session, id);
+    if (!stream)
+    {
+        // Frames the client sent before seeing our RST_STREAM are dropped
+        if (id > session->last_stream_id)
+            connection_error(session, H2_PROTOCOL_ERROR, "DATA on an idle stream");
+        return;
+    }
+    if (stream->remote_closed)
+    {
+        stream_error(session, id, H2_STREAM_CLOSED, "DATA after END_STREAM");
+        return;
+    }
+    if ((int64_t)flow > stream->recv_window)
+    {
+        stream_error(session, id, H2_FLOW_CONTROL_ERROR, "stream window exceeded");
+        return;
+    }
+    stream->recv_window -= (int64_t)flow;
+    stream->recv_unacked += flow;
+
+    receive_body(session, stream, payload, len);
+    if (flags & FLAG_END_STREAM)
+    {
+        // The body may have been answered, and the stream closed, meanwhile
+        stream = find_stream(session, id);
+        if (stream)
+            end_request(session, stream);
+    }
+}
+
+static void on_rst_stream(http2_session_t *session, uint32_t id, size_t len)
+{
+    if (len != 4)
+    {
+        connection_error(session, H2_FRAME_SIZE_ERROR, "RST_STREAM length");
+        return;
+    }
+    if (id == 0 || id > session->last_stream_id)
+    {
+        connection_error(session, H2_PROTOCOL_ERROR, "RST_STREAM on an idle stream");
+        return;
+    }
+    http2_stream_t *stream = find_stream(session, id);
+    if (stream)
+        close_stream(session, stream);
+}
+
+static void on_settings(http2_session_t *session, uint32_t id, uint8_t flags, const uint8_t *payload, size_t len)
+{
+    if (id != 0)
+    {
+        connection_error(session, H2_PROTOCOL_ERROR, "SETTINGS on a stream");
+        return;
+    }
+    if (flags & FLAG_ACK)
+    {
+        if (len != 0)
+            connection_error(session, H2_FRAME_SIZE_ERROR, "SETTINGS ACK with a payload");
+        return;
+    }
+    if (len % 6 != 0)
+    {
+        connection_error(session, H2_FRAME_SIZE_ERROR, "SETTINGS length");
+        return;
+    }
+
+    for (size_t i = 0; i < len; i += 6)
+    {
+        unsigned setting = (unsigned)payload[i] << 8 | payload[i + 1];
+        uint32_t value = get32(payload + i + 2);
+        switch (setting)
+        {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            hpack_encoder_set_max_size(&session->encoder, value);
+            break;
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+            {
+                connection_error(session, H2_PROTOCOL_ERROR, "SETTINGS_ENABLE_PUSH value");
+                return;
+            }
+            break; // nothing is pushed either way
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if (value > MAX_WINDOW)
+            {
+                connection_error(session, H2_FLOW_CONTROL_ERROR, "SETTINGS_INITIAL_WINDOW_SIZE value");
+                return;
+            }
+            // Applies to the windows of open streams as a delta (RFC 9113 section 6.9.2)
+            int64_t delta = (int64_t)value - session->peer_initial_window;
+            for (http2_stream_t *stream = session->streams; stream; stream = stream->next)
+            {
+                stream->send_window += delta;
+                if (stream->send_window > MAX_WINDOW)
+                {
+                    connection_error(session, H2_FLOW_CONTROL_ERROR, "stream window overflow");
+                    return;
+                }
+            }
+            session->peer_initial_window = value;
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < HTTP2_FRAME_SIZE || value > MAX_FRAME_LIMIT)
+            {
+                connection_error(session, H2_PROTOCOL_ERROR, "SETTINGS_MAX_FRAME_SIZE value");
+                return;
+            }
+            session->peer_max_frame = value;
+            break;
+        default:
+            break; // unknown settings are ignored, as are limits we never reach
+        }
+    }
+    session->settings_received = 1;
+    queue_frame(session, FRAME_SETTINGS, FLAG_ACK, 0, NULL, 0);
+}
+
+static void on_ping(http2_session_t *session, uint32_t id, uint8_t flags, const uint8_t *payload, size_t len)
+{
+    if (len != 8)
+        connection_error(session, H2_FRAME_SIZE_ERROR, "PING length");
+    else if (id != 0)
+        connection_error(session, H2_PROTOCOL_ERROR, "PING on a stream");
+    else if (!(flags & FLAG_ACK))
+        queue_frame(session, FRAME_PING, FLAG_ACK, 0, payload, len);
+}
+
+static void on_window_update(http2_session_t *session, uint32_t id, const uint8_t *payload, size_t len)
+{
+    if (len != 4)
+    {
+        connection_error(session, H2_FRAME_SIZE_ERROR, "WINDOW_UPDATE length");
+        return;
+    }
+    uint32_t increment = get32(payload) & 0x7fffffff;
+    if (id == 0)
+    {
+        if (increment == 0)
+            connection_error(session, H2_PROTOCOL_ERROR, "zero WINDOW_UPDATE");
+        else if (session->send_window + increment > MAX_WINDOW)
+            connection_error(session, H2_FLOW_CONTROL_ERROR, "connection window overflow");
+        else
+            session->send_window += increment;
+        return;
+    }
+
+    http2_stream_t *stream = find_stream(session, id);
+    if (!stream)
+    {
+        if (id > session->last_stream_id)
+            connection_error(session, H2_PROTOCOL_ERROR, "WINDOW_UPDATE on an idle stream");
+        return;
+    }
+    if (increment == 0)
+        stream_error(session, id, H2_PROTOCOL_ERROR, "zero WINDOW_UPDATE");
+    else if (stream->send_window + increment > MAX_WINDOW)
+        stream_error(session, id, H2_FLOW_CONTROL_ERROR, "stream window overflow");
+    else
+        stream->send_window += increment;
+}
+
+static void handle_frame(http2_session_t *session, uint8_t type, uint8_t flags, uint32_t id,
+                         const uint8_t *payload, size_t len)
+{
+    // A header block must not be interleaved with other frames
+    if (session->header_stream && type != FRAME_CONTINUATION)
+    {
+        connection_error(session, H2_PROTOCOL_ERROR, "header block interrupted");
+        return;
+    }
+    if (!session->settings_received && type != FRAME_SETTINGS)
+    {
+        connection_error(session, H2_PROTOCOL_ERROR, "preface without SETTINGS");
+        return;
+    }
+
+    switch (type)
+    {
+    case FRAME_DATA:
+        on_data(session, id, flags, payload, len);
+        break;
+    case FRAME_HEADERS:
+        on_headers(session, id, flags, payload, len);
+        break;
+    case FRAME_PRIORITY:
+        if (id == 0)
+            connection_error(session, H2_PROTOCOL_ERROR, "PRIORITY on stream 0");
+        else if (len != 5)
+            stream_error(session, id, H2_FRAME_SIZE_ERROR, "PRIORITY length");
+        break;
+    case FRAME_RST_STREAM:
+        on_rst_stream(session, id, len);
+        break;
+    case FRAME_SETTINGS:
+        on_settings(session, id, flags, payload, len);
+        break;
+    case FRAME_PUSH_PROMISE:
+        connection_error(session, H2_PROTOCOL_ERROR, "PUSH_PROMISE from a client");
+        break;
+    case FRAME_PING:
+        on_ping(session, id, flags, payload, len);
+        break;
+    case FRAME_GOAWAY:
+        if (id != 0)
+            connection_error(session, H2_PROTOCOL_ERROR, "GOAWAY on a stream");
+        else
+            session->goaway = 1; // finish the open streams, accept no more
+        break;
+    case FRAME_WINDOW_UPDATE:
+        on_window_update(session, id, payload, len);
+        break;
+    case FRAME_CONTINUATION:
+        on_continuation(session, id, flags, payload, len);
+        break;
+    default:
+        break; // unknown frame types are ignored
+    }
+}
+
+// Give the client back the window its body bytes used, once half of it is gone
+static void credit_windows(http2_session_t *session)
+{
+    if (session->failed)
+        return;
+    if (session->recv_unacked >= HTTP2_WINDOW / 2)
+    {
+        send_window_update(session, 0, (uint32_t)session->recv_unacked);
+        session->recv_window += (int64_t)session->recv_unacked;
+        session->recv_unacked = 0;
+    }
+    for (http2_stream_t *stream = session->streams; stream; stream = stream->next)
+    {
+        if (stream->remote_closed || stream->discard_body || stream->recv_unacked < HTTP2_WINDOW / 2)
+            continue;
+        send_window_update(session, stream->id, (uint32_t)stream->recv_unacked);
+        stream->recv_window += (int64_t)stream->recv_unacked;
+        stream->recv_unacked = 0;
+    }
+}
+
+// Write if there is output, otherwise read. A failed session, or one told
+// to go away with nothing left open, closes once the queue drains.
+static void update_state(http2_session_t *session)
+{
+    connection_t *conn = session->conn;
+    if (session->failed || (session->goaway && session->stream_count == 0))
+        conn->close_after_write = 1;
+    conn->state = (conn->out_head || conn->close_after_write) ? CONN_WRITING : CONN_READ_HEADERS;
+}
+
+// ----- Connection -----
+
+void http2_process_input(connection_t *conn)
+{
+    http2_session_t *session = conn->h2;
+    size_t pos = 0;
+
+    if (!session->preface_received && conn->buffer_len > 0)
+    {
+        int rc = http2_check_preface(conn->buffer, conn->buffer_len);
+        if (rc < 0)
+            connection_error(session, H2_PROTOCOL_ERROR, "bad client preface");
+        else if (rc > 0)
+        {
+            session->preface_received = 1;
+            pos = HTTP2_PREFACE_LEN;
+        }
+    }
+
+    while (session->preface_received && !session->failed && conn->buffer_len - pos >= FRAME_HEADER_LEN)
+    {
+        const uint8_t *frame = (const uint8_t *)conn->buffer + pos;
+        size_t len = (size_t)frame[0] << 16 | (size_t)frame[1] << 8 | frame[2];
+        if (len > HTTP2_FRAME_SIZE)
+        {
+            connection_error(session, H2_FRAME_SIZE_ERROR, "frame larger than SETTINGS_MAX_FRAME_SIZE");
+            break;
+        }
+        if (conn->buffer_len - pos < FRAME_HEADER_LEN + len)
+            break; // rest of the frame still to come
+        handle_frame(session, frame[3], frame[4], get32(frame + 5) & 0x7fffffff, frame + FRAME_HEADER_LEN, len);
+        pos += FRAME_HEADER_LEN + len;
+    }
+
+    // Keep the partial frame at the start of the buffer
+    if (session->failed || pos >= conn->buffer_len)
+        conn->buffer_len = 0;
+    else if (pos > 0)
+    {
+        conn->buffer_len -= pos;
+        memmove(conn->buffer, conn->buffer + pos, conn->buffer_len);
+    }
+    if (conn->buffer)
+        conn->buffer[conn->buffer_len] = '\0';
+
+    credit_windows(session);
+    produce_data(session);
+    update_state(session);
+}
+
+int http2_on_output_sent(connection_t *conn)
+{
+    produce_data(conn->h2);
+    update_state(conn->h2);
+    return conn->out_head || !conn->close_after_write;
+}
+
+int http2_start(connection_t *conn)
+{
+    http2_session_t *session = calloc(1, sizeof(*session));
+    if (!session)
+    {
+        LOG_ERROR("Failed to allocate HTTP/2 session");
+        return -1;
+    }
+    session->conn = conn;
+    hpack_table_init(&session->decoder);
+    hpack_table_init(&session->encoder);
+    session->peer_initial_window = DEFAULT_WINDOW;
+    session->peer_max_frame = HTTP2_FRAME_SIZE;
+    session->send_window = DEFAULT_WINDOW;
+    session->recv_window = HTTP2_WINDOW; // raised right below
+    conn->h2 = session;
+
+    static const struct
+    {
+        uint16_t id;
+        uint32_t value;
+    } settings[] = {
+        {SETTINGS_MAX_CONCURRENT_STREAMS, HTTP2_MAX_STREAMS},
+        {SETTINGS_INITIAL_WINDOW_SIZE, HTTP2_WINDOW},
+        {SETTINGS_MAX_HEADER_LIST_SIZE, MAX_REQUEST_SIZE},
+    };
+    uint8_t payload[sizeof(settings) / sizeof(settings[0]) * 6];
+    for (size_t i = 0; i < sizeof(settings) / sizeof(settings[0]); i++)
+    {
+        payload[i * 6] = (uint8_t)(settings[i].id >> 8);
+        payload[i * 6 + 1] = (uint8_t)settings[i].id;
+        put32(payload + i * 6 + 2, settings[i].value);
+    }
+    queue_frame(session, FRAME_SETTINGS, 0, 0, payload, sizeof(payload));
+    send_window_update(session, 0, HTTP2_WINDOW - DEFAULT_WINDOW);
+
+    metrics_count_http2_connection();
+    LOG_DEBUG("Connection switched to HTTP/2");
+    return 0;
+}
+
+void http2_free(http2_session_t *session)
+{
+    if (!session)
+        return;
+    while (session->streams)
+        close_stream(session, session->streams);
+    hpack_table_free(&session->decoder);
+    hpack_table_free(&session->encoder);
+    free(session->header_block);
+    free(session);
+}
+
+int http2_is_idle(const http2_session_t *session)
+{
+    return session->stream_count == 0 && session->streams_served > 0;
+}
+
+void http2_on_timeout(connection_t *conn)
+{
+    http2_session_t *session = conn->h2;
+    metrics_count_timeout(session->stream_count > 0);
+    if (!session->goaway)
+        send_goaway(session, H2_NO_ERROR);
+    session->failed = 1;
+}
@@ -0,0 +1,57 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stddef.h>
+
+#include "connection.h"
+
+// HTTP/2 (RFC 9113): many concurrent requests on one connection, each a
+// stream of frames. Reached through ALPN "h2" under TLS, or over plain TCP
+// by a client that opens with the HTTP/2 preface (prior knowledge h2c).
+//
+// Every stream runs its request through the same handlers as HTTP/1.x: the
+// decoded header block is laid out in a request buffer of a per-stream
+// connection_t, the handler queues an HTTP/1.1 response there, and the
+// engine turns its head into a HEADERS frame (HPACK, see hpack.h) and its
+// body into DATA frames. DATA frames borrow the queued body chunks, so
+// files still leave through sendfile() (or kTLS) without being copied.
+// Streams with output are served round-robin within the flow control
+// windows the client grants, a frame per stream at a time.
+
+#define HTTP2_PREFACE_LEN 24
+#define HTTP2_MAX_STREAMS 128      // SETTINGS_MAX_CONCURRENT_STREAMS
+#define HTTP2_FRAME_SIZE 16384     // largest frame accepted (the protocol minimum)
+#define HTTP2_WINDOW (1 << 20)     // receive window per stream and for the connection
+#define HTTP2_WRITE_BATCH (1 << 18) // DATA bytes queued per round, before input is looked at again
+
+struct http2_session;
+
+// Check the start of the bytes a plain connection received for the client
+// preface. Returns 1 if it is there, 0 if what arrived so far is a prefix of
+// it, -1 if this is not HTTP/2.
+int http2_check_preface(const char *data, size_t len);
+
+// Switch `conn` to HTTP/2 and queue the server's SETTINGS. The client
+// preface is expected at the start of the receive buffer. Returns 0 or -1.
+int http2_start(connection_t *conn);
+
+// Release the session and every stream. The connection's queue must have
+// been freed first.
+void http2_free(struct http2_session *session);
+
+// Handle the complete frames in the receive buffer, keeping a partial one
+// for later, and queue whatever they produced. Leaves the connection in
+// CONN_WRITING if there is output, CONN_READ_HEADERS otherwise.
+void http2_process_input(connection_t *conn);
+
+// The queue drained: queue the next round of DATA frames. Returns 1 to keep
+// the connection open, 0 when it is done.
+int http2_on_output_sent(connection_t *conn);
+
+// 1 if no stream is open and at least one was served (keep-alive timeout)
+int http2_is_idle(const struct http2_session *session);
+
+// The connection timed out: queue a GOAWAY. The caller closes it.
+void http2_on_timeout(connection_t *conn);
+
+#endif
@@ -0,0 +1,265 @@
+#include <string.h>
+
+#include "http_chunked.h"
+#include "http_errors.h"
+#include "log.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Value of a hex digit, or -1
+static int hex_value(unsigned char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20; // lowercase
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+// Field and extension bytes: HTAB, SP, VCHAR and obs-text
+static int is_field_char(unsigned char c)
+{
+    return c == '\t' || (c >= ' ' && c != 0x7f);
+}
+
+void http_chunked_init(http_chunked_t *decoder, uint64_t max_body)
+{
+    decoder->state = HC_SIZE;
+    decoder->chunk_size = 0;
+    decoder->size_digits = 0;
+    decoder->ext_len = 0;
+    decoder->trailer_len = 0;
+    decoder->body_length = 0;
+    decoder->max_body = max_body;
+    decoder->error = 0;
+}
+
+static int fail(http_chunked_t *decoder, int error)
+{
+    decoder->state = HC_ERROR;
+    decoder->error = error;
+    return error;
+}
+
+int http_chunked_decode(http_chunked_t *decoder, const char *in, size_t *in_len, char *out, size_t *out_len)
+{
+    size_t len = *in_len;
+    size_t i = 0;
+    size_t o = 0;
+    *in_len = 0;
+    *out_len = 0;
+
+    if (decoder->state == HC_DONE)
+        return 1;
+    if (decoder->state == HC_ERROR)
+        return decoder->error;
+
+    http_chunked_state_t state = decoder->state;
+    int rc = 0;
+
+    while (i < len)
+    {
+        unsigned char c = (unsigned char)in[i];
+
+        switch (state)
+        {
+        case HC_SIZE:
+        {
+            int digit = hex_value(c);
+            if (digit >= 0)
+            {
+                // Leading zeros are free; 16 significant digits fill 64 bits
+                if (decoder->chunk_size >> 60)
+                {
+                    LOG_INFO("Chunk size overflows");
+                    rc = fail(decoder, HTTP_BODY_TOO_LARGE);
+                    goto out;
+                }
+                decoder->chunk_size = (decoder->chunk_size << 4) | (uint64_t)digit;
+                decoder->size_digits++;
+                break;
+            }
+            if (decoder->size_digits == 0)
+            {
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            decoder->ext_len = 0;
+            state = HC_EXT_START;
+            continue; // reprocess as the byte after the size
+        }
+
+        case HC_EXT_START:
+            // chunk-ext = *( BWS ";" BWS ext-name [ BWS "=" BWS ext-val ] )
+            if (c == ' ' || c == '\t')
+                break;
+            if (c == '\r')
+            {
+                state = HC_SIZE_LF;
+                break;
+            }
+            if (c != ';')
+            {
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            state = HC_EXT;
+            break;
+
+        case HC_EXT:
+            if (c == '\r')
+            {
+                state = HC_SIZE_LF;
+                break;
+            }
+            if (!is_field_char(c) || ++decoder->ext_len > HTTP_CHUNK_EXT_MAX)
+            {
+                LOG_INFO("Malformed or oversized chunk extension");
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            break;
+
+        case HC_SIZE_LF:
+            if (c != '\n')
+            {
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            if (decoder->chunk_size == 0)
+            {
+                state = HC_TRAILER_START; // last-chunk
+                break;
+            }
+            if (decoder->chunk_size > decoder->max_body - decoder->body_length)
+            {
+                LOG_INFO("Chunked body exceeds %llu bytes", (unsigned long long)decoder->max_body);
+                rc = fail(decoder, HTTP_BODY_TOO_LARGE);
+                goto out;
+            }
+            state = HC_DATA;
+            break;
+
+        case HC_DATA:
+        {
+            // Copy as much of the chunk as this read holds in one go
+            size_t n = len - i;
+            if (n > decoder->chunk_size)
+                n = (size_t)decoder->chunk_size;
+            if (out + o != in + i)
+                memmove(out + o, in + i, n);
+            o += n;
+            i += n;
+            decoder->chunk_size -= n;
+            decoder->body_length += n;
+            if (decoder->chunk_size == 0)
+                state = HC_DATA_CR;
+            continue;
+        }
+
+        case HC_DATA_CR:
+            if (c != '\r')
+            {
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            state = HC_DATA_LF;
+            break;
+
+        case HC_DATA_LF:
+            if (c != '\n')
+            {
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            decoder->size_digits = 0;
+            state = HC_SIZE;
+            break;
+
+        case HC_TRAILER_START:
+            if (c == '\r')
+            {
+                state = HC_END_LF;
+                break;
+            }
+            // A field line may not start with whitespace (obsolete line folding)
+            if (c == ' ' || c == '\t' || !is_field_char(c))
+            {
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            state = HC_TRAILER;
+            continue;
+
+        case HC_TRAILER:
+            if (++decoder->trailer_len > HTTP_CHUNK_TRAILER_MAX)
+            {
+                LOG_INFO("Trailer section too large");
+                rc = fail(decoder, HTTP_HEADERS_TOO_LARGE);
+                goto out;
+            }
+            if (c == '\r')
+            {
+                state = HC_TRAILER_LF;
+                break;
+            }
+            if (!is_field_char(c))
+            {
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            break;
+
+        case HC_TRAILER_LF:
+            if (c != '\n')
+            {
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            state = HC_TRAILER_START;
+            break;
+
+        case HC_END_LF:
+            if (c != '\n')
+            {
+                rc = fail(decoder, HTTP_PARSE_ERROR);
+                goto out;
+            }
+            i++;
+            state = HC_DONE;
+            rc = 1;
+            goto out;
+
+        case HC_DONE:
+        case HC_ERROR:
+            break;
+        }
+
+        i++;
+    }
+
+out:
+    if (rc >= 0)
+        decoder->state = state;
+    *in_len = i;
+    *out_len = o;
+    return rc;
+}
+
+size_t http_chunked_head(char *out, size_t len)
+{
+    char digits[16];
+    size_t n = 0;
+    do
+    {
+        digits[n++] = hex_digits[len & 0xf];
+        len >>= 4;
+    } while (len);
+
+    for (size_t i = 0; i < n; i++)
+        out[i] = digits[n - 1 - i];
+    out[n] = '\r';
+    out[n + 1] = '\n';
+    return n + 2;
+}
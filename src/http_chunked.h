@@ -0,0 +1,68 @@
+#ifndef HTTP_CHUNKED_H
+#define HTTP_CHUNKED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Chunked transfer coding (RFC 9112 section 7.1).
+// The decoder is resumable like the head parser: feed it each run of body
+// bytes as it arrives and it continues where the previous call stopped, so
+// it never needs a complete chunk, or even a complete chunk-size line, in
+// the buffer. Chunk data is copied out; chunk extensions and trailer fields
+// are checked for syntax and discarded.
+
+#define HTTP_CHUNK_EXT_MAX 1024     // chunk extension bytes per chunk-size line
+#define HTTP_CHUNK_TRAILER_MAX 8192 // bytes of the whole trailer section
+
+typedef enum
+{
+    HC_SIZE,          // chunk-size hex digits
+    HC_EXT_START,     // whitespace before the ';' of a chunk extension
+    HC_EXT,           // chunk extension, up to CR
+    HC_SIZE_LF,
+    HC_DATA,
+    HC_DATA_CR,       // CRLF closing the chunk data
+    HC_DATA_LF,
+    HC_TRAILER_START, // start of a trailer field line or the final CRLF
+    HC_TRAILER,
+    HC_TRAILER_LF,
+    HC_END_LF,
+    HC_DONE,
+    HC_ERROR,
+} http_chunked_state_t;
+
+typedef struct
+{
+    http_chunked_state_t state;
+    uint64_t chunk_size;  // size being read, then data bytes left in the chunk
+    int size_digits;      // digits of the chunk size seen so far
+    size_t ext_len;       // extension bytes on the current chunk-size line
+    size_t trailer_len;   // trailer section bytes so far
+    uint64_t body_length; // data bytes decoded so far
+    uint64_t max_body;    // larger bodies fail with HTTP_BODY_TOO_LARGE
+    int error;            // negative http_io_status_t once HC_ERROR
+} http_chunked_t;
+
+void http_chunked_init(http_chunked_t *decoder, uint64_t max_body);
+
+// Decode in[0, *in_len), copying chunk data to `out`. `out` may be `in`
+// itself: data never moves forward, so decoding in place compacts the body.
+// On return *in_len is the number of bytes consumed (all of them unless the
+// body ended; bytes after it belong to the next request) and *out_len the
+// number of data bytes written. Returns 1 once the last chunk and trailer
+// section are complete, 0 if more input is needed, or a negative
+// http_io_status_t (HTTP_PARSE_ERROR, HTTP_BODY_TOO_LARGE, or
+// HTTP_HEADERS_TOO_LARGE for oversized trailers).
+int http_chunked_decode(http_chunked_t *decoder, const char *in, size_t *in_len, char *out, size_t *out_len);
+
+// ----- Encoder -----
+
+#define HTTP_CHUNK_HEAD_MAX 18 // 16 hex digits + CRLF
+#define HTTP_CHUNK_END "\r\n"        // follows the data of every chunk
+#define HTTP_CHUNK_LAST "0\r\n\r\n" // last chunk and an empty trailer section
+
+// Render the "<hex size>\r\n" line opening a chunk of `len` (non-zero) bytes
+// into `out` (HTTP_CHUNK_HEAD_MAX bytes). Returns its length.
+size_t http_chunked_head(char *out, size_t len);
+
+#endif
@@ -0,0 +1,119 @@
+#include <string.h>
+
+#include "http_encoding.h"
+
+const char *const http_encoding_names[HTTP_ENCODING_COUNT] = {"br", "zstd", "gzip"};
+const char *const http_encoding_suffixes[HTTP_ENCODING_COUNT] = {".br", ".zst", ".gz"};
+
+static const char *const content_encoding_lines[HTTP_ENCODING_COUNT] = {
+    "Content-Encoding: br\r\n",
+    "Content-Encoding: zstd\r\n",
+    "Content-Encoding: gzip\r\n",
+};
+
+// qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] )
+// Returns thousandths, or -1 if malformed.
+static int parse_qvalue(const char *p, const char *end)
+{
+    if (p == end || (*p != '0' && *p != '1'))
+        return -1;
+
+    int q = (*p++ - '0') * 1000;
+    if (p < end)
+    {
+        if (*p++ != '.')
+            return -1;
+        for (int scale = 100; p < end; p++, scale /= 10)
+        {
+            if (scale == 0 || *p < '0' || *p > '9')
+                return -1;
+            q += (*p - '0') * scale;
+        }
+    }
+    return q > 1000 ? -1 : q;
+}
+
+static int name_is(const char *name, size_t len, const char *literal)
+{
+    return len == strlen(literal) && memcmp(name, literal, len) == 0;
+}
+
+void http_accept_encoding_parse(const char *value, http_accept_encoding_t *accept)
+{
+    int q[HTTP_ENCODING_COUNT];
+    for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+        q[i] = -1;
+    int identity = -1;
+    int star = -1;
+
+    // Accept-Encoding = #( codings [ weight ] ), weight = ";" "q=" qvalue
+    const char *p = value ? value : "";
+    while (*p)
+    {
+        while (*p == ',' || *p == ' ' || *p == '\t')
+            p++;
+        const char *end = strchr(p, ',');
+        if (!end)
+            end = p + strlen(p);
+
+        const char *name = p;
+        while (p < end && *p != ';')
+            p++;
+        size_t name_len = (size_t)(p - name);
+
+        // Parameters other than q are allowed and ignored
+        int quality = 1000;
+        while (p < end && quality >= 0)
+        {
+            const char *param = ++p;
+            while (p < end && *p != ';')
+                p++;
+            if (p - param >= 2 && param[0] == 'q' && param[1] == '=')
+                quality = parse_qvalue(param + 2, p);
+        }
+        p = end;
+
+        if (quality < 0 || name_len == 0)
+            continue;
+        if (name_is(name, name_len, "*"))
+            star = quality;
+        else if (name_is(name, name_len, "identity"))
+            identity = quality;
+        else if (name_is(name, name_len, "x-gzip"))
+            q[HTTP_ENCODING_GZIP] = quality;
+        else
+        {
+            for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+            {
+                if (name_is(name, name_len, http_encoding_names[i]))
+                    q[i] = quality;
+            }
+        }
+    }
+
+    for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+        accept->q[i] = (uint16_t)(q[i] >= 0 ? q[i] : star >= 0 ? star : 0);
+    accept->identity = (uint16_t)(identity >= 0 ? identity : star >= 0 ? star : 1000);
+}
+
+http_encoding_t http_accept_encoding_select(const http_accept_encoding_t *accept, unsigned available)
+{
+    http_encoding_t best = HTTP_ENCODING_IDENTITY;
+    unsigned best_q = 0;
+    for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+    {
+        if ((available & (1u << i)) && accept->q[i] > best_q)
+        {
+            best = (http_encoding_t)i;
+            best_q = accept->q[i];
+        }
+    }
+    return best_q >= accept->identity ? best : HTTP_ENCODING_IDENTITY;
+}
+
+const char *http_content_encoding_line(http_encoding_t encoding, size_t *len)
+{
+    const char *line = content_encoding_lines[encoding];
+    *len = strlen(line);
+    return line;
+}
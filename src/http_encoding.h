@@ -0,0 +1,47 @@
+#ifndef HTTP_ENCODING_H
+#define HTTP_ENCODING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Content codings (RFC 9110 section 8.4) and Accept-Encoding negotiation
+// (section 12.5.3)
+
+typedef enum
+{
+    HTTP_ENCODING_IDENTITY = -1,
+    HTTP_ENCODING_BR,
+    HTTP_ENCODING_ZSTD,
+    HTTP_ENCODING_GZIP,
+    HTTP_ENCODING_COUNT
+} http_encoding_t;
+
+// Content-Encoding token and precompressed file suffix of each coding
+extern const char *const http_encoding_names[HTTP_ENCODING_COUNT];
+extern const char *const http_encoding_suffixes[HTTP_ENCODING_COUNT];
+
+#define HTTP_VARY_ACCEPT_ENCODING "Vary: Accept-Encoding\r\n"
+
+// Quality of each coding, in thousandths (0 = not acceptable)
+typedef struct
+{
+    uint16_t q[HTTP_ENCODING_COUNT];
+    uint16_t identity;
+} http_accept_encoding_t;
+
+// Parse an Accept-Encoding value (lowercased, OWS trimmed). A NULL value,
+// i.e. no header, accepts identity only. Codings not listed take the
+// quality of "*", if present, else 0; identity stays acceptable unless
+// refused explicitly or through "*;q=0". "x-gzip" counts as gzip, unknown
+// codings and malformed members are skipped.
+void http_accept_encoding_parse(const char *value, http_accept_encoding_t *accept);
+
+// The coding out of `available` (bit 1 << coding) to send: the one the client
+// rates highest, earlier codings winning ties, unless it rates identity
+// higher. A coding wins a tie with identity, being the smaller of the two.
+http_encoding_t http_accept_encoding_select(const http_accept_encoding_t *accept, unsigned available);
+
+// Pre-rendered "Content-Encoding: <coding>\r\n" line
+const char *http_content_encoding_line(http_encoding_t encoding, size_t *len);
+
+#endif
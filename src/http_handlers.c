@@ -0,0 +1,793 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include "http_handlers.h"
+#include "server_config.h"
+#include "string_utils.h"
+#include "error_handlers.h"
+#include "response_utils.h"
+#include "file_cache.h"
+#include "compress.h"
+#include "http_encoding.h"
+#include "http_range.h"
+#include "metrics.h"
+#include "log.h"
+
+typedef struct
+{
+    const char *ext;
+    const char *type;
+    int compressible; // worth compressing on the fly
+} mime_type;
+
+static const mime_type mime_types[] = {
+    {".html", "text/html", 1},
+    {".htm", "text/html", 1},
+    {".css", "text/css", 1},
+    {".js", "application/javascript", 1},
+    {".json", "application/json", 1},
+    {".svg", "image/svg+xml", 1},
+    {".jpg", "image/jpeg", 0},
+    {".jpeg", "image/jpeg", 0},
+    {".png", "image/png", 0},
+    {".gif", "image/gif", 0},
+    {".txt", "text/plain", 1},
+    {NULL, "application/octet-stream", 0}};
+
+const char *get_mime_type(const char *filepath)
+{
+    const char *ext = strrchr(filepath, '.');
+    if (!ext)
+        return mime_types[sizeof(mime_types) / sizeof(mime_type) - 1].type;
+    for (size_t i = 0; mime_types[i].ext; i++)
+    {
+        if (str_case_cmp(ext, mime_types[i].ext) == 0)
+        {
+            return mime_types[i].type;
+        }
+    }
+    return mime_types[sizeof(mime_types) / sizeof(mime_type) - 1].type;
+}
+
+int mime_type_compressible(const char *type)
+{
+    for (size_t i = 0; mime_types[i].ext; i++)
+    {
+        if (strcmp(type, mime_types[i].type) == 0)
+            return mime_types[i].compressible;
+    }
+    return 0;
+}
+
+// Queue `len` bytes of the entry's body from `offset`. The caller's reference
+// to the entry passes to the queued chunk.
+static void queue_file_body(connection_t *conn, file_cache_entry_t *entry, uint64_t offset, size_t len)
+{
+    if (entry->body)
+        connection_send_ref(conn, entry->body + offset, len, file_cache_release, entry);
+    else
+        connection_send_file_ref(conn, entry->fd, (off_t)offset, len, file_cache_release, entry);
+}
+
+// Pick the representation of `entry` to send: the precompressed variant the
+// client rates highest, or else, for files that qualify, the file compressed
+// on the fly (once, into the cache), or else the file itself.
+static file_cache_entry_t *select_variant(file_cache_entry_t *entry, const http_request *request)
+{
+    http_accept_encoding_t accept;
+    http_accept_encoding_parse(http_request_header(request, HTTP_HEADER_ACCEPT_ENCODING), &accept);
+
+    unsigned available = 0;
+    for (int i = 0; i < HTTP_ENCODING_COUNT; i++)
+    {
+        if (entry->variants[i] && entry->variants[i]->headers_len > 0)
+            available |= 1u << i;
+    }
+
+    http_encoding_t encoding = http_accept_encoding_select(&accept, available);
+    if (encoding == HTTP_ENCODING_IDENTITY && compress_eligible(entry->mime_type, entry->size))
+    {
+        encoding = http_accept_encoding_select(&accept, compress_supported() & ~entry->incompressible);
+        if (encoding != HTTP_ENCODING_IDENTITY && !file_cache_compress(entry, encoding))
+            encoding = HTTP_ENCODING_IDENTITY;
+    }
+    return encoding == HTTP_ENCODING_IDENTITY ? entry : entry->variants[encoding];
+}
+
+// 1 if the If-Match/If-None-Match list `list` holds the entity-tag `etag`
+// (or is "*"). Weak comparison ignores W/ prefixes; under strong comparison
+// a weak tag never matches. A malformed list matches nothing.
+static int etag_list_matches(const char *list, const char *etag, int weak)
+{
+    size_t etag_len = strlen(etag);
+    const char *p = list;
+    for (;;)
+    {
+        while (*p == ' ' || *p == '\t' || *p == ',')
+            p++;
+        if (*p == '\0')
+            return 0;
+        if (*p == '*')
+            return 1;
+
+        int is_weak = p[0] == 'W' && p[1] == '/';
+        if (is_weak)
+            p += 2;
+        if (*p != '"')
+            return 0;
+        const char *end = strchr(p + 1, '"');
+        if (!end)
+            return 0;
+
+        size_t len = (size_t)(end - p) + 1;
+        if ((weak || !is_weak) && len == etag_len && memcmp(p, etag, len) == 0)
+            return 1;
+        p = end + 1;
+    }
+}
+
+// Evaluate the conditional headers of a GET/HEAD against the file, in the
+// order of RFC 9110 section 13.2.2. Returns 200 to send it, 304 or 412.
+// Everything needed is cached metadata: no file system access.
+static int evaluate_preconditions(const http_request *request, const file_cache_entry_t *entry)
+{
+    time_t date;
+    const char *if_match = http_request_header(request, HTTP_HEADER_IF_MATCH);
+    const char *if_unmodified_since = http_request_header(request, HTTP_HEADER_IF_UNMODIFIED_SINCE);
+    if (if_match)
+    {
+        if (!etag_list_matches(if_match, entry->etag, 0))
+            return 412;
+    }
+    else if (if_unmodified_since && http_parse_date(if_unmodified_since, &date) && entry->mtime.tv_sec > date)
+    {
+        return 412;
+    }
+
+    const char *if_none_match = http_request_header(request, HTTP_HEADER_IF_NONE_MATCH);
+    const char *if_modified_since = http_request_header(request, HTTP_HEADER_IF_MODIFIED_SINCE);
+    if (if_none_match)
+    {
+        if (etag_list_matches(if_none_match, entry->etag, 1))
+            return 304;
+    }
+    else if (if_modified_since && http_parse_date(if_modified_since, &date) && entry->mtime.tv_sec <= date)
+    {
+        return 304;
+    }
+    return 200;
+}
+
+// 304: the validators the 200 would carry, no body
+static void send_not_modified(connection_t *conn, file_cache_entry_t *entry, const char *connection_header)
+{
+    connection_set_response(conn, 304, 0);
+    response_builder_t response;
+    response_begin(&response, 304, "Not Modified");
+    response_add(&response, entry->headers + entry->type_line_len, entry->validators_len);
+    response_add_connection(&response, connection_header);
+    response_finish(&response, conn, NULL, 0);
+    file_cache_release(entry);
+}
+
+// A Range applies only while the If-Range validator, if any, still matches
+// the file: its entity-tag (strong comparison) or an HTTP-date equal to its
+// Last-Modified
+static int if_range_matches(const http_request *request, const file_cache_entry_t *entry)
+{
+    const char *if_range = http_request_header(request, HTTP_HEADER_IF_RANGE);
+    if (!if_range)
+        return 1;
+    if (if_range[0] == '"' || if_range[0] == 'W')
+        return strcmp(if_range, entry->etag) == 0;
+
+    time_t date;
+    return http_parse_date(if_range, &date) && date == entry->mtime.tv_sec;
+}
+
+// 206 for a single range: the slice goes out like a whole file, sendfile()
+// or splice() from its offset for fd-backed entries
+static void send_range_response(connection_t *conn, file_cache_entry_t *entry, const http_range_t *range,
+                                const char *connection_header)
+{
+    size_t len = (size_t)(range->last - range->first + 1);
+    char content_range[80];
+    int content_range_len = snprintf(content_range, sizeof(content_range), "Content-Range: bytes %llu-%llu/%zu\r\n",
+                                     (unsigned long long)range->first, (unsigned long long)range->last, entry->size);
+
+    connection_set_response(conn, 206, len);
+    response_builder_t response;
+    response_begin(&response, 206, "Partial Content");
+    response_add(&response, entry->headers, entry->type_line_len + entry->validators_len);
+    response_add(&response, content_range, (size_t)content_range_len);
+    response_add_content_length(&response, len);
+    response_add_connection(&response, connection_header);
+    if (response_finish(&response, conn, NULL, 0) < 0)
+    {
+        file_cache_release(entry);
+        return;
+    }
+    queue_file_body(conn, entry, range->first, len);
+}
+
+// A part head is the boundary line, the entry's type lines (shorter than its
+// rendered headers) and a Content-Range line of three 20-digit numbers, so
+// every head fits and none is ever cut short
+#define RANGE_PART_HEAD_FIXED 128
+#define RANGE_PART_HEAD_MAX (sizeof(((file_cache_entry_t *)0)->headers) + RANGE_PART_HEAD_FIXED)
+_Static_assert(sizeof("\r\n--\r\nContent-Range: bytes -/\r\n\r\n") - 1 + 16 + 3 * 20 <= RANGE_PART_HEAD_FIXED,
+               "part head fixed text fits");
+
+// 206 multipart/byteranges: a small head per part, each followed by its
+// slice of the file queued by reference like a single range
+static void send_multirange_response(connection_t *conn, file_cache_entry_t *entry, const http_range_t *ranges,
+                                     int count, const char *connection_header)
+{
+    // The boundary is derived from the file's identity, so it is stable for
+    // one version of the file
+    uint64_t seed = ((uint64_t)entry->ino * UINT64_C(0x9e3779b97f4a7c15)) ^
+                    ((uint64_t)entry->mtime.tv_sec << 20) ^ (uint64_t)entry->mtime.tv_nsec ^ entry->size;
+    char boundary[17];
+    snprintf(boundary, sizeof(boundary), "%016llx", (unsigned long long)seed);
+
+    char heads[HTTP_RANGE_MAX][RANGE_PART_HEAD_MAX];
+    size_t head_lens[HTTP_RANGE_MAX];
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int len = snprintf(heads[i], sizeof(heads[i]), "\r\n--%s\r\n%.*sContent-Range: bytes %llu-%llu/%zu\r\n\r\n",
+                           boundary, (int)entry->type_line_len, entry->headers,
+                           (unsigned long long)ranges[i].first, (unsigned long long)ranges[i].last, entry->size);
+        head_lens[i] = (size_t)len;
+        total += head_lens[i] + (size_t)(ranges[i].last - ranges[i].first + 1);
+    }
+    char closing[32];
+    size_t closing_len = (size_t)snprintf(closing, sizeof(closing), "\r\n--%s--\r\n", boundary);
+    total += closing_len;
+
+    char content_type[80];
+    int content_type_len = snprintf(content_type, sizeof(content_type),
+                                    "Content-Type: multipart/byteranges; boundary=%s\r\n", boundary);
+
+    connection_set_response(conn, 206, total);
+    response_builder_t response;
+    response_begin(&response, 206, "Partial Content");
+    response_add(&response, content_type, (size_t)content_type_len);
+    response_add(&response, entry->headers + entry->type_line_len, entry->validators_len);
+    response_add_content_length(&response, total);
+    response_add_connection(&response, connection_header);
+    if (response_finish(&response, conn, NULL, 0) < 0)
+    {
+        file_cache_release(entry);
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        connection_send(conn, heads[i], head_lens[i]);
+        file_cache_retain(entry); // one reference per queued slice
+        queue_file_body(conn, entry, ranges[i].first, (size_t)(ranges[i].last - ranges[i].first + 1));
+    }
+    connection_send(conn, closing, closing_len);
+    file_cache_release(entry);
+}
+
+void send_file_response(connection_t *conn, const char *filepath, const http_request *request)
+{
+    const char *method = request->method;
+    const char *connection_header = request->connection_header;
+
+    // Hot files come straight from the per-worker cache: no open/fstat, and
+    // the Content-Type, validator and Content-Length lines are already rendered
+    file_cache_entry_t *entry = file_cache_get(filepath);
+    if (!entry)
+    {
+        send_error_response(conn, 404, "Not Found", connection_header, method);
+        return;
+    }
+
+    if (entry->headers_len == 0)
+    {
+        file_cache_release(entry);
+        send_error_response(conn, 500, "Internal Server Error", connection_header, method);
+        return;
+    }
+
+    int head_only = str_case_cmp(method, "GET") != 0;
+
+    // Content negotiation over the precompressed variants. Range requests
+    // always address the file itself, so byte offsets and If-Range keep
+    // meaning the same thing whatever the client accepts.
+    const char *range = head_only ? NULL : http_request_header(request, HTTP_HEADER_RANGE);
+    if (!range)
+    {
+        file_cache_entry_t *variant = select_variant(entry, request);
+        if (variant != entry)
+        {
+            file_cache_retain(variant);
+            file_cache_release(entry);
+            entry = variant;
+        }
+    }
+
+    // Revalidation is answered from the cached validators
+    int condition = evaluate_preconditions(request, entry);
+    if (condition == 304)
+    {
+        send_not_modified(conn, entry, connection_header);
+        return;
+    }
+    if (condition == 412)
+    {
+        file_cache_release(entry);
+        send_error_response(conn, 412, "Precondition Failed", connection_header, method);
+        return;
+    }
+
+    // Range requests are defined for GET only
+    if (range && if_range_matches(request, entry))
+    {
+        http_range_t ranges[HTTP_RANGE_MAX];
+        int count = http_range_parse(range, entry->size, ranges);
+        if (count == 0)
+        {
+            char content_range[64];
+            snprintf(content_range, sizeof(content_range), "Content-Range: bytes */%zu\r\n", entry->size);
+            file_cache_release(entry);
+            send_error_response_with_headers(conn, 416, "Range Not Satisfiable", connection_header, content_range,
+                                             method);
+            return;
+        }
+        if (count == 1)
+        {
+            send_range_response(conn, entry, &ranges[0], connection_header);
+            return;
+        }
+        if (count > 1)
+        {
+            send_multirange_response(conn, entry, ranges, count, connection_header);
+            return;
+        }
+        // Ignored: the whole file follows
+    }
+
+    connection_set_response(conn, 200, head_only ? 0 : entry->size);
+
+    // Head from pre-rendered fragments; the body is queued separately
+    response_builder_t response;
+    response_begin(&response, 200, "OK");
+    response_add(&response, entry->headers, entry->headers_len);
+    response_add_connection(&response, connection_header);
+    if (response_finish(&response, conn, NULL, 0) < 0)
+    {
+        file_cache_release(entry);
+        return;
+    }
+
+    size_t file_size = entry->size;
+
+    // Queue file content only if method is GET. The body is borrowed from the
+    // cache entry, which stays referenced until the chunk has been sent:
+    // in-memory bodies go out with send(), fd-backed ones zero-copy
+    // (sendfile/splice) as the socket drains
+    if (!head_only && file_size > 0)
+        queue_file_body(conn, entry, 0, file_size);
+    else
+        file_cache_release(entry);
+
+    LOG_DEBUG("Sent file: %s (%zu bytes)", filepath, file_size);
+}
+
+// Map URL path to file path
+int map_path_to_file(const char *url_path, char *file_path, size_t max_len)
+{
+    if (strcmp(url_path, "/") == 0)
+    {
+        snprintf(file_path, max_len, "./www/index.html");
+    }
+    else
+    {
+        int bytes = snprintf(file_path, max_len, "./www%s", url_path);
+        if (bytes < 0 || (size_t)bytes >= max_len)
+        {
+            LOG_INFO("File path too long");
+            return HTTP_URI_TOO_LONG;
+        }
+    }
+    return 0;
+}
+
+// Check that the upload directory behind `url_path` exists and return its
+// file system path in `dir_path`. Sends an error response and returns 0 if not.
+static int upload_directory(connection_t *conn, const http_request *request, char *dir_path, size_t max_len)
+{
+    if (map_path_to_file(request->path, dir_path, max_len) != 0)
+    {
+        send_error_response(conn, 414, "URI Too Long", "close", request->method);
+        return 0;
+    }
+
+    struct stat st;
+    if (stat(dir_path, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        LOG_ERROR("Directory %s does not exist or is not a directory", dir_path);
+        send_error_response(conn, 500, "Internal Server Error", "close", request->method);
+        return 0;
+    }
+    return 1;
+}
+
+// File extension for an image/<subtype> upload: the lowercased subtype, or
+// "bin" if it is not purely alphanumeric
+static void image_extension(const char *content_type, char *extension, size_t max_len)
+{
+    const char *subtype = content_type + 6;
+
+    // Extract subtype up to ';' (if optional parameters present) or end, and convert to lowercase
+    size_t ext_len = 0;
+    for (const char *p = subtype; *p && *p != ';' && ext_len < max_len - 1; p++, ext_len++)
+    {
+        extension[ext_len] = tolower(*p);
+    }
+    extension[ext_len] = '\0';
+
+    // Validate: only alphanumeric characters allowed
+    for (size_t i = 0; extension[i]; i++)
+    {
+        if (!isalnum(extension[i]))
+        {
+            strcpy(extension, "bin"); // Fallback for invalid subtypes
+            break;
+        }
+    }
+    if (ext_len == 0)
+        strcpy(extension, "bin");
+}
+
+// A body being streamed to disk: written to a hidden temporary file and
+// renamed into place only once complete, so a failed upload never replaces
+// the previous image
+typedef struct
+{
+    int fd;
+    char temp_path[1024];
+    char final_path[1024];
+} upload_t;
+
+int prepare_request_body(connection_t *conn, http_request *request)
+{
+    size_t limit = server_config_max_body(request->path);
+    if (request->content_length > limit)
+    {
+        LOG_INFO("Content-Length too large: %zu bytes for %zu on %s", request->content_length, limit, request->path);
+        handle_read_body_status(HTTP_BODY_TOO_LARGE, conn, "close", request->method);
+        return 0;
+    }
+
+    // Images posted to /test go straight to disk; everything else is buffered
+    const char *content_type = http_request_header(request, HTTP_HEADER_CONTENT_TYPE);
+    if (strcmp(request->method, "POST") != 0 || strcmp(request->path, "/test") != 0 ||
+        !content_type || strn_case_cmp(content_type, "image/", 6) != 0)
+        return 1;
+
+    char dir_path[1024];
+    if (!upload_directory(conn, request, dir_path, sizeof(dir_path)))
+        return 0;
+
+    char extension[64];
+    image_extension(content_type, extension, sizeof(extension));
+
+    upload_t *upload = malloc(sizeof(*upload));
+    if (!upload)
+    {
+        LOG_ERROR("Failed to allocate upload");
+        send_error_response(conn, 500, "Internal Server Error", "close", request->method);
+        return 0;
+    }
+
+    int temp_len = snprintf(upload->temp_path, sizeof(upload->temp_path), "%s/.upload-XXXXXX", dir_path);
+    int final_len = snprintf(upload->final_path, sizeof(upload->final_path), "%s/image.%s", dir_path, extension);
+    if (temp_len < 0 || (size_t)temp_len >= sizeof(upload->temp_path) ||
+        final_len < 0 || (size_t)final_len >= sizeof(upload->final_path))
+    {
+        LOG_ERROR("Directory path too long for image upload: %s", dir_path);
+        free(upload);
+        send_error_response(conn, 500, "Internal Server Error", "close", request->method);
+        return 0;
+    }
+
+    upload->fd = mkostemp(upload->temp_path, O_CLOEXEC);
+    if (upload->fd < 0 || fchmod(upload->fd, 0644) != 0)
+    {
+        LOG_ERROR("Failed to create %s: %s", upload->temp_path, strerror(errno));
+        if (upload->fd >= 0)
+        {
+            close(upload->fd);
+            unlink(upload->temp_path);
+        }
+        free(upload);
+        send_error_response(conn, 500, "Internal Server Error", "close", request->method);
+        return 0;
+    }
+
+    LOG_DEBUG("Streaming %zu byte upload to %s", request->content_length, upload->final_path);
+    connection_stream_body(conn, upload->fd, 0, upload);
+    return 1;
+}
+
+int finish_streamed_body(connection_t *conn, http_request *request, void *stream, int status)
+{
+    upload_t *upload = stream;
+    if (close(upload->fd) != 0 && status == 1)
+    {
+        LOG_ERROR("Failed to write %s: %s", upload->temp_path, strerror(errno));
+        status = HTTP_IO_ERROR;
+    }
+    if (status == 1 && rename(upload->temp_path, upload->final_path) != 0)
+    {
+        LOG_ERROR("Failed to rename %s to %s: %s", upload->temp_path, upload->final_path, strerror(errno));
+        send_error_response(conn, 500, "Internal Server Error", "close", request->method);
+        status = 0;
+    }
+    if (status != 1)
+    {
+        unlink(upload->temp_path);
+        free(upload);
+        return 0;
+    }
+
+    // Content-Length, or the decoded size of a chunked body
+    size_t stored = (size_t)conn->body_offset;
+    LOG_DEBUG("Stored %zu byte upload in %s", stored, upload->final_path);
+    free(upload);
+
+    char body[64];
+    int body_len = snprintf(body, sizeof(body), "Received: %zu bytes", stored);
+
+    connection_set_response(conn, 200, (size_t)body_len);
+    response_builder_t response;
+    response_begin(&response, 200, "OK");
+    response_add_literal(&response, "Content-Type: text/plain\r\n");
+    response_add_content_length(&response, (size_t)body_len);
+    response_add_connection(&response, request->connection_header);
+    response_end_head(&response);
+    response_add(&response, body, (size_t)body_len);
+    response_send(&response, conn);
+
+    return strn_case_cmp(request->connection_header, "keep-alive", 10) == 0;
+}
+
+// Coding for a dynamic body of `mime_type` and `size` bytes (SIZE_MAX if not
+// known up front): the one the client prefers, or identity. Compressed
+// bodies go out as a chunked stream, so HTTP/1.0 clients always get
+// identity. Sets *vary if the choice depends on Accept-Encoding.
+static http_encoding_t stream_encoding(const http_request *request, const char *mime_type, size_t size, int *vary)
+{
+    *vary = compress_eligible(mime_type, size);
+    if (!*vary || strcmp(request->version, "HTTP/1.1") != 0)
+        return HTTP_ENCODING_IDENTITY;
+
+    http_accept_encoding_t accept;
+    http_accept_encoding_parse(http_request_header(request, HTTP_HEADER_ACCEPT_ENCODING), &accept);
+    return http_accept_encoding_select(&accept, compress_supported());
+}
+
+// Finish the head of a 200 with a chunked body in `encoding` and open the
+// stream the body is written to; fclose() ends it. Returns NULL if the
+// response could not be started.
+static FILE *open_body_stream(connection_t *conn, response_builder_t *response, http_encoding_t encoding,
+                              const char *connection_header)
+{
+    connection_set_response(conn, 200, 0); // the stream counts the body
+    if (encoding != HTTP_ENCODING_IDENTITY)
+    {
+        size_t len;
+        const char *line = http_content_encoding_line(encoding, &len);
+        response_add(response, line, len);
+    }
+    response_add_chunked(response);
+    response_add_connection(response, connection_header);
+    if (response_finish(response, conn, NULL, 0) < 0)
+        return NULL;
+
+    FILE *out = response_chunked_stream(conn);
+    if (out && encoding != HTTP_ENCODING_IDENTITY)
+    {
+        FILE *compressed = compress_stream(encoding, out);
+        if (!compressed)
+            fclose(out);
+        out = compressed;
+    }
+    if (!out)
+    {
+        LOG_ERROR("Failed to open response stream");
+        conn->close_after_write = 1; // head already queued: cut the response short
+    }
+    return out;
+}
+
+void handle_post_request(connection_t *conn, const http_request *request, const char *connection_header)
+{
+    // Store body to file (image uploads were already streamed by prepare_request_body())
+    if (request->body_length > 0 && strcmp(request->path, "/test") == 0)
+    {
+        char dir_path[1024];
+        if (!upload_directory(conn, request, dir_path, sizeof(dir_path)))
+            return;
+
+        // Check Content-Type
+        const char *content_type = http_request_header(request, HTTP_HEADER_CONTENT_TYPE);
+        if (!content_type || // Handle text data
+            (strn_case_cmp(content_type, "text/", 5) != 0 &&
+             strn_case_cmp(content_type, "application/json", 16) != 0 &&
+             strn_case_cmp(content_type, "application/x-www-form-urlencoded", 33) != 0))
+        {
+            LOG_INFO("Unsupported Content-Type: %s", content_type ? content_type : "none");
+            send_error_response(conn, 415, "Unsupported Media Type", request->connection_header, request->method);
+            return;
+        }
+
+        char log_path[1024];
+        if (snprintf(log_path, sizeof(log_path), "%s/post.log", dir_path) >= (int)sizeof(log_path))
+        {
+            LOG_ERROR("Directory path too long for post log: %s", dir_path);
+            send_error_response(conn, 500, "Internal Server Error", request->connection_header, request->method);
+            return;
+        }
+
+        // Open in text mode, append
+        FILE *log = fopen(log_path, "a");
+        if (!log)
+        {
+            LOG_ERROR("Failed to open %s for writing: %s", log_path, strerror(errno));
+            send_error_response(conn, 500, "Internal Server Error", request->connection_header, request->method);
+            return;
+        }
+
+        fwrite(request->body, 1, request->body_length, log);
+        fwrite("\n", 1, 1, log);
+        fclose(log);
+    }
+
+    // Build response. The echoed body (or path) stays in the request buffer,
+    // which the queued chunk borrows.
+    static const char received[] = "Received: ";
+    static const char received_empty[] = "Received empty POST request to ";
+    const char *prefix = request->body_length > 0 ? received : received_empty;
+    size_t prefix_len = request->body_length > 0 ? sizeof(received) - 1 : sizeof(received_empty) - 1;
+    const char *echo = request->body_length > 0 ? request->body : request->path;
+    size_t echo_len = request->body_length > 0 ? request->body_length : strlen(request->path);
+
+    response_builder_t response;
+    response_begin(&response, 200, "OK");
+    response_add_literal(&response, "Content-Type: text/plain\r\n");
+
+    // Large echoes are compressed as they are written out
+    int vary;
+    http_encoding_t encoding = stream_encoding(request, "text/plain", prefix_len + echo_len, &vary);
+    if (vary)
+        response_add_literal(&response, HTTP_VARY_ACCEPT_ENCODING);
+    if (encoding != HTTP_ENCODING_IDENTITY)
+    {
+        FILE *out = open_body_stream(conn, &response, encoding, connection_header);
+        if (out)
+        {
+            fwrite(prefix, 1, prefix_len, out);
+            fwrite(echo, 1, echo_len, out);
+            fclose(out);
+        }
+        LOG_DEBUG("Handled POST request to %s with %zu bytes, %s", request->path, request->body_length,
+                  http_encoding_names[encoding]);
+        return;
+    }
+
+    connection_set_response(conn, 200, prefix_len + echo_len);
+    response_add_content_length(&response, prefix_len + echo_len);
+    response_add_connection(&response, connection_header);
+    response_end_head(&response);
+    response_add(&response, prefix, prefix_len);
+    if (response_send(&response, conn) == 0)
+        connection_send_buffer_ref(conn, echo, echo_len);
+
+    LOG_DEBUG("Handled POST request to %s with %zu bytes", request->path, request->body_length);
+}
+
+// Prometheus scrape of the server's own metrics. HTTP/1.1 clients get it
+// chunked, written out as it renders; HEAD and HTTP/1.0 need the length up
+// front, so for them it is rendered into one buffer first.
+static void send_metrics_response(connection_t *conn, const http_request *request)
+{
+    const char *method = request->method;
+    const char *connection_header = request->connection_header;
+    int head_only = strcmp(method, "HEAD") == 0;
+
+    response_builder_t response;
+    response_begin(&response, 200, "OK");
+    response_add_literal(&response, "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                                    "Cache-Control: no-store\r\n");
+
+    // Scrapers usually accept gzip: compress while rendering
+    int vary;
+    http_encoding_t encoding = stream_encoding(request, "text/plain", SIZE_MAX, &vary);
+    if (vary)
+        response_add_literal(&response, HTTP_VARY_ACCEPT_ENCODING);
+
+    if (!head_only && strcmp(request->version, "HTTP/1.1") == 0)
+    {
+        FILE *out = open_body_stream(conn, &response, encoding, connection_header);
+        if (!out)
+            return;
+        metrics_write(out);
+        fclose(out);
+        return;
+    }
+
+    size_t len;
+    char *text = metrics_render(&len);
+    if (!text)
+    {
+        LOG_ERROR("Failed to render metrics");
+        send_error_response(conn, 500, "Internal Server Error", connection_header, method);
+        return;
+    }
+
+    connection_set_response(conn, 200, head_only ? 0 : len);
+    response_add_content_length(&response, len);
+    response_add_connection(&response, connection_header);
+    if (response_finish(&response, conn, NULL, 0) < 0 || head_only)
+        free(text);
+    else
+        connection_send_ref(conn, text, len, free, text);
+}
+
+int dispatch_request(connection_t *conn, http_request *request)
+{
+    // Step 7: Validate path safety
+    uint64_t step_start = metrics_now();
+    int safe = is_safe_path(request->path);
+    uint64_t handler_start = metrics_now();
+    metrics_record(METRICS_PHASE_PATH_CHECK, handler_start - step_start);
+    if (!safe)
+    {
+        send_error_response(conn, 400, "Bad Request", request->connection_header, request->method);
+        return 0;
+    }
+
+    // Step 8: Handle different methods
+    int is_get = strcmp(request->method, "GET") == 0 || strcmp(request->method, "HEAD") == 0;
+    if (is_get && server_config.metrics_path && strcmp(request->path, server_config.metrics_path) == 0)
+    {
+        send_metrics_response(conn, request);
+    }
+    else if (is_get)
+    {
+        char file_path[1024];
+        if (map_path_to_file(request->path, file_path, sizeof(file_path)) != 0)
+        {
+            send_error_response(conn, 414, "URI Too Long", "close", request->method);
+            return 0;
+        }
+        send_file_response(conn, file_path, request);
+    }
+    else if (strcmp(request->method, "POST") == 0)
+    {
+        handle_post_request(conn, request, request->connection_header);
+    }
+    else
+    {
+        send_error_response(conn, 405, "Method Not Allowed", request->connection_header, request->method);
+    }
+    metrics_record_since(METRICS_PHASE_HANDLER, handler_start);
+
+    LOG_DEBUG("connection header: %s", request->connection_header);
+    return strn_case_cmp(request->connection_header, "keep-alive", 10) == 0;
+}
@@ -0,0 +1,41 @@
+#ifndef HTTP_HANDLERS_H
+#define HTTP_HANDLERS_H
+
+#include <stddef.h>
+
+#include "connection.h"
+#include "http_request.h"
+
+const char *get_mime_type(const char *filepath);
+
+// 1 if `type` (as returned by get_mime_type()) is worth compressing on the fly
+int mime_type_compressible(const char *type);
+
+// Map URL path to file path
+int map_path_to_file(const char *url_path, char *file_path, size_t max_len);
+
+// Queue a file response (GET sends the body, HEAD only headers) with ETag and
+// Last-Modified, in the content coding Accept-Encoding prefers: from a
+// precompressed sibling, else compressed once into the file cache.
+// Conditional requests get 304 or 412; GET honours Range/If-Range with 206,
+// multipart/byteranges or 416.
+void send_file_response(connection_t *conn, const char *filepath, const http_request *request);
+
+// Check a request body before it is read: enforce the route's size limit and
+// choose between buffering it and streaming it to disk (connection_stream_body()).
+// Returns 1 to read the body, 0 if an error response was queued.
+int prepare_request_body(connection_t *conn, http_request *request);
+
+// Called once a streamed body is complete (`status` 1) or abandoned (a
+// negative http_io_status_t, the error response being the caller's). Releases
+// `upload` and queues the response on success.
+// Returns 1 if the connection may be kept alive, 0 if it must be closed.
+int finish_streamed_body(connection_t *conn, http_request *request, void *upload, int status);
+
+void handle_post_request(connection_t *conn, const http_request *request, const char *connection_header);
+
+// Route a fully received request to its method handler.
+// Returns 1 if the connection may be kept alive, 0 if it must be closed.
+int dispatch_request(connection_t *conn, http_request *request);
+
+#endif
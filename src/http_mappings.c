@@ -3,78 +3,26 @@
 #include <ctype.h>
 #include "http_mappings.h"
 #include "string_utils.h"
+#include "perfect_hash.h"
+#include "http_perfect_hash.h"
 #include <stdio.h>
 
-// Define allowed methods and header mappings
-const char *const allowed_methods[] = {"GET", "POST", "HEAD"};
+// Define allowed methods and header mappings (see the .def files)
+const char *const allowed_methods[] = {
+#define HTTP_METHOD(name) #name,
+#include "http_methods.def"
+#undef HTTP_METHOD
+};
 const size_t allowed_methods_count =
     sizeof(allowed_methods) / sizeof(allowed_methods[0]);
 
-static const header_mapping_t header_mappings[] = {
-    // --- General headers ---
-    {"host", 1, 0},
-    {"connection", 1, 1},
-    {"cache-control", 1, 1},
-    {"pragma", 1, 1},
-    {"upgrade", 1, 1},
-    {"via", 1, 1},
-    {"warning", 0, 1},
-
-    // --- Request headers ---
-    {"user-agent", 0, 0},
-    {"accept", 1, 1},
-    {"accept-encoding", 1, 1},
-    {"accept-language", 1, 1},
-    {"accept-charset", 1, 1},
-    {"referer", 0, 0},
-    {"origin", 0, 0},
-    {"content-type", 1, 1},
-    {"content-length", 0, 0},
-    {"transfer-encoding", 1, 1},
-    {"te", 1, 1},
-    {"expect", 1, 1},
-    {"authorization", 0, 0},
-    {"cookie", 0, 0},
-    {"upgrade-insecure-requests", 0, 0},
-    {"if-modified-since", 0, 0},
-    {"if-none-match", 0, 1},
-    {"if-unmodified-since", 0, 0},
-    {"if-match", 0, 1},
-    {"if-range", 0, 0},
-
-    // --- Response headers ---
-    {"server", 0, 0},
-    {"date", 0, 0},
-    {"last-modified", 0, 0},
-    {"etag", 0, 0},
-    {"content-encoding", 1, 1},
-    {"content-language", 1, 1},
-    {"content-location", 0, 0},
-    {"content-disposition", 0, 1},
-    {"content-range", 1, 1},
-    {"allow", 0, 1},
-    {"vary", 1, 1},
-    {"set-cookie", 0, 0},
-    {"www-authenticate", 0, 1},
-    {"proxy-authenticate", 0, 1},
-    {"location", 0, 0},
-    {"retry-after", 0, 0},
-    {"expires", 0, 0},
-    {"content-security-policy", 0, 0},
-
-    // --- CORS headers ---
-    {"access-control-allow-origin", 0, 0},
-    {"access-control-allow-headers", 1, 1},
-    {"access-control-allow-methods", 0, 1},
-    {"access-control-expose-headers", 1, 1},
-    {"access-control-request-headers", 1, 1},
-    {"access-control-request-method", 0, 0},
-    {"access-control-max-age", 0, 0},
+static const header_mapping_t header_mappings[HTTP_HEADER_KNOWN_COUNT] = {
+#define HTTP_HEADER(id, name, value_case_insensitive, trim_ows) \
+    {name, sizeof(name) - 1, HTTP_HEADER_##id, value_case_insensitive, trim_ows},
+#include "http_headers.def"
+#undef HTTP_HEADER
 };
 
-static const size_t header_mappings_count =
-    sizeof(header_mappings) / sizeof(header_mappings[0]);
-
 // Trim leading and trailing whitespace from a string (in place)
 static void trim_outer_whitespaces(char *str)
 {
@@ -171,101 +119,56 @@ void normalize_string_lower(char *str)
         *str = (char)tolower((unsigned char)*str);
 }
 
-// Normalizes only the header name (before ':') to lowercase
-void normalize_header_name(char *header_line)
-{
-    if (!header_line || !*header_line)
-        return;
-
-    char *colon = strchr(header_line, ':');
-    if (!colon)
-        return; // Invalid header (no ':')
-
-    // Store where the value starts
-    char *value = colon + 1;
-
-    // Temporarily split into two parts: name and value
-    *colon = '\0';
-    trim_outer_whitespaces(header_line); // Trim name
-
-    size_t name_len = strlen(header_line);
-    header_line[name_len] = ':'; // Restore colon
-
-    // Put value string after the trimmed name
-    size_t val_len = strlen(value);
-    memmove(header_line + name_len + 1, value, val_len + 1); // +1 to copy the '\0'
-
-    for (char *p = header_line; *p && *p != ':'; p++)
-        *p = (char)tolower((unsigned char)*p);
-}
-
-// Normalizes the header value to lowercase if the header is case-insensitive
-void normalize_header_value(char *header_line)
+// Trims the header value and applies the case and OWS rules of its header
+void normalize_header_value(const header_mapping_t *mapping, char *value)
 {
-    char *colon = strchr(header_line, ':');
-    if (!colon)
-        return; // Invalid header (no ':')
-
-    // Extract header name
-    size_t name_len = colon - header_line;
-    if (name_len == 0)
-        return;
-
-    char header_name[128];
-    if (name_len >= sizeof(header_name))
-        return;
-
-    strncpy(header_name, header_line, name_len);
-    header_name[name_len] = '\0';
-
-    // Locate value and trim
-    char *value = colon + 1;
     trim_outer_whitespaces(value);
+    if (!mapping)
+        return;
 
     // If this header's value is case-insensitive, normalize to lowercase
-    if (is_header_value_case_insensitive(header_name))
+    if (mapping->value_case_insensitive)
     {
         normalize_string_lower(value);
     }
 
-    if (should_trim_ows(header_name))
+    if (mapping->trim_ows)
     {
         trim_internal_whitespaces(value);
     }
 }
 
-void normalize_header(char *header_line)
+http_method_id_t lookup_method_id(const char *method, size_t len)
 {
-    normalize_header_name(header_line);
-    normalize_header_value(header_line);
+    uint64_t hash = perfect_hash_key(method, len);
+    uint32_t displacement = http_method_hash_displacement[(uint32_t)hash % HTTP_METHOD_HASH_BUCKETS];
+    http_method_id_t id = http_method_hash_slots[perfect_hash_slot(hash, displacement) % HTTP_METHOD_HASH_SIZE];
+
+    const char *candidate = allowed_methods[id];
+    if (strncmp(candidate, method, len) == 0 && candidate[len] == '\0')
+        return id;
+    return HTTP_METHOD_UNKNOWN;
 }
 
 int is_method_allowed(const char *method)
 {
-    for (size_t i = 0; i < allowed_methods_count; i++)
-    {
-        if (strcmp(method, allowed_methods[i]) == 0)
-            return 1;
-    }
-    return 0;
+    return lookup_method_id(method, strlen(method)) != HTTP_METHOD_UNKNOWN;
 }
 
-int is_header_value_case_insensitive(const char *header_name)
+const header_mapping_t *lookup_header(const char *name, size_t len)
 {
-    for (size_t i = 0; i < header_mappings_count; i++)
-    {
-        if (str_case_cmp(header_name, header_mappings[i].name) == 0)
-            return header_mappings[i].value_case_insensitive;
-    }
-    return 0;
+    uint64_t hash = perfect_hash_key(name, len);
+    uint32_t displacement = http_header_hash_displacement[(uint32_t)hash % HTTP_HEADER_HASH_BUCKETS];
+    const header_mapping_t *mapping =
+        &header_mappings[http_header_hash_slots[perfect_hash_slot(hash, displacement) % HTTP_HEADER_HASH_SIZE]];
+
+    if (mapping->name_len == len && memcmp(mapping->name, name, len) == 0)
+        return mapping;
+    return NULL;
 }
 
-int should_trim_ows(const char *header_name)
+http_header_id_t lookup_header_id(const char *name, size_t len)
 {
-    for (size_t i = 0; i < header_mappings_count; i++)
-    {
-        if (str_case_cmp(header_name, header_mappings[i].name) == 0)
-            return header_mappings[i].trim_ows;
-    }
-    return 0;
+    const header_mapping_t *mapping = lookup_header(name, len);
+    return mapping ? mapping->id : HTTP_HEADER_UNKNOWN;
 }
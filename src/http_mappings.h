@@ -1,9 +1,32 @@
 #ifndef HTTP_MAPPINGS_H
 #define HTTP_MAPPINGS_H
 
+#include <stddef.h>
+
+// Every header in http_headers.def gets an ID; requests index these for O(1) lookups
+typedef enum
+{
+#define HTTP_HEADER(id, name, value_case_insensitive, trim_ows) HTTP_HEADER_##id,
+#include "http_headers.def"
+#undef HTTP_HEADER
+    HTTP_HEADER_KNOWN_COUNT,
+    HTTP_HEADER_UNKNOWN = HTTP_HEADER_KNOWN_COUNT,
+} http_header_id_t;
+
+typedef enum
+{
+#define HTTP_METHOD(name) HTTP_METHOD_##name,
+#include "http_methods.def"
+#undef HTTP_METHOD
+    HTTP_METHOD_COUNT,
+    HTTP_METHOD_UNKNOWN = HTTP_METHOD_COUNT,
+} http_method_id_t;
+
 typedef struct
 {
     const char *name;
+    size_t name_len;
+    http_header_id_t id;
     int value_case_insensitive; // 1 for case-insensitive value
     int trim_ows;               // 1 to trim OWS (optional whitespace) around delimiters (',', ';', '=')
 } header_mapping_t;
@@ -11,12 +34,18 @@ typedef struct
 extern const char *const allowed_methods[];
 extern const size_t allowed_methods_count;
 
+// Perfect-hash lookups over the tables generated from the .def files:
+// one hash, one slot, one comparison.
+http_method_id_t lookup_method_id(const char *method, size_t len);
 int is_method_allowed(const char *method);
-int is_header_value_case_insensitive(const char *header_name);
-int should_trim_ows(const char *header_name);
-void normalize_header_name(char *name);
-void normalize_header_value(char *header_line);
-void normalize_header(char *header_line);
+
+// Metadata for a lowercase header name, NULL if it is not in http_headers.def
+const header_mapping_t *lookup_header(const char *name, size_t len);
+http_header_id_t lookup_header_id(const char *name, size_t len);
+
+// In-place normalization of a NUL-terminated header value: trim, then the
+// case/OWS rules of `mapping` (which may be NULL)
+void normalize_header_value(const header_mapping_t *mapping, char *value);
 void normalize_string_lower(char *str);
 
 #endif
@@ -0,0 +1,268 @@
+#include <stdio.h>
+
+#include "http_parser.h"
+#include "http_errors.h"
+#include "http_request.h"
+#include "http_scan.h"
+#include "log.h"
+
+#define MAX_HEAD_SIZE (MAX_REQUEST_SIZE / 2) // request line + headers
+
+// Byte classes
+#define C_TOKEN 0x01  // tchar (methods, header names)
+#define C_TARGET 0x02 // VCHAR, allowed in the request target
+#define C_VERSION 0x04
+#define C_WS 0x08 // SP / HTAB
+
+static const uint8_t char_class[256] = {
+    ['\t'] = C_WS,
+    [' '] = C_WS,
+    ['!'] = C_TOKEN | C_TARGET,
+    ['"'] = C_TARGET,
+    ['#' ... '\''] = C_TOKEN | C_TARGET,
+    ['(' ... ')'] = C_TARGET,
+    ['*' ... '+'] = C_TOKEN | C_TARGET,
+    [','] = C_TARGET,
+    ['-' ... '.'] = C_TOKEN | C_TARGET | C_VERSION,
+    ['/'] = C_TARGET | C_VERSION,
+    ['0' ... '9'] = C_TOKEN | C_TARGET | C_VERSION,
+    [':' ... '@'] = C_TARGET,
+    ['A' ... 'Z'] = C_TOKEN | C_TARGET | C_VERSION,
+    ['['] = C_TARGET,
+    ['\\'] = C_TARGET,
+    [']'] = C_TARGET,
+    ['^' ... '`'] = C_TOKEN | C_TARGET,
+    ['a' ... 'z'] = C_TOKEN | C_TARGET,
+    ['{'] = C_TARGET,
+    ['|'] = C_TOKEN | C_TARGET,
+    ['}'] = C_TARGET,
+    ['~'] = C_TOKEN | C_TARGET,
+};
+
+void http_parser_init(http_parser_t *parser)
+{
+    parser->state = HP_REQUEST_START;
+    parser->offset = 0;
+    parser->token_start = 0;
+    parser->query_offset = 0;
+    parser->name_end = 0;
+    parser->value_start = 0;
+    parser->value_end = 0;
+    parser->header_count = 0;
+    parser->error = 0;
+}
+
+static int fail(http_parser_t *parser, size_t offset, int error)
+{
+    parser->state = HP_ERROR;
+    parser->offset = offset;
+    parser->error = error;
+    return error;
+}
+
+int http_parser_execute(http_parser_t *parser, const http_parser_callbacks_t *callbacks, void *ctx,
+                        const char *buffer, size_t len)
+{
+    if (parser->state == HP_DONE)
+        return 1;
+    if (parser->state == HP_ERROR)
+        return parser->error;
+
+    http_parser_state_t state = parser->state;
+    size_t i = parser->offset;
+    int rc;
+
+// Hand a completed piece to its callback, stopping on error
+#define EMIT(call)                      \
+    do                                  \
+    {                                   \
+        rc = (call);                    \
+        if (rc < 0)                     \
+            return fail(parser, i, rc); \
+    } while (0)
+
+    while (i < len)
+    {
+        unsigned char c = (unsigned char)buffer[i];
+        uint8_t class = char_class[c];
+
+        switch (state)
+        {
+        case HP_REQUEST_START:
+            // Ignore empty lines before the request line (RFC 9112 section 2.2)
+            if (c == '\r' || c == '\n')
+                break;
+            if (!(class & C_TOKEN))
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            parser->token_start = i;
+            state = HP_METHOD;
+            break;
+
+        case HP_METHOD:
+            if (class & C_TOKEN)
+            {
+                if (i - parser->token_start >= MAX_METHOD - 1)
+                    return fail(parser, i, HTTP_PARSE_ERROR);
+                break;
+            }
+            if (c != ' ')
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            EMIT(callbacks->on_method(ctx, parser->token_start, i - parser->token_start));
+            state = HP_BEFORE_TARGET;
+            break;
+
+        case HP_BEFORE_TARGET:
+            if (c == ' ')
+                break;
+            if (!(class & C_TARGET))
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            parser->token_start = i;
+            parser->query_offset = 0;
+            state = HP_TARGET;
+            continue; // reprocess as the first target byte
+
+        case HP_TARGET:
+            if (class & C_TARGET)
+            {
+                if (c == '?' && !parser->query_offset)
+                    parser->query_offset = i;
+                else if (parser->query_offset ? i - parser->query_offset > MAX_QUERY - 1
+                                              : i - parser->token_start >= MAX_PATH - 1)
+                    return fail(parser, i, HTTP_URI_TOO_LONG);
+                break;
+            }
+            if (c != ' ')
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            EMIT(callbacks->on_target(ctx, parser->token_start, i - parser->token_start, parser->query_offset));
+            state = HP_BEFORE_VERSION;
+            break;
+
+        case HP_BEFORE_VERSION:
+            if (c == ' ')
+                break;
+            if (!(class & C_VERSION))
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            parser->token_start = i;
+            state = HP_VERSION;
+            break;
+
+        case HP_VERSION:
+            if (class & C_VERSION)
+            {
+                if (i - parser->token_start >= MAX_VERSION - 1)
+                    return fail(parser, i, HTTP_PARSE_ERROR);
+                break;
+            }
+            if (c != '\r')
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            EMIT(callbacks->on_version(ctx, parser->token_start, i - parser->token_start));
+            state = HP_REQUEST_LINE_LF;
+            break;
+
+        case HP_REQUEST_LINE_LF:
+            if (c != '\n')
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            state = HP_HEADER_START;
+            break;
+
+        case HP_HEADER_START:
+            if (c == '\r')
+            {
+                state = HP_HEADERS_END_LF;
+                break;
+            }
+            // Leading whitespace would be obsolete line folding: rejected
+            if (!(class & C_TOKEN))
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            if (parser->header_count == MAX_HEADERS)
+            {
+                LOG_INFO("Too many headers");
+                return fail(parser, i, HTTP_HEADERS_TOO_LARGE);
+            }
+            parser->token_start = i;
+            state = HP_HEADER_NAME;
+            break;
+
+        case HP_HEADER_NAME:
+            if (class & C_TOKEN)
+                break;
+            if (c != ':') // includes whitespace before the colon
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            parser->name_end = i;
+            state = HP_BEFORE_VALUE;
+            break;
+
+        case HP_BEFORE_VALUE:
+            if (class & C_WS)
+                break;
+            parser->value_start = i;
+            parser->value_end = i;
+            state = HP_HEADER_VALUE;
+            continue;
+
+        case HP_HEADER_VALUE:
+        {
+            // Field content is the bulk of the head: skip it with the SIMD line scanner
+            const char *stop = http_scan_line(buffer + i, buffer + len);
+            size_t stop_offset = (size_t)(stop - buffer);
+
+            for (size_t j = stop_offset; j > i; j--)
+            {
+                if (!(char_class[(unsigned char)buffer[j - 1]] & C_WS))
+                {
+                    parser->value_end = j;
+                    break;
+                }
+            }
+            if (stop_offset - parser->token_start >= MAX_HEADER_LINE)
+            {
+                LOG_INFO("Header line too long");
+                return fail(parser, stop_offset, HTTP_HEADERS_TOO_LARGE);
+            }
+
+            i = stop_offset;
+            if (i == len)
+                continue; // wait for the rest of the line
+            if (buffer[i] != '\r')
+                return fail(parser, i, HTTP_PARSE_ERROR); // control character in the value
+            state = HP_HEADER_LF;
+            break;
+        }
+
+        case HP_HEADER_LF:
+            if (c != '\n')
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            EMIT(callbacks->on_header(ctx, parser->token_start, parser->name_end - parser->token_start,
+                                      parser->value_start, parser->value_end - parser->value_start));
+            parser->header_count++;
+            state = HP_HEADER_START;
+            break;
+
+        case HP_HEADERS_END_LF:
+            if (c != '\n')
+                return fail(parser, i, HTTP_PARSE_ERROR);
+            i++;
+            parser->state = HP_DONE;
+            parser->offset = i;
+            EMIT(callbacks->on_headers_complete(ctx));
+            return 1;
+
+        case HP_DONE:
+        case HP_ERROR:
+            break;
+        }
+
+        i++;
+        if (i > MAX_HEAD_SIZE)
+        {
+            LOG_INFO("Headers too large (%zu bytes)", i);
+            return fail(parser, i, HTTP_HEADERS_TOO_LARGE);
+        }
+    }
+
+#undef EMIT
+
+    parser->state = state;
+    parser->offset = i;
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Resumable HTTP/1.1 request head parser.
+// Consumes the receive buffer byte by byte as it arrives: feed it whatever has
+// been read so far and it picks up where the previous call stopped, so no byte
+// is looked at twice. Syntax and the MAX_* limits are enforced as soon as the
+// offending byte arrives. Recognized pieces are reported through callbacks as
+// offsets into the buffer; the parser itself never modifies the buffer.
+
+typedef enum
+{
+    HP_REQUEST_START, // skipping empty lines before the request line
+    HP_METHOD,
+    HP_BEFORE_TARGET,
+    HP_TARGET,
+    HP_BEFORE_VERSION,
+    HP_VERSION,
+    HP_REQUEST_LINE_LF,
+    HP_HEADER_START, // start of a header line or the final CRLF
+    HP_HEADER_NAME,
+    HP_BEFORE_VALUE,
+    HP_HEADER_VALUE,
+    HP_HEADER_LF,
+    HP_HEADERS_END_LF,
+    HP_DONE,
+    HP_ERROR,
+} http_parser_state_t;
+
+// Event callbacks. Each returns 1 to continue or a negative http_io_status_t
+// to stop parsing with that error. Offsets are relative to the buffer start.
+typedef struct
+{
+    int (*on_method)(void *ctx, size_t offset, size_t len);
+    // query_offset is the offset of the '?' in the target, 0 if there is none
+    int (*on_target)(void *ctx, size_t offset, size_t len, size_t query_offset);
+    int (*on_version)(void *ctx, size_t offset, size_t len);
+    // value excludes surrounding whitespace
+    int (*on_header)(void *ctx, size_t name_offset, size_t name_len, size_t value_offset, size_t value_len);
+    int (*on_headers_complete)(void *ctx);
+} http_parser_callbacks_t;
+
+typedef struct
+{
+    http_parser_state_t state;
+    size_t offset;       // next byte to consume; the head length once HP_DONE
+    size_t token_start;  // method/target/version or header line being parsed
+    size_t query_offset; // '?' within the target, 0 if none yet
+    size_t name_end;     // ':' of the current header line
+    size_t value_start;
+    size_t value_end; // past the last non-whitespace value byte
+    int header_count;
+    int error; // negative http_io_status_t once HP_ERROR
+} http_parser_t;
+
+void http_parser_init(http_parser_t *parser);
+
+// Parse buffer[parser->offset, len). Returns 1 once the request head is
+// complete (parser->offset is then its length), 0 if more data is needed,
+// or a negative http_io_status_t.
+int http_parser_execute(http_parser_t *parser, const http_parser_callbacks_t *callbacks, void *ctx,
+                        const char *buffer, size_t len);
+
+#endif
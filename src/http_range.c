@@ -0,0 +1,101 @@
+#include "http_range.h"
+#include "string_utils.h"
+
+// Parse 1*DIGIT at `*p`, saturating at UINT64_MAX. Returns 0 if there is no digit.
+static int parse_position(const char **p, uint64_t *value)
+{
+    const char *s = *p;
+    if (*s < '0' || *s > '9')
+        return 0;
+
+    uint64_t n = 0;
+    for (; *s >= '0' && *s <= '9'; s++)
+    {
+        unsigned digit = (unsigned)(*s - '0');
+        n = n > (UINT64_MAX - digit) / 10 ? UINT64_MAX : n * 10 + digit;
+    }
+    *p = s;
+    *value = n;
+    return 1;
+}
+
+static const char *skip_ows(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+int http_range_parse(const char *value, uint64_t size, http_range_t *ranges)
+{
+    // ranges-specifier = range-unit "=" range-set
+    if (strn_case_cmp(value, "bytes=", 6) != 0)
+        return -1;
+
+    const char *p = value + 6;
+    int specs = 0;
+    int count = 0;
+
+    // range-set = 1#range-spec; empty list elements are allowed and skipped
+    for (;;)
+    {
+        p = skip_ows(p);
+        if (*p == ',')
+        {
+            p++;
+            continue;
+        }
+        if (*p == '\0')
+            break;
+
+        uint64_t first;
+        uint64_t last;
+        if (*p == '-')
+        {
+            // suffix-range = "-" suffix-length: the final bytes
+            p++;
+            uint64_t suffix;
+            if (!parse_position(&p, &suffix))
+                return -1;
+            if (suffix == 0 || size == 0)
+            {
+                first = last = UINT64_MAX; // unsatisfiable
+            }
+            else
+            {
+                first = suffix >= size ? 0 : size - suffix;
+                last = size - 1;
+            }
+        }
+        else
+        {
+            // int-range = first-pos "-" [ last-pos ]
+            if (!parse_position(&p, &first) || *p++ != '-')
+                return -1;
+            last = UINT64_MAX;
+            if (*p >= '0' && *p <= '9')
+            {
+                parse_position(&p, &last);
+                if (last < first)
+                    return -1;
+            }
+            if (size > 0 && last > size - 1)
+                last = size - 1;
+        }
+
+        p = skip_ows(p);
+        if (*p != ',' && *p != '\0')
+            return -1;
+        if (++specs > HTTP_RANGE_MAX)
+            return -1;
+
+        if (first < size)
+        {
+            ranges[count].first = first;
+            ranges[count].last = last;
+            count++;
+        }
+    }
+
+    return specs > 0 ? count : -1;
+}
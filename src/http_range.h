@@ -0,0 +1,24 @@
+#ifndef HTTP_RANGE_H
+#define HTTP_RANGE_H
+
+#include <stdint.h>
+
+// Range requests (RFC 9110 section 14)
+
+#define HTTP_RANGE_MAX 16 // range specs honoured per request; more and the header is ignored
+
+// Inclusive byte range, already clamped to the representation
+typedef struct
+{
+    uint64_t first;
+    uint64_t last;
+} http_range_t;
+
+// Parse a Range header value for a representation of `size` bytes. Stores
+// the satisfiable ranges, in request order, in `ranges` (HTTP_RANGE_MAX
+// entries). Returns their count, 0 if none is satisfiable (416), or -1 if
+// the header is to be ignored and the whole representation sent: a unit
+// other than bytes, invalid syntax, or more than HTTP_RANGE_MAX specs.
+int http_range_parse(const char *value, uint64_t size, http_range_t *ranges);
+
+#endif
@@ -0,0 +1,310 @@
+#define _GNU_SOURCE // strptime(), timegm()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "http_request.h"
+#include "http_errors.h"
+#include "http_mappings.h"
+#include "string_utils.h"
+#include "log.h"
+
+void http_request_init(http_request *req, char *buffer)
+{
+    req->buffer = buffer;
+    req->method = "";
+    req->path = "";
+    req->query = "";
+    req->version = "";
+    req->header_count = 0;
+    memset(req->known, 0, sizeof(req->known));
+    req->body = NULL;
+    req->body_length = 0;
+    req->content_length = 0;
+    req->chunked = 0;
+    req->connection_header = "";
+}
+
+// Move `p` along with the buffer if it pointed into it (fields may also hold
+// string literals such as the "" defaults)
+static const char *rebase_pointer(const char *p, const char *old_buffer, size_t old_size, char *buffer)
+{
+    uintptr_t addr = (uintptr_t)p;
+    uintptr_t start = (uintptr_t)old_buffer;
+    if (addr < start || addr > start + old_size)
+        return p;
+    return buffer + (addr - start);
+}
+
+void http_request_rebase(http_request *req, char *buffer, size_t old_size)
+{
+    const char *old_buffer = req->buffer;
+    req->method = rebase_pointer(req->method, old_buffer, old_size, buffer);
+    req->path = rebase_pointer(req->path, old_buffer, old_size, buffer);
+    req->query = rebase_pointer(req->query, old_buffer, old_size, buffer);
+    req->version = rebase_pointer(req->version, old_buffer, old_size, buffer);
+    req->connection_header = rebase_pointer(req->connection_header, old_buffer, old_size, buffer);
+    if (req->body)
+        req->body = (char *)rebase_pointer(req->body, old_buffer, old_size, buffer);
+    // Headers are offsets and need no adjustment
+    req->buffer = buffer;
+}
+
+// Content-Length is 1*DIGIT (RFC 9110 section 8.6): no sign, no whitespace,
+// nothing strtoul() would otherwise skip. Returns 0, or -1 if invalid or too large.
+static int parse_content_length(const char *value, size_t *out)
+{
+    size_t length = 0;
+    if (*value == '\0')
+        return -1;
+    for (const char *p = value; *p; p++)
+    {
+        if (*p < '0' || *p > '9')
+            return -1;
+        size_t digit = (size_t)(*p - '0');
+        if (length > (SIZE_MAX - digit) / 10)
+            return -1;
+        length = length * 10 + digit;
+    }
+    *out = length;
+    return 0;
+}
+
+// Extract Content-Length from headers (checked by validate_http_request())
+size_t get_content_length(const http_request *req)
+{
+    const char *value = http_request_header(req, HTTP_HEADER_CONTENT_LENGTH);
+    size_t length;
+    if (!value || parse_content_length(value, &length) < 0)
+        return 0;
+    return length;
+}
+
+int http_parse_date(const char *value, time_t *out)
+{
+    // IMF-fixdate, then the obsolete RFC 850 and asctime() forms recipients
+    // must still accept (RFC 9110 section 5.6.7)
+    static const char *const formats[] = {
+        "%a, %d %b %Y %H:%M:%S GMT",
+        "%A, %d-%b-%y %H:%M:%S GMT",
+        "%a %b %e %H:%M:%S %Y",
+    };
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char *end = strptime(value, formats[i], &tm);
+        if (end && *end == '\0')
+        {
+            *out = timegm(&tm);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ----- Parser callbacks: turn parser events into the request, in place -----
+
+static int on_method(void *ctx, size_t offset, size_t len)
+{
+    http_request *req = ctx;
+    char *method = req->buffer + offset;
+    method[len] = '\0';
+
+    // Accept only known methods
+    if (!is_method_allowed(method))
+    {
+        LOG_INFO("Unsupported method: %s", method);
+        return HTTP_METHOD_NOT_ALLOWED;
+    }
+
+    req->method = method;
+    return 1;
+}
+
+static int on_target(void *ctx, size_t offset, size_t len, size_t query_offset)
+{
+    http_request *req = ctx;
+    req->buffer[offset + len] = '\0';
+
+    // Split path and query
+    if (query_offset)
+    {
+        req->buffer[query_offset] = '\0';
+        req->query = req->buffer + query_offset + 1;
+    }
+    req->path = req->buffer + offset;
+    return 1;
+}
+
+static int on_version(void *ctx, size_t offset, size_t len)
+{
+    http_request *req = ctx;
+    char *version = req->buffer + offset;
+    version[len] = '\0';
+
+    // Set default connection header based on http version
+    if (strcmp(version, "HTTP/1.0") == 0)
+    {
+        req->connection_header = "close";
+    }
+    else if (strcmp(version, "HTTP/1.1") == 0)
+    {
+        req->connection_header = "keep-alive";
+    }
+    else
+    {
+        return HTTP_VERSION_UNSUPPORTED;
+    }
+
+    req->version = version;
+    return 1;
+}
+
+static int on_header(void *ctx, size_t name_offset, size_t name_len, size_t value_offset, size_t value_len)
+{
+    http_request *req = ctx;
+
+    // NUL-terminate name (over the ':') and value, then normalize in place:
+    // one perfect-hash probe yields both the header ID and its value rules
+    char *name = req->buffer + name_offset;
+    char *value = req->buffer + value_offset;
+    name[name_len] = '\0';
+    value[value_len] = '\0';
+
+    normalize_string_lower(name);
+    const header_mapping_t *mapping = lookup_header(name, name_len);
+    if (mapping && (mapping->value_case_insensitive || mapping->trim_ows))
+    {
+        normalize_header_value(mapping, value);
+        value_len = strlen(value);
+    }
+
+    http_header_t *header = &req->headers[req->header_count];
+    header->name.offset = (uint32_t)name_offset;
+    header->name.length = (uint32_t)name_len;
+    header->value.offset = (uint32_t)value_offset;
+    header->value.length = (uint32_t)value_len;
+    header->id = mapping ? mapping->id : HTTP_HEADER_UNKNOWN;
+
+    req->header_count++;
+    if (header->id != HTTP_HEADER_UNKNOWN && req->known[header->id] == 0)
+        req->known[header->id] = (uint8_t)req->header_count;
+
+    // Check for Connection header
+    if (header->id == HTTP_HEADER_CONNECTION && value_len < 32)
+        req->connection_header = value;
+
+    return 1;
+}
+
+static int on_headers_complete(void *ctx)
+{
+    http_request *req = ctx;
+
+    LOG_DEBUG("Parsed %d headers", req->header_count);
+    for (int i = 0; i < req->header_count; i++)
+    {
+        LOG_DEBUG("Header[%d]: %s:%s", i, req->buffer + req->headers[i].name.offset,
+                  req->buffer + req->headers[i].value.offset);
+    }
+    return 1;
+}
+
+const http_parser_callbacks_t http_request_parser_callbacks = {
+    .on_method = on_method,
+    .on_target = on_target,
+    .on_version = on_version,
+    .on_header = on_header,
+    .on_headers_complete = on_headers_complete,
+};
+
+// Check for required headers
+int validate_http_request(http_request *req)
+{
+    // HTTP/1.1 requires Host header
+    if (strcmp(req->version, "HTTP/1.1") == 0 && !req->known[HTTP_HEADER_HOST])
+    {
+        LOG_INFO("HTTP/1.1 request missing Host header");
+        return HTTP_PARSE_ERROR;
+    }
+
+    // Transfer-Encoding (TE): chunked is the only coding understood, and it
+    // must be the only one applied (RFC 9112 section 6.1)
+    const char *transfer_encoding = http_request_header(req, HTTP_HEADER_TRANSFER_ENCODING);
+    if (transfer_encoding)
+    {
+        int te_count = 0;
+        for (int i = 0; i < req->header_count; i++)
+            te_count += req->headers[i].id == HTTP_HEADER_TRANSFER_ENCODING;
+        if (te_count > 1 || strcmp(transfer_encoding, "chunked") != 0)
+        {
+            LOG_INFO("Unsupported Transfer-Encoding: %s", transfer_encoding);
+            return HTTP_NOT_IMPLEMENTED; // 501
+        }
+
+        // TE alongside Content-Length (CL), or in an HTTP/1.0 request, is
+        // ambiguous framing and the classic request smuggling vector
+        if (req->known[HTTP_HEADER_CONTENT_LENGTH] || strcmp(req->version, "HTTP/1.0") == 0)
+        {
+            LOG_INFO("Transfer-Encoding with Content-Length or in HTTP/1.0");
+            return HTTP_PARSE_ERROR;
+        }
+        req->chunked = 1;
+    }
+
+    // Every Content-Length field must be a valid number, and repeated ones
+    // must agree: otherwise where the body ends is ambiguous (RFC 9112 section 6.3)
+    if (req->known[HTTP_HEADER_CONTENT_LENGTH])
+    {
+        size_t first = 0;
+        int seen = 0;
+        for (int i = 0; i < req->header_count; i++)
+        {
+            if (req->headers[i].id != HTTP_HEADER_CONTENT_LENGTH)
+                continue;
+            const char *value = req->buffer + req->headers[i].value.offset;
+            size_t length;
+            if (parse_content_length(value, &length) < 0 || (seen && length != first))
+            {
+                LOG_INFO("Invalid or conflicting Content-Length: %s", value);
+                return HTTP_PARSE_ERROR;
+            }
+            first = length;
+            seen = 1;
+        }
+    }
+
+    // Post requests must have CL or TE
+    if (strcmp(req->method, "POST") == 0)
+    {
+        if (!req->known[HTTP_HEADER_CONTENT_LENGTH] && !req->chunked)
+        {
+            return HTTP_LENGTH_REQUIRED; // 411
+        }
+    }
+
+    return 1;
+}
+
+// Path traversal protection
+int is_safe_path(const char *path)
+{
+    if (strstr(path, "..") != NULL)
+    {
+        LOG_INFO("Path traversal attempt: %s", path);
+        return 0;
+    }
+
+    if (path[0] != '/')
+    {
+        LOG_INFO("Path must start with /: %s", path);
+        return 0;
+    }
+
+    return 1;
+}
@@ -0,0 +1,84 @@
+#ifndef HTTP_REQUEST_H
+#define HTTP_REQUEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "http_mappings.h"
+#include "http_parser.h"
+
+#define MAX_REQUEST_SIZE 65536 // 64KB max request
+#define MAX_HEADERS 100
+#define MAX_PATH 2048        // 2KB max path length
+#define MAX_QUERY 1024       // 1KB max query length
+#define MAX_HEADER_LINE 8192 // 8KB max header line
+#define MAX_METHOD 16
+#define MAX_VERSION 16
+
+// Span of the receive buffer. The parser callbacks NUL-terminate every slice
+// in place, so buffer + offset is also a valid C string.
+typedef struct
+{
+    uint32_t offset;
+    uint32_t length;
+} http_slice_t;
+
+typedef struct
+{
+    http_slice_t name;  // lowercased
+    http_slice_t value; // normalized per header_mappings
+    http_header_id_t id;
+} http_header_t;
+
+// Parsed request. Nothing is copied out of the receive buffer: the request
+// line fields point into it and headers are slices of it, so the buffer must
+// outlive the request.
+typedef struct
+{
+    char *buffer; // receive buffer the slices refer to
+    const char *method;
+    const char *path;
+    const char *query; // "" when absent
+    const char *version;
+    http_header_t headers[MAX_HEADERS];
+    int header_count;
+    uint8_t known[HTTP_HEADER_KNOWN_COUNT]; // index + 1 into headers of the first occurrence, 0 if absent
+    char *body;
+    size_t body_length;
+    size_t content_length;
+    int chunked; // body framed by Transfer-Encoding: chunked
+    const char *connection_header; // "keep-alive"/"close" default or the Connection value
+} http_request;
+
+// Reset `req` to an empty request over `buffer`
+void http_request_init(http_request *req, char *buffer);
+
+// The receive buffer was moved to `buffer` (grown into a larger one). Repoint
+// the fields that referred into the old buffer of `old_size` bytes.
+void http_request_rebase(http_request *req, char *buffer, size_t old_size);
+
+// Value of a known header, or NULL if the request does not carry it
+static inline const char *http_request_header(const http_request *req, http_header_id_t id)
+{
+    unsigned index = req->known[id];
+    return index ? req->buffer + req->headers[index - 1].value.offset : NULL;
+}
+
+// Extract Content-Length from headers
+size_t get_content_length(const http_request *req);
+
+// Parse an HTTP-date header value. Returns 1 and sets `*out`, or 0 if invalid.
+int http_parse_date(const char *value, time_t *out);
+
+// Parser callbacks that build an http_request (the callback context) from
+// the receive buffer. Fields are NUL-terminated and normalized in place.
+extern const http_parser_callbacks_t http_request_parser_callbacks;
+
+// Check for required headers. Returns 1 on success or a negative http_io_status_t
+int validate_http_request(http_request *req);
+
+// Path traversal protection
+int is_safe_path(const char *path);
+
+#endif
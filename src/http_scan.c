@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "http_scan.h"
+
+#if defined(__x86_64__) // SSE2 is part of the x86-64 baseline
+#define HTTP_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// Bytes that end a line scan in the scalar kernel: '\r' or a byte not
+// allowed in a line
+static uint8_t scan_stop[256];
+
+// ----- Scalar -----
+
+static const char *scan_line_scalar(const char *p, const char *end)
+{
+    for (; p < end; p++)
+    {
+        if (scan_stop[(unsigned char)*p])
+            return p;
+    }
+    return p;
+}
+
+#ifdef HTTP_SCAN_X86
+
+// ----- SSE2 (baseline on x86-64) -----
+
+// Mask of bytes that end a line scan: '\r', controls other than HTAB, DEL
+static inline __m128i stop_mask_sse2(__m128i x)
+{
+    __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(0x1f)), x); // x <= 0x1f
+    ctl = _mm_andnot_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\t')), ctl);
+    return _mm_or_si128(ctl, _mm_cmpeq_epi8(x, _mm_set1_epi8(0x7f)));
+}
+
+static const char *scan_line_sse2(const char *p, const char *end)
+{
+    for (; end - p >= 16; p += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)p);
+        unsigned stop = (unsigned)_mm_movemask_epi8(stop_mask_sse2(x));
+        if (stop)
+            return p + __builtin_ctz(stop);
+    }
+    return scan_line_scalar(p, end);
+}
+
+// ----- AVX2 -----
+
+__attribute__((target("avx2"))) static const char *scan_line_avx2(const char *p, const char *end)
+{
+    const __m256i ctl_max = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+
+    for (; end - p >= 32; p += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)p);
+        __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(x, ctl_max), x);
+        ctl = _mm256_andnot_si256(_mm256_cmpeq_epi8(x, tab), ctl);
+        unsigned stop = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(ctl, _mm256_cmpeq_epi8(x, del)));
+        if (stop)
+            return p + __builtin_ctz(stop);
+    }
+    return scan_line_sse2(p, end);
+}
+
+#endif
+
+// ----- Dispatch -----
+
+static const char *(*scan_line_impl)(const char *, const char *) = scan_line_scalar;
+static const char *impl_name = "scalar";
+
+// Runs before main(), so worker threads only ever read the pointer
+__attribute__((constructor)) static void http_scan_init(void)
+{
+    for (int c = 0; c < 0x20; c++)
+        scan_stop[c] = 1;
+    scan_stop['\t'] = 0;
+    scan_stop[0x7f] = 1;
+
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        scan_line_impl = scan_line_avx2;
+        impl_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        scan_line_impl = scan_line_sse2;
+        impl_name = "sse2";
+    }
+#endif
+}
+
+const char *http_scan_line(const char *p, const char *end)
+{
+    return scan_line_impl(p, end);
+}
+
+const char *http_scan_impl_name(void)
+{
+    return impl_name;
+}
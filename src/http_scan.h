@@ -0,0 +1,18 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+// Byte-scanning kernel the request parser skips field values with (the bulk
+// of a request head). It has an SSE2 and an AVX2 variant plus a portable
+// scalar fallback; the fastest one the CPU supports is picked once at startup.
+
+// Scan one line starting at `p`: returns the first '\r' or the first byte that
+// may not appear in a request/field line (control characters other than HTAB,
+// and DEL), or `end` if neither occurs.
+const char *http_scan_line(const char *p, const char *end);
+
+// Name of the kernel in use ("avx2", "sse2" or "scalar")
+const char *http_scan_impl_name(void);
+
+#endif
@@ -0,0 +1,366 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#include "log.h"
+
+_Static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+
+enum
+{
+    SINK_SERVER,
+    SINK_ACCESS,
+    SINK_COUNT
+};
+
+// Byte ring of complete records. Positions only grow; masking yields the
+// index. The owning thread is the only writer of `head`, the flusher the
+// only writer of `tail`.
+typedef struct
+{
+    char *data;
+    _Atomic size_t head; // bytes published by the owning thread
+    _Atomic size_t tail; // bytes consumed by the flusher
+    _Atomic unsigned long dropped;
+} log_ring_t;
+
+typedef struct
+{
+    log_ring_t rings[SINK_COUNT];
+} log_thread_t;
+
+log_level_t log_level = LOG_LEVEL_INFO;
+
+// Rings of every thread that has logged. Threads live as long as the
+// process, so entries are never removed.
+static log_thread_t *_Atomic threads[LOG_MAX_THREADS];
+static atomic_int thread_count;
+static _Atomic unsigned long unregistered_drops; // threads that could not get a ring
+
+static _Thread_local log_thread_t *local_rings;
+static _Thread_local int local_rings_failed;
+
+static int sink_fds[SINK_COUNT] = {STDOUT_FILENO, -1};
+static pthread_t flusher_thread;
+static int flusher_started;
+static atomic_int flusher_stop;
+
+static const char *const level_names[] = {"debug", "info", "warn", "error", "off"};
+
+int log_parse_level(const char *name, log_level_t *level)
+{
+    for (int i = LOG_LEVEL_DEBUG; i <= LOG_LEVEL_OFF; i++)
+    {
+        if (strcmp(name, level_names[i]) == 0)
+        {
+            *level = (log_level_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// ----- Producer side -----
+
+static log_thread_t *thread_rings(void)
+{
+    if (local_rings || local_rings_failed)
+        return local_rings;
+
+    int index = atomic_fetch_add(&thread_count, 1);
+    log_thread_t *rings = index < LOG_MAX_THREADS ? calloc(1, sizeof(*rings)) : NULL;
+    for (int sink = 0; rings && sink < SINK_COUNT; sink++)
+    {
+        rings->rings[sink].data = malloc(LOG_RING_SIZE);
+        if (!rings->rings[sink].data)
+        {
+            for (int i = 0; i < sink; i++)
+                free(rings->rings[i].data);
+            free(rings);
+            rings = NULL;
+        }
+    }
+    if (!rings)
+    {
+        local_rings_failed = 1; // its slot, if any, stays NULL and is skipped
+        return NULL;
+    }
+
+    atomic_store_explicit(&threads[index], rings, memory_order_release);
+    local_rings = rings;
+    return rings;
+}
+
+static void ring_push(int sink, const char *record, size_t len)
+{
+    log_thread_t *rings = thread_rings();
+    if (!rings)
+    {
+        atomic_fetch_add_explicit(&unregistered_drops, 1, memory_order_relaxed);
+        return;
+    }
+
+    log_ring_t *ring = &rings->rings[sink];
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (LOG_RING_SIZE - (head - tail) < len)
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    size_t pos = head & (LOG_RING_SIZE - 1);
+    size_t first = len < LOG_RING_SIZE - pos ? len : LOG_RING_SIZE - pos;
+    memcpy(ring->data + pos, record, first);
+    memcpy(ring->data, record + first, len - first);
+    atomic_store_explicit(&ring->head, head + len, memory_order_release);
+}
+
+// Format `fmt` after `prefix` into `record`, truncating and adding the newline.
+// Returns the record length.
+static size_t format_record(char *record, const char *prefix, size_t prefix_len, const char *fmt, va_list args)
+{
+    memcpy(record, prefix, prefix_len);
+    int written = vsnprintf(record + prefix_len, LOG_MAX_RECORD - prefix_len - 1, fmt, args);
+    size_t len = prefix_len;
+    if (written > 0)
+        len += (size_t)written < LOG_MAX_RECORD - prefix_len - 1 ? (size_t)written : LOG_MAX_RECORD - prefix_len - 2;
+    record[len++] = '\n';
+    return len;
+}
+
+// Per-thread timestamp caches, re-rendered when the second changes
+static _Thread_local struct
+{
+    time_t second;
+    char server[32]; // "2026-10-15T23:37:36Z"
+    char access[32]; // "[15/Oct/2026:23:37:36 +0000]"
+} clock_cache;
+
+static void refresh_clock(void)
+{
+    time_t now = time(NULL);
+    if (now == clock_cache.second && clock_cache.server[0])
+        return;
+
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    strftime(clock_cache.server, sizeof(clock_cache.server), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    strftime(clock_cache.access, sizeof(clock_cache.access), "[%d/%b/%Y:%H:%M:%S +0000]", &tm);
+    clock_cache.second = now;
+}
+
+void log_write(log_level_t level, const char *fmt, ...)
+{
+    refresh_clock();
+    char prefix[64];
+    int prefix_len = snprintf(prefix, sizeof(prefix), "%s [%s] ", clock_cache.server, level_names[level]);
+
+    char record[LOG_MAX_RECORD];
+    va_list args;
+    va_start(args, fmt);
+    size_t len = format_record(record, prefix, (size_t)prefix_len, fmt, args);
+    va_end(args);
+    ring_push(SINK_SERVER, record, len);
+}
+
+int log_access_enabled(void)
+{
+    return sink_fds[SINK_ACCESS] >= 0;
+}
+
+void log_access(const char *fmt, ...)
+{
+    char record[LOG_MAX_RECORD];
+    va_list args;
+    va_start(args, fmt);
+    size_t len = format_record(record, "", 0, fmt, args);
+    va_end(args);
+    ring_push(SINK_ACCESS, record, len);
+}
+
+const char *log_access_time(void)
+{
+    refresh_clock();
+    return clock_cache.access;
+}
+
+unsigned long log_dropped_count(void)
+{
+    unsigned long dropped = atomic_load_explicit(&unregistered_drops, memory_order_relaxed);
+    int count = atomic_load_explicit(&thread_count, memory_order_acquire);
+    for (int i = 0; i < count && i < LOG_MAX_THREADS; i++)
+    {
+        log_thread_t *rings = atomic_load_explicit(&threads[i], memory_order_acquire);
+        for (int sink = 0; rings && sink < SINK_COUNT; sink++)
+            dropped += atomic_load_explicit(&rings->rings[sink].dropped, memory_order_relaxed);
+    }
+    return dropped;
+}
+
+// ----- Flusher -----
+
+// Write every iovec fully. Returns 0, or -1 if the destination failed.
+static int write_all(int fd, struct iovec *iov, int count)
+{
+    while (count > 0)
+    {
+        ssize_t written = writev(fd, iov, count > IOV_MAX ? IOV_MAX : count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return 0;
+}
+
+// Drain every thread's ring for `sink` with one batched writev(). Returns
+// the number of bytes taken off the rings.
+static size_t flush_sink(int sink)
+{
+    static struct iovec iov[2 * LOG_MAX_THREADS];
+    static size_t heads[LOG_MAX_THREADS];
+    int count = atomic_load_explicit(&thread_count, memory_order_acquire);
+    if (count > LOG_MAX_THREADS)
+        count = LOG_MAX_THREADS;
+
+    int iov_count = 0;
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        log_thread_t *rings = atomic_load_explicit(&threads[i], memory_order_acquire);
+        if (!rings)
+            continue;
+
+        log_ring_t *ring = &rings->rings[sink];
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        heads[i] = head;
+        if (head == tail)
+            continue;
+
+        // Up to two segments when the records wrap around the end
+        size_t pos = tail & (LOG_RING_SIZE - 1);
+        size_t len = head - tail;
+        size_t first = len < LOG_RING_SIZE - pos ? len : LOG_RING_SIZE - pos;
+        iov[iov_count++] = (struct iovec){ring->data + pos, first};
+        if (len > first)
+            iov[iov_count++] = (struct iovec){ring->data, len - first};
+        total += len;
+    }
+
+    if (total == 0)
+        return 0;
+
+    // A failing destination must not stall the rings: the batch is discarded
+    if (sink_fds[sink] >= 0)
+        write_all(sink_fds[sink], iov, iov_count);
+
+    for (int i = 0; i < count; i++)
+    {
+        log_thread_t *rings = atomic_load_explicit(&threads[i], memory_order_acquire);
+        if (rings)
+            atomic_store_explicit(&rings->rings[sink].tail, heads[i], memory_order_release);
+    }
+    return total;
+}
+
+static void *flusher_main(void *arg)
+{
+    (void)arg;
+    unsigned long reported = 0;
+
+    for (;;)
+    {
+        int stopping = atomic_load(&flusher_stop);
+        size_t flushed = 0;
+        for (int sink = 0; sink < SINK_COUNT; sink++)
+            flushed += flush_sink(sink);
+
+        unsigned long dropped = log_dropped_count();
+        if (dropped != reported)
+        {
+            // Written directly: the flusher has no ring of its own
+            refresh_clock();
+            char line[128];
+            int len = snprintf(line, sizeof(line), "%s [warn] log: %lu records dropped (ring full)\n",
+                               clock_cache.server, dropped - reported);
+            if (write(sink_fds[SINK_SERVER], line, (size_t)len) < 0)
+            {
+                // nothing left to report the failure to
+            }
+            reported = dropped;
+        }
+
+        if (stopping)
+            return NULL;
+        if (flushed == 0)
+        {
+            struct timespec pause = {0, LOG_FLUSH_INTERVAL_MS * 1000000L};
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+static void log_shutdown(void)
+{
+    if (!flusher_started)
+        return;
+    atomic_store(&flusher_stop, 1);
+    pthread_join(flusher_thread, NULL); // the flusher drains once more before exiting
+    flusher_started = 0;
+}
+
+int log_init(const char *access_log_path)
+{
+    if (access_log_path)
+    {
+        if (strcmp(access_log_path, "-") == 0)
+        {
+            sink_fds[SINK_ACCESS] = STDOUT_FILENO;
+        }
+        else
+        {
+            sink_fds[SINK_ACCESS] = open(access_log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (sink_fds[SINK_ACCESS] < 0)
+            {
+                fprintf(stderr, "Cannot open access log %s: %s\n", access_log_path, strerror(errno));
+                return -1;
+            }
+        }
+    }
+
+    int rc = pthread_create(&flusher_thread, NULL, flusher_main, NULL);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Failed to start log flusher: %s\n", strerror(rc));
+        return -1;
+    }
+    flusher_started = 1;
+    atexit(log_shutdown);
+    return 0;
+}
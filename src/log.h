@@ -0,0 +1,72 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stddef.h>
+
+// Asynchronous logger. Every thread appends formatted records to its own
+// lock-free ring (single producer, single consumer); a background flusher
+// thread drains all rings with one batched writev() per destination. A full
+// ring drops the record and counts it instead of blocking the worker.
+//
+// Two destinations: the server log (leveled messages, stdout) and the
+// optional access log (one line per request, combined log format).
+
+typedef enum
+{
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF,
+} log_level_t;
+
+// Levels below this are compiled out entirely (make LOG_LEVEL=DEBUG keeps them)
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SIZE (256 * 1024) // bytes per thread and destination (power of two)
+#define LOG_MAX_RECORD 1024        // longer records are truncated
+#define LOG_MAX_THREADS 256        // threads beyond this have their records dropped
+#define LOG_FLUSH_INTERVAL_MS 20   // flusher sleep when all rings are empty
+
+// Runtime threshold, set from the command line before the workers start
+extern log_level_t log_level;
+
+#define LOG_ENABLED(level) ((level) >= LOG_COMPILE_LEVEL && (level) >= log_level)
+
+#define LOG_AT(level, ...)                  \
+    do                                      \
+    {                                       \
+        if (LOG_ENABLED(level))             \
+            log_write((level), __VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+// Parse "debug", "info", "warn", "error" or "off". Returns 0 or -1.
+int log_parse_level(const char *name, log_level_t *level);
+
+// Open the access log (NULL disables it, "-" is stdout) and start the
+// flusher thread. Pending records are flushed at exit. Returns 0 or -1.
+int log_init(const char *access_log_path);
+
+// Append one server log record (a newline is added). Never blocks.
+void log_write(log_level_t level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// 1 if an access log was configured
+int log_access_enabled(void);
+
+// Append one access log line (a newline is added). Never blocks.
+void log_access(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// "[15/Oct/2026:23:37:36 +0000]" for the current second, cached per thread
+const char *log_access_time(void);
+
+// Records dropped so far because a ring was full
+unsigned long log_dropped_count(void);
+
+#endif
@@ -0,0 +1,382 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "metrics.h"
+#include "log.h"
+
+// One latency histogram. Counters are atomics only so that the exposition may
+// read them while the owning thread writes; the owner updates them with a
+// relaxed load and store, which compile to plain moves.
+typedef struct
+{
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+    _Atomic uint64_t sum_ns;
+} histogram_t;
+
+typedef struct
+{
+    histogram_t phases[METRICS_PHASE_COUNT];
+    _Atomic uint64_t status[METRICS_MAX_STATUS]; // index 0 collects codes out of range
+    _Atomic uint64_t bytes_in;
+    _Atomic uint64_t bytes_out;
+    _Atomic uint64_t keepalive_reuse;
+    _Atomic uint64_t timeouts[2]; // idle, partial request
+    _Atomic uint64_t connections_opened;
+    _Atomic uint64_t connections_closed;
+    _Atomic uint64_t tls_handshakes[METRICS_TLS_RESULTS];
+    _Atomic uint64_t tls_kernel_send;
+    _Atomic uint64_t tls_tickets[2];       // miss, hit
+    _Atomic uint64_t tls_session_cache[2]; // miss, hit
+    _Atomic uint64_t http2_connections;
+    _Atomic uint64_t http2_streams;
+    _Atomic uint64_t http2_resets;
+} metrics_thread_t;
+
+static const char *const phase_names[METRICS_PHASE_COUNT] = {
+    [METRICS_PHASE_READ_HEADERS] = "read_headers",
+    [METRICS_PHASE_PARSE] = "parse",
+    [METRICS_PHASE_VALIDATE] = "validate",
+    [METRICS_PHASE_READ_BODY] = "read_body",
+    [METRICS_PHASE_PATH_CHECK] = "path_check",
+    [METRICS_PHASE_HANDLER] = "handler",
+    [METRICS_PHASE_WRITE] = "write",
+    [METRICS_PHASE_TOTAL] = "total",
+};
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+// Blocks of every thread that has recorded something. Threads live as long
+// as the process, so entries are never removed.
+static metrics_thread_t *_Atomic threads[METRICS_MAX_THREADS];
+static atomic_int thread_count;
+
+static _Thread_local metrics_thread_t *local_metrics;
+static _Thread_local int local_metrics_failed;
+
+static metrics_thread_t *thread_metrics(void)
+{
+    if (local_metrics || local_metrics_failed)
+        return local_metrics;
+
+    int index = atomic_fetch_add(&thread_count, 1);
+    metrics_thread_t *metrics = index < METRICS_MAX_THREADS ? calloc(1, sizeof(*metrics)) : NULL;
+    if (!metrics)
+    {
+        local_metrics_failed = 1; // its slot, if any, stays NULL and is skipped
+        LOG_WARN("metrics: this thread's requests are not counted");
+        return NULL;
+    }
+
+    atomic_store_explicit(&threads[index], metrics, memory_order_release);
+    local_metrics = metrics;
+    return metrics;
+}
+
+// Add to a counter only the calling thread writes
+static inline void bump(_Atomic uint64_t *counter, uint64_t n)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static unsigned bucket_index(uint64_t ns)
+{
+    if (ns >> METRICS_MAX_EXP)
+        ns = (UINT64_C(1) << METRICS_MAX_EXP) - 1;
+    if (ns < (1u << METRICS_SUB_BITS))
+        return (unsigned)ns;
+
+    unsigned exp = 63u - (unsigned)__builtin_clzll(ns);
+    unsigned shift = exp - METRICS_SUB_BITS;
+    return ((shift + 1) << METRICS_SUB_BITS) + (unsigned)((ns >> shift) & ((1u << METRICS_SUB_BITS) - 1));
+}
+
+// Largest value that lands in bucket `index`
+static uint64_t bucket_upper(unsigned index)
+{
+    if (index < (1u << METRICS_SUB_BITS))
+        return index;
+
+    unsigned shift = (index >> METRICS_SUB_BITS) - 1;
+    uint64_t sub = index & ((1u << METRICS_SUB_BITS) - 1);
+    uint64_t low = ((UINT64_C(1) << METRICS_SUB_BITS) + sub) << shift;
+    return low + (UINT64_C(1) << shift) - 1;
+}
+
+void metrics_record(metrics_phase_t phase, uint64_t ns)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (!metrics)
+        return;
+
+    histogram_t *histogram = &metrics->phases[phase];
+    bump(&histogram->buckets[bucket_index(ns)], 1);
+    bump(&histogram->sum_ns, ns);
+}
+
+void metrics_count_response(int status)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->status[status > 0 && status < METRICS_MAX_STATUS ? status : 0], 1);
+}
+
+void metrics_count_bytes_in(size_t bytes)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->bytes_in, bytes);
+}
+
+void metrics_count_bytes_out(size_t bytes)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->bytes_out, bytes);
+}
+
+void metrics_count_keepalive_reuse(void)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->keepalive_reuse, 1);
+}
+
+void metrics_count_timeout(int partial)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->timeouts[partial ? 1 : 0], 1);
+}
+
+void metrics_count_connection_opened(void)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->connections_opened, 1);
+}
+
+void metrics_count_connection_closed(void)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->connections_closed, 1);
+}
+
+void metrics_count_tls_handshake(metrics_tls_result_t result)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->tls_handshakes[result], 1);
+}
+
+void metrics_count_tls_kernel_send(void)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->tls_kernel_send, 1);
+}
+
+void metrics_count_tls_ticket(int hit)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->tls_tickets[hit ? 1 : 0], 1);
+}
+
+void metrics_count_tls_session_cache(int hit)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->tls_session_cache[hit ? 1 : 0], 1);
+}
+
+void metrics_count_http2_connection(void)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->http2_connections, 1);
+}
+
+void metrics_count_http2_stream(void)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->http2_streams, 1);
+}
+
+void metrics_count_http2_reset(void)
+{
+    metrics_thread_t *metrics = thread_metrics();
+    if (metrics)
+        bump(&metrics->http2_resets, 1);
+}
+
+// ----- Exposition -----
+
+// Sum a counter at `offset` bytes into every thread block
+static uint64_t sum_counter(size_t offset)
+{
+    uint64_t total = 0;
+    int count = atomic_load_explicit(&thread_count, memory_order_acquire);
+    for (int i = 0; i < count && i < METRICS_MAX_THREADS; i++)
+    {
+        metrics_thread_t *metrics = atomic_load_explicit(&threads[i], memory_order_acquire);
+        if (metrics)
+            total += atomic_load_explicit((_Atomic uint64_t *)((char *)metrics + offset), memory_order_relaxed);
+    }
+    return total;
+}
+
+#define SUM_COUNTER(field) sum_counter(offsetof(metrics_thread_t, field))
+
+static void render_phases(FILE *out)
+{
+    uint64_t merged[METRICS_BUCKETS]; // 8 KB, one phase at a time
+
+    fputs("# HELP http_request_phase_seconds Time spent in each request processing phase.\n"
+          "# TYPE http_request_phase_seconds summary\n",
+          out);
+
+    for (int phase = 0; phase < METRICS_PHASE_COUNT; phase++)
+    {
+        uint64_t count = 0;
+        for (unsigned b = 0; b < METRICS_BUCKETS; b++)
+        {
+            merged[b] = SUM_COUNTER(phases[phase].buckets[b]);
+            count += merged[b];
+        }
+        uint64_t sum_ns = SUM_COUNTER(phases[phase].sum_ns);
+
+        // Walk the merged buckets once, reporting each quantile at the upper
+        // edge of the bucket that reaches its rank
+        uint64_t seen = 0;
+        unsigned b = 0;
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+        {
+            fprintf(out, "http_request_phase_seconds{phase=\"%s\",quantile=\"%g\"} ", phase_names[phase], quantiles[q]);
+            if (count == 0)
+            {
+                fputs("NaN\n", out);
+                continue;
+            }
+
+            double target = quantiles[q] * (double)count;
+            uint64_t rank = (uint64_t)target;
+            if (rank == 0 || (double)rank < target)
+                rank++; // ceil(), at least the first sample
+            while (b < METRICS_BUCKETS - 1 && seen + merged[b] < rank)
+                seen += merged[b++];
+            fprintf(out, "%.9f\n", (double)bucket_upper(b) / 1e9);
+        }
+        fprintf(out, "http_request_phase_seconds_sum{phase=\"%s\"} %.9f\n", phase_names[phase], (double)sum_ns / 1e9);
+        fprintf(out, "http_request_phase_seconds_count{phase=\"%s\"} %llu\n", phase_names[phase],
+                (unsigned long long)count);
+    }
+}
+
+void metrics_write(FILE *out)
+{
+    render_phases(out);
+
+    fputs("# HELP http_responses_total Responses sent, by status code.\n"
+          "# TYPE http_responses_total counter\n",
+          out);
+    for (int status = 0; status < METRICS_MAX_STATUS; status++)
+    {
+        uint64_t count = SUM_COUNTER(status[status]);
+        if (count == 0)
+            continue;
+        if (status == 0)
+            fprintf(out, "http_responses_total{code=\"other\"} %llu\n", (unsigned long long)count);
+        else
+            fprintf(out, "http_responses_total{code=\"%d\"} %llu\n", status, (unsigned long long)count);
+    }
+
+    uint64_t opened = SUM_COUNTER(connections_opened);
+    uint64_t closed = SUM_COUNTER(connections_closed);
+    fprintf(out,
+            "# HELP http_received_bytes_total Bytes read from client sockets.\n"
+            "# TYPE http_received_bytes_total counter\n"
+            "http_received_bytes_total %llu\n"
+            "# HELP http_sent_bytes_total Bytes written to client sockets.\n"
+            "# TYPE http_sent_bytes_total counter\n"
+            "http_sent_bytes_total %llu\n"
+            "# HELP http_keepalive_requests_total Requests received on an already used connection.\n"
+            "# TYPE http_keepalive_requests_total counter\n"
+            "http_keepalive_requests_total %llu\n"
+            "# HELP http_timeouts_total Connections closed by a timeout, idle or with a partial request.\n"
+            "# TYPE http_timeouts_total counter\n"
+            "http_timeouts_total{kind=\"idle\"} %llu\n"
+            "http_timeouts_total{kind=\"partial\"} %llu\n"
+            "# HELP http_connections_total Connections accepted.\n"
+            "# TYPE http_connections_total counter\n"
+            "http_connections_total %llu\n"
+            "# HELP http_open_connections Connections currently open.\n"
+            "# TYPE http_open_connections gauge\n"
+            "http_open_connections %lld\n"
+            "# HELP tls_handshakes_total TLS handshakes, by outcome.\n"
+            "# TYPE tls_handshakes_total counter\n"
+            "tls_handshakes_total{result=\"full\"} %llu\n"
+            "tls_handshakes_total{result=\"resumed\"} %llu\n"
+            "tls_handshakes_total{result=\"failed\"} %llu\n"
+            "# HELP tls_kernel_send_total TLS connections whose records the kernel encrypts (kTLS).\n"
+            "# TYPE tls_kernel_send_total counter\n"
+            "tls_kernel_send_total %llu\n"
+            "# HELP tls_session_tickets_total Session tickets presented, by whether their key was still known.\n"
+            "# TYPE tls_session_tickets_total counter\n"
+            "tls_session_tickets_total{result=\"hit\"} %llu\n"
+            "tls_session_tickets_total{result=\"miss\"} %llu\n"
+            "# HELP tls_session_cache_lookups_total TLS 1.2 session ID lookups in the shared session cache.\n"
+            "# TYPE tls_session_cache_lookups_total counter\n"
+            "tls_session_cache_lookups_total{result=\"hit\"} %llu\n"
+            "tls_session_cache_lookups_total{result=\"miss\"} %llu\n"
+            "# HELP http2_connections_total Connections that switched to HTTP/2 (ALPN h2 or prior-knowledge h2c).\n"
+            "# TYPE http2_connections_total counter\n"
+            "http2_connections_total %llu\n"
+            "# HELP http2_streams_total Request streams opened on HTTP/2 connections.\n"
+            "# TYPE http2_streams_total counter\n"
+            "http2_streams_total %llu\n"
+            "# HELP http2_stream_resets_total HTTP/2 streams the server reset (RST_STREAM sent).\n"
+            "# TYPE http2_stream_resets_total counter\n"
+            "http2_stream_resets_total %llu\n"
+            "# HELP log_dropped_records_total Log records dropped because a ring was full.\n"
+            "# TYPE log_dropped_records_total counter\n"
+            "log_dropped_records_total %lu\n",
+            (unsigned long long)SUM_COUNTER(bytes_in),
+            (unsigned long long)SUM_COUNTER(bytes_out),
+            (unsigned long long)SUM_COUNTER(keepalive_reuse),
+            (unsigned long long)SUM_COUNTER(timeouts[0]),
+            (unsigned long long)SUM_COUNTER(timeouts[1]),
+            (unsigned long long)opened,
+            (long long)(opened - closed),
+            (unsigned long long)SUM_COUNTER(tls_handshakes[METRICS_TLS_FULL]),
+            (unsigned long long)SUM_COUNTER(tls_handshakes[METRICS_TLS_RESUMED]),
+            (unsigned long long)SUM_COUNTER(tls_handshakes[METRICS_TLS_FAILED]),
+            (unsigned long long)SUM_COUNTER(tls_kernel_send),
+            (unsigned long long)SUM_COUNTER(tls_tickets[1]),
+            (unsigned long long)SUM_COUNTER(tls_tickets[0]),
+            (unsigned long long)SUM_COUNTER(tls_session_cache[1]),
+            (unsigned long long)SUM_COUNTER(tls_session_cache[0]),
+            (unsigned long long)SUM_COUNTER(http2_connections),
+            (unsigned long long)SUM_COUNTER(http2_streams),
+            (unsigned long long)SUM_COUNTER(http2_resets),
+            log_dropped_count());
+}
+
+char *metrics_render(size_t *len)
+{
+    char *text = NULL;
+    FILE *out = open_memstream(&text, len);
+    if (!out)
+        return NULL;
+
+    metrics_write(out);
+    if (fclose(out) != 0)
+    {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
@@ -0,0 +1,85 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Request latency histograms and traffic counters, exposed in the Prometheus
+// text format. Every worker thread records into its own block; the block is
+// written by that thread only (plain loads and stores, no locked
+// instructions), and the exposition sums all blocks when it is scraped.
+
+// Request processing phases, each timed into its own histogram
+typedef enum
+{
+    METRICS_PHASE_READ_HEADERS, // first request byte buffered to head complete (includes client wait)
+    METRICS_PHASE_PARSE,        // time spent in the parser (request line and headers)
+    METRICS_PHASE_VALIDATE,     // validate_http_request()
+    METRICS_PHASE_READ_BODY,    // head complete to body complete (requests with a body)
+    METRICS_PHASE_PATH_CHECK,   // path safety check
+    METRICS_PHASE_HANDLER,      // method handler, up to the response being queued
+    METRICS_PHASE_WRITE,        // response queued to fully sent
+    METRICS_PHASE_TOTAL,        // first request byte to response queued
+    METRICS_PHASE_COUNT
+} metrics_phase_t;
+
+// HDR-style log-linear buckets over nanoseconds: exact below 2^SUB_BITS,
+// then 2^SUB_BITS buckets per power of two (about 3% relative error).
+// Values from 2^MAX_EXP ns (about 69 s) up land in the last bucket.
+#define METRICS_SUB_BITS 5
+#define METRICS_MAX_EXP 36
+#define METRICS_BUCKETS ((METRICS_MAX_EXP - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS)
+
+// Outcome of a TLS handshake
+typedef enum
+{
+    METRICS_TLS_FAILED,
+    METRICS_TLS_FULL,    // new session
+    METRICS_TLS_RESUMED, // session ticket or session cache hit
+    METRICS_TLS_RESULTS
+} metrics_tls_result_t;
+
+#define METRICS_MAX_STATUS 600  // status codes counted individually (below this)
+#define METRICS_MAX_THREADS 256 // threads beyond this are not counted
+
+static inline uint64_t metrics_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Record `ns` nanoseconds for a phase
+void metrics_record(metrics_phase_t phase, uint64_t ns);
+
+// Record the time elapsed since `start` (a metrics_now() value) for a phase
+static inline void metrics_record_since(metrics_phase_t phase, uint64_t start)
+{
+    metrics_record(phase, metrics_now() - start);
+}
+
+void metrics_count_response(int status);
+void metrics_count_bytes_in(size_t bytes);
+void metrics_count_bytes_out(size_t bytes);
+void metrics_count_keepalive_reuse(void); // request on an already used connection
+void metrics_count_timeout(int partial);  // HTTP_IO_TIMEOUT (0) or HTTP_IO_TIMEOUT_PARTIAL (1)
+void metrics_count_connection_opened(void);
+void metrics_count_connection_closed(void);
+void metrics_count_tls_handshake(metrics_tls_result_t result);
+void metrics_count_tls_kernel_send(void);      // session handed to kTLS for transmit
+void metrics_count_tls_ticket(int hit);        // a presented ticket's key was still known (1) or not (0)
+void metrics_count_tls_session_cache(int hit); // a TLS 1.2 session ID was found in the cache (1) or not (0)
+void metrics_count_http2_connection(void);     // connection switched to HTTP/2
+void metrics_count_http2_stream(void);         // request stream opened on an HTTP/2 connection
+void metrics_count_http2_reset(void);          // stream reset by the server (RST_STREAM sent)
+
+// Write every thread's metrics, summed, to `out` in the Prometheus text format
+void metrics_write(FILE *out);
+
+// The same exposition in a malloc()ed buffer. Sets `*len`, or returns NULL
+// on allocation failure.
+char *metrics_render(size_t *len);
+
+#endif
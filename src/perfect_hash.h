@@ -0,0 +1,40 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Hash functions shared by tools/gen_perfect_hash.c and the lookups that use
+// its tables, so generated displacements always match at runtime.
+//
+// Lookup (hash and displace): h = perfect_hash_key(key)
+//   bucket = (uint32_t)h % buckets
+//   slot   = perfect_hash_slot(h, displacement[bucket]) % size
+// Every key of the table lands in its own slot; other inputs land somewhere
+// and are rejected by comparing against the key stored for that slot.
+
+// FNV-1a over the key bytes
+static inline uint64_t perfect_hash_key(const char *key, size_t len)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Mix the upper half of the key hash with a bucket's displacement (murmur3 finalizer)
+static inline uint32_t perfect_hash_slot(uint64_t hash, uint32_t displacement)
+{
+    uint32_t x = (uint32_t)(hash >> 32) ^ (displacement * 0x9e3779b9u);
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+#endif
@@ -1,37 +1,296 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include "response_utils.h"
 #include "http_mappings.h"
+#include "http_chunked.h"
+#include "server_config.h"
+#include "log.h"
+
+#define STRINGIFY_VALUE(x) #x
+#define STRINGIFY(x) STRINGIFY_VALUE(x)
+
+typedef struct
+{
+    int code;
+    const char *text;
+    const char *line;
+    size_t line_len;
+} status_entry_t;
+
+#define STATUS(code, text) {code, text, "HTTP/1.1 " #code " " text "\r\n", sizeof("HTTP/1.1 " #code " " text "\r\n") - 1}
+
+static const status_entry_t status_table[] = {
+    STATUS(200, "OK"),
+    STATUS(206, "Partial Content"),
+    STATUS(304, "Not Modified"),
+    STATUS(400, "Bad Request"),
+    STATUS(404, "Not Found"),
+    STATUS(405, "Method Not Allowed"),
+    STATUS(408, "Request Timeout"),
+    STATUS(411, "Length Required"),
+    STATUS(412, "Precondition Failed"),
+    STATUS(413, "Payload Too Large"),
+    STATUS(414, "URI Too Long"),
+    STATUS(415, "Unsupported Media Type"),
+    STATUS(416, "Range Not Satisfiable"),
+    STATUS(431, "Request Header Fields Too Large"),
+    STATUS(500, "Internal Server Error"),
+    STATUS(501, "Not Implemented"),
+    STATUS(505, "HTTP Version Not Supported"),
+};
+
+#undef STATUS
+
+static const status_entry_t *find_status(int status_code)
+{
+    for (size_t i = 0; i < sizeof(status_table) / sizeof(status_table[0]); i++)
+    {
+        if (status_table[i].code == status_code)
+            return &status_table[i];
+    }
+    return NULL;
+}
+
+const char *response_status_line(int status_code, size_t *len)
+{
+    const status_entry_t *status = find_status(status_code);
+    if (!status)
+        return NULL;
+    *len = status->line_len;
+    return status->line;
+}
 
-void add_date_header(char *headers, size_t *offset, size_t buffer_size)
+const char *response_status_text(int status_code)
 {
-    time_t now = time(NULL);
-    struct tm tm;
+    const status_entry_t *status = find_status(status_code);
+    return status ? status->text : NULL;
+}
+
+// Date line cache, one per worker thread
+static _Thread_local struct
+{
+    time_t second;
+    size_t len;
+    char line[48];
+} date_cache;
+
+const char *response_date_line(size_t *len)
+{
+    time_t now = time(NULL); // vDSO, no syscall
+    if (now != date_cache.second || date_cache.len == 0)
+    {
+        struct tm tm;
 #if defined(_WIN32)
-    gmtime_s(&tm, &now);
+        gmtime_s(&tm, &now);
 #else
-    gmtime_r(&now, &tm);
+        gmtime_r(&now, &tm);
 #endif
-    char date_str[64];
-    // IMF-fixdate per RFC 9110 (Sun, 06 Nov 1994 08:49:37 GMT)
-    strftime(date_str, sizeof(date_str), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        // IMF-fixdate per RFC 9110 (Sun, 06 Nov 1994 08:49:37 GMT)
+        date_cache.len = strftime(date_cache.line, sizeof(date_cache.line),
+                                  "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        date_cache.second = now;
+    }
+    *len = date_cache.len;
+    return date_cache.line;
+}
+
+void response_begin(response_builder_t *response, int status_code, const char *status_text)
+{
+    response->count = 0;
+    response->overflow = 0;
+
+    size_t len;
+    const char *line = response_status_line(status_code, &len);
+    if (line)
+    {
+        response_add(response, line, len);
+    }
+    else
+    {
+        // Rare: render "HTTP/1.1 NNN " and reference the text
+        int prefix = snprintf(response->status_prefix, sizeof(response->status_prefix),
+                              "HTTP/1.1 %03d ", status_code);
+        response_add(response, response->status_prefix, (size_t)prefix);
+        response_add(response, status_text, strlen(status_text));
+        response_add_literal(response, "\r\n");
+    }
+
+    line = response_date_line(&len);
+    response_add(response, line, len);
+}
+
+void response_add(response_builder_t *response, const char *fragment, size_t len)
+{
+    if (response->count == RESPONSE_MAX_PARTS)
+    {
+        response->overflow = 1;
+        return;
+    }
+    response->parts[response->count].iov_base = (void *)fragment;
+    response->parts[response->count].iov_len = len;
+    response->count++;
+}
+
+void response_add_content_length(response_builder_t *response, size_t length)
+{
+    static const char name[] = "Content-Length: ";
+    char digits[24];
+    size_t n = 0;
+    do
+    {
+        digits[n++] = (char)('0' + length % 10);
+        length /= 10;
+    } while (length);
+
+    char *out = response->content_length;
+    char *p = out;
+    memcpy(p, name, sizeof(name) - 1);
+    p += sizeof(name) - 1;
+    while (n)
+        *p++ = digits[--n];
+    *p++ = '\r';
+    *p++ = '\n';
+    response_add(response, out, (size_t)(p - out));
+}
+
+const char *response_connection_line(const char *connection_header, size_t *len)
+{
+    static const char close_line[] = "Connection: close\r\n";
+    static const char keep_alive_lines[] = "Connection: keep-alive\r\n"
+                                           "Keep-Alive: timeout=" STRINGIFY(KEEP_ALIVE_TIMEOUT_SEC) "\r\n";
+    if (strcmp(connection_header, "close") == 0)
+    {
+        *len = sizeof(close_line) - 1;
+        return close_line;
+    }
+    if (strcmp(connection_header, "keep-alive") == 0)
+    {
+        *len = sizeof(keep_alive_lines) - 1;
+        return keep_alive_lines;
+    }
+    return NULL;
+}
+
+void response_add_connection(response_builder_t *response, const char *connection_header)
+{
+    size_t len;
+    const char *line = response_connection_line(connection_header, &len);
+    if (line)
+    {
+        response_add(response, line, len);
+    }
+    else
+    {
+        // Echo an unusual Connection value the client sent
+        response_add_literal(response, "Connection: ");
+        response_add(response, connection_header, strlen(connection_header));
+        response_add_literal(response, "\r\n");
+    }
+}
+
+void response_end_head(response_builder_t *response)
+{
+    response_add_literal(response, "\r\n");
+}
+
+int response_send(response_builder_t *response, connection_t *conn)
+{
+    if (response->overflow)
+    {
+        LOG_ERROR("Too many response fragments");
+        return -1;
+    }
+    return connection_sendv(conn, response->parts, response->count);
+}
+
+int response_finish(response_builder_t *response, connection_t *conn, const void *body, size_t body_len)
+{
+    response_end_head(response);
+    if (body && body_len > 0)
+        response_add(response, body, body_len);
+    return response_send(response, conn);
+}
+
+// ----- Chunked bodies -----
+
+int response_send_chunk(connection_t *conn, const void *data, size_t len)
+{
+    if (len == 0)
+        return 0;
+
+    char head[HTTP_CHUNK_HEAD_MAX];
+    struct iovec iov[3] = {
+        {head, http_chunked_head(head, len)},
+        {(void *)data, len},
+        {HTTP_CHUNK_END, sizeof(HTTP_CHUNK_END) - 1},
+    };
+    return connection_sendv(conn, iov, 3);
+}
+
+int response_end_chunks(connection_t *conn)
+{
+    return connection_send_ref(conn, HTTP_CHUNK_LAST, sizeof(HTTP_CHUNK_LAST) - 1, NULL, NULL);
+}
+
+typedef struct
+{
+    connection_t *conn;
+    int failed; // a chunk was lost: the body must not be terminated
+} chunked_stream_t;
 
-    if (*offset < buffer_size)
+static ssize_t chunked_stream_write(void *cookie, const char *data, size_t len)
+{
+    chunked_stream_t *stream = cookie;
+    if (stream->failed || response_send_chunk(stream->conn, data, len) < 0)
     {
-        *offset += (size_t)snprintf(headers + *offset, buffer_size - *offset,
-                                    "Date: %s\r\n", date_str);
-        if (*offset > buffer_size)
-            *offset = buffer_size;
+        stream->failed = 1;
+        return 0;
     }
+    stream->conn->response_bytes += len;
+    return (ssize_t)len;
+}
+
+static int chunked_stream_close(void *cookie)
+{
+    chunked_stream_t *stream = cookie;
+    int rc = stream->failed ? -1 : response_end_chunks(stream->conn);
+    free(stream);
+    return rc;
+}
+
+FILE *response_chunked_stream(connection_t *conn)
+{
+    chunked_stream_t *stream = malloc(sizeof(*stream));
+    if (!stream)
+        return NULL;
+    stream->conn = conn;
+    stream->failed = 0;
+
+    cookie_io_functions_t functions = {
+        .write = chunked_stream_write,
+        .close = chunked_stream_close,
+    };
+    FILE *out = fopencookie(stream, "w", functions);
+    if (!out)
+    {
+        free(stream);
+        return NULL;
+    }
+    setvbuf(out, NULL, _IOFBF, RESPONSE_CHUNK_SIZE);
+    return out;
 }
 
 // Build Allow: header value, with the allowed methods
 const char *build_allow_header()
 {
-    static char allow_buffer[128];
-    allow_buffer[0] = '\0';
+    static _Thread_local char allow_buffer[128]; // per worker thread, rendered once
+    if (allow_buffer[0])
+        return allow_buffer;
 
     size_t offset = 0;
     offset += snprintf(allow_buffer + offset, sizeof(allow_buffer) - offset, "Allow: ");
@@ -49,4 +308,4 @@ const char *build_allow_header()
     offset += snprintf(allow_buffer + offset, sizeof(allow_buffer) - offset, "\r\n");
 
     return allow_buffer;
-}
\ No newline at end of file
+}
@@ -2,9 +2,88 @@
 #define RESPONSE_UTILS_H
 
 #include <stddef.h>
+#include <stdio.h>
+#include <sys/uio.h>
 
-// Writes a RFC 9110-compliant Date header into `headers` at position `*offset`
-void add_date_header(char *headers, size_t *offset, size_t buffer_size);
+#include "connection.h"
+
+#define RESPONSE_MAX_PARTS 16
+#define RESPONSE_CHUNK_SIZE 16384 // bytes buffered per chunk by response_chunked_stream()
+
+// Response head assembled from pre-rendered fragments: status lines, the
+// cached Date line, Connection/Keep-Alive lines and content types are
+// constant strings referenced in place, so building a response formats
+// nothing but the Content-Length digits. response_finish() gathers the
+// fragments into one queued chunk; a borrowed body queued right after it
+// leaves in the same sendmsg() without being copied.
+typedef struct
+{
+    struct iovec parts[RESPONSE_MAX_PARTS];
+    int count;
+    int overflow; // more fragments than RESPONSE_MAX_PARTS were added
+    char status_prefix[16];  // "HTTP/1.1 NNN " for codes without a pre-rendered line
+    char content_length[40]; // "Content-Length: N\r\n"
+} response_builder_t;
+
+// Pre-rendered status line ("HTTP/1.1 404 Not Found\r\n") and reason phrase,
+// or NULL for status codes without one
+const char *response_status_line(int status_code, size_t *len);
+const char *response_status_text(int status_code);
+
+// Start a response with its status line and Date header. Status codes
+// without a pre-rendered line are rendered from `status_text`, which must
+// then outlive the builder.
+void response_begin(response_builder_t *response, int status_code, const char *status_text);
+
+// Append a header fragment (one or more complete "Name: value\r\n" lines).
+// The bytes are referenced, not copied, until response_finish().
+void response_add(response_builder_t *response, const char *fragment, size_t len);
+#define response_add_literal(response, s) response_add((response), (s), sizeof(s) - 1)
+
+void response_add_content_length(response_builder_t *response, size_t length);
+
+// Pre-rendered "Connection: close" or "Connection: keep-alive" + Keep-Alive
+// lines, or NULL for any other Connection value
+const char *response_connection_line(const char *connection_header, size_t *len);
+
+// Connection line for the request's Connection value, plus Keep-Alive when
+// the connection stays open
+void response_add_connection(response_builder_t *response, const char *connection_header);
+
+// Terminate the head. Fragments added afterwards form the body.
+void response_end_head(response_builder_t *response);
+
+// Queue everything added so far as one chunk. Returns 0, or -1 if there were
+// more fragments than fit or the chunk could not be queued.
+int response_send(response_builder_t *response, connection_t *conn);
+
+// Terminate the head and queue it followed by `body` (copied, may be NULL)
+int response_finish(response_builder_t *response, connection_t *conn, const void *body, size_t body_len);
+
+// ----- Chunked bodies -----
+// For bodies whose size is not known up front: the head announces
+// "Transfer-Encoding: chunked" instead of a Content-Length, and the body is
+// queued chunk by chunk as it is produced. Only for HTTP/1.1 requests.
+
+#define response_add_chunked(response) response_add_literal((response), "Transfer-Encoding: chunked\r\n")
+
+// Queue `len` bytes (copied) as one chunk. Empty data queues nothing: a
+// zero-size chunk would end the body.
+int response_send_chunk(connection_t *conn, const void *data, size_t len);
+
+// Queue the last chunk, ending the body
+int response_end_chunks(connection_t *conn);
+
+// Open a stdio stream whose output is queued in chunks of up to
+// RESPONSE_CHUNK_SIZE bytes. fclose() flushes it and ends the body, unless a
+// chunk could not be queued (the connection is then closed after the partial
+// response, so the client sees it truncated). Each chunk adds to the
+// response's body size in the access log. Returns NULL on failure.
+FILE *response_chunked_stream(connection_t *conn);
+
+// "Date: <IMF-fixdate>\r\n" for the current second, re-rendered at most once
+// a second per worker thread
+const char *response_date_line(size_t *len);
 
 // Builds an Allow: header value with the allowed methods
 const char *build_allow_header(void);
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "server_config.h"
+
+server_config_t server_config = {
+    .port = PORT,
+    .workers = 0,
+    .pin_workers = 0,
+    .io_backend = IO_BACKEND_EPOLL,
+    .file_cache_size = (size_t)FILE_CACHE_DEFAULT_MB * 1024 * 1024,
+    .file_cache_revalidate_sec = FILE_CACHE_REVALIDATE_SEC,
+    .error_pages_dir = NULL,
+    .log_level = LOG_LEVEL_INFO,
+    .access_log_path = NULL,
+    .metrics_path = NULL, // the listener is public: metrics are opt-in
+    .max_body = (size_t)MAX_BODY_DEFAULT_MB * 1024 * 1024,
+    .compress_level = COMPRESS_DEFAULT_LEVEL,
+    .compress_min_size = COMPRESS_DEFAULT_MIN_SIZE,
+    .tls_ticket_rotate_sec = TLS_TICKET_ROTATE_DEFAULT_SEC,
+    .tls_session_cache_size = TLS_SESSION_CACHE_DEFAULT,
+    .http2 = 1,
+};
+
+// "<n>[K|M|G]" in bytes. Returns 0 or -1.
+static int parse_size(const char *text, size_t *size)
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (errno || end == text || text[0] == '-')
+        return -1;
+
+    unsigned shift = 0;
+    switch (*end)
+    {
+    case 'K':
+    case 'k':
+        shift = 10;
+        end++;
+        break;
+    case 'M':
+    case 'm':
+        shift = 20;
+        end++;
+        break;
+    case 'G':
+    case 'g':
+        shift = 30;
+        end++;
+        break;
+    }
+    if (*end || value > (SIZE_MAX >> shift))
+        return -1;
+    *size = (size_t)value << shift;
+    return 0;
+}
+
+// "-B <size>" sets the default body limit, "-B <path>=<size>" a route's
+static int parse_body_limit(char *arg)
+{
+    char *equals = strchr(arg, '=');
+    if (!equals)
+        return parse_size(arg, &server_config.max_body);
+
+    if (arg[0] != '/' || server_config.body_route_count == MAX_BODY_ROUTES)
+        return -1;
+    *equals = '\0';
+    body_route_t *route = &server_config.body_routes[server_config.body_route_count];
+    if (parse_size(equals + 1, &route->max_body) < 0)
+        return -1;
+    route->path = arg;
+    server_config.body_route_count++;
+    return 0;
+}
+
+size_t server_config_max_body(const char *path)
+{
+    size_t best_len = 0;
+    size_t max_body = server_config.max_body;
+    for (int i = 0; i < server_config.body_route_count; i++)
+    {
+        const body_route_t *route = &server_config.body_routes[i];
+        size_t len = strlen(route->path);
+        if (len > 1 && route->path[len - 1] == '/')
+            len--; // "/uploads/" covers "/uploads" too
+        // Whole path segments only: /test matches /test and /test/x, not /testing
+        if (len >= best_len && strncmp(path, route->path, len) == 0 &&
+            (path[len] == '\0' || path[len] == '/' || len == 1))
+        {
+            best_len = len;
+            max_body = route->max_body;
+        }
+    }
+    return max_body;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -p <port>     Listen port (default %d)\n"
+            "  -w <workers>  Reactor threads, 0 = one per CPU (default 0)\n"
+            "  -a            Pin each worker thread to its own CPU\n"
+            "  -b <backend>  I/O backend: epoll or io_uring (default epoll)\n"
+            "  -c <MB>       Static file cache size per worker, 0 = off (default %d)\n"
+            "  -v <seconds>  Re-check cached files on disk after this long (default %d)\n"
+            "  -e <dir>      Load custom error pages (<status>.html) from this directory\n"
+            "  -l <level>    Log level: debug, info, warn, error or off (default info;\n"
+            "                debug needs a `make LOG_LEVEL=DEBUG` build)\n"
+            "  -A <file>     Write an access log in combined format, - for stdout\n"
+            "  -M <path>     Serve Prometheus metrics at this URL path, e.g. /metrics;\n"
+            "                it is reachable by every client (default off)\n"
+            "  -B [path=]<size>  Max request body, optionally for the paths under `path`;\n"
+            "                K/M/G suffixes, repeatable (default %dM)\n"
+            "  -z <level>    On-the-fly gzip/zstd compression level 1-9, 0 = off (default %d)\n"
+            "  -m <size>     Compress bodies of at least this size, K/M suffixes (default %d)\n"
+            "  -C <file>     Serve HTTPS with this PEM certificate chain (needs -K)\n"
+            "  -K <file>     PEM private key of the -C certificate\n"
+            "  -T <seconds>  Rotate the TLS session ticket key this often, 0 = no tickets\n"
+            "                (default %d)\n"
+            "  -S <entries>  Shared TLS 1.2 session cache size, 0 = off (default %d)\n"
+            "  -H            Serve HTTP/1.x only: no HTTP/2 (h2 or h2c)\n"
+            "  -h            Show this help\n",
+            prog, PORT, FILE_CACHE_DEFAULT_MB, FILE_CACHE_REVALIDATE_SEC, MAX_BODY_DEFAULT_MB,
+            COMPRESS_DEFAULT_LEVEL, COMPRESS_DEFAULT_MIN_SIZE, TLS_TICKET_ROTATE_DEFAULT_SEC,
+            TLS_SESSION_CACHE_DEFAULT);
+}
+
+int parse_server_config(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "p:w:ab:c:v:e:l:A:M:B:z:m:C:K:T:S:Hh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p':
+            server_config.port = atoi(optarg);
+            if (server_config.port <= 0 || server_config.port > 65535)
+            {
+                fprintf(stderr, "Invalid port: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'w':
+            server_config.workers = atoi(optarg);
+            if (server_config.workers < 0)
+            {
+                fprintf(stderr, "Invalid worker count: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'a':
+            server_config.pin_workers = 1;
+            break;
+        case 'b':
+            if (strcmp(optarg, "epoll") == 0)
+                server_config.io_backend = IO_BACKEND_EPOLL;
+            else if (strcmp(optarg, "io_uring") == 0)
+                server_config.io_backend = IO_BACKEND_IO_URING;
+            else
+            {
+                fprintf(stderr, "Unknown I/O backend: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'c':
+        {
+            int megabytes = atoi(optarg);
+            if (megabytes < 0)
+            {
+                fprintf(stderr, "Invalid cache size: %s\n", optarg);
+                return -1;
+            }
+            server_config.file_cache_size = (size_t)megabytes * 1024 * 1024;
+            break;
+        }
+        case 'v':
+            server_config.file_cache_revalidate_sec = atoi(optarg);
+            if (server_config.file_cache_revalidate_sec < 0)
+            {
+                fprintf(stderr, "Invalid revalidation interval: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'e':
+            server_config.error_pages_dir = optarg;
+            break;
+        case 'l':
+            if (log_parse_level(optarg, &server_config.log_level) < 0)
+            {
+                fprintf(stderr, "Unknown log level: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'A':
+            server_config.access_log_path = optarg;
+            break;
+        case 'M':
+            if (strcmp(optarg, "off") == 0)
+                server_config.metrics_path = NULL;
+            else if (optarg[0] == '/')
+                server_config.metrics_path = optarg;
+            else
+            {
+                fprintf(stderr, "Metrics path must start with '/': %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'B':
+            if (parse_body_limit(optarg) < 0)
+            {
+                fprintf(stderr, "Invalid body limit: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'z':
+        {
+            char *end;
+            long level = strtol(optarg, &end, 10);
+            if (end == optarg || *end || level < 0 || level > 9)
+            {
+                fprintf(stderr, "Invalid compression level: %s\n", optarg);
+                return -1;
+            }
+            server_config.compress_level = (int)level;
+            break;
+        }
+        case 'm':
+            if (parse_size(optarg, &server_config.compress_min_size) < 0)
+            {
+                fprintf(stderr, "Invalid minimum compression size: %s\n", optarg);
+                return -1;
+            }
+            break;
+        case 'C':
+            server_config.tls_cert_path = optarg;
+            break;
+        case 'K':
+            server_config.tls_key_path = optarg;
+            break;
+        case 'T':
+        {
+            char *end;
+            long seconds = strtol(optarg, &end, 10);
+            if (end == optarg || *end || seconds < 0 || seconds > 7 * 24 * 3600)
+            {
+                fprintf(stderr, "Invalid ticket key rotation interval: %s\n", optarg);
+                return -1;
+            }
+            server_config.tls_ticket_rotate_sec = (int)seconds;
+            break;
+        }
+        case 'S':
+        {
+            char *end;
+            unsigned long long entries = strtoull(optarg, &end, 10);
+            if (end == optarg || *end || optarg[0] == '-' || entries > 1u << 24)
+            {
+                fprintf(stderr, "Invalid TLS session cache size: %s\n", optarg);
+                return -1;
+            }
+            server_config.tls_session_cache_size = (size_t)entries;
+            break;
+        }
+        case 'H':
+            server_config.http2 = 0;
+            break;
+        case 'h':
+        default:
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (!server_config.tls_cert_path != !server_config.tls_key_path)
+    {
+        fprintf(stderr, "TLS needs both a certificate (-C) and a private key (-K)\n");
+        return -1;
+    }
+
+    if (server_config.workers == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        server_config.workers = (cpus > 0) ? (int)cpus : 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <stddef.h>
+
+#include "log.h"
+
+#define PORT 8080
+
+#define READ_TIMEOUT_SEC 30      // 30 second timeout
+#define KEEP_ALIVE_TIMEOUT_SEC 5 // 5 second keep-alive timeout
+
+#define FILE_CACHE_DEFAULT_MB 32    // per-worker static file cache budget
+#define FILE_CACHE_REVALIDATE_SEC 2 // stat() cached files at most this often
+
+#define MAX_BODY_DEFAULT_MB 1024 // request body limit for routes without their own
+#define MAX_BODY_ROUTES 16
+
+#define COMPRESS_DEFAULT_LEVEL 6       // on-the-fly gzip/zstd level
+#define COMPRESS_DEFAULT_MIN_SIZE 1024 // smallest body worth compressing
+
+#define TLS_TICKET_ROTATE_DEFAULT_SEC 3600 // session ticket key lifetime for issuing new tickets
+#define TLS_SESSION_CACHE_DEFAULT 20480    // TLS 1.2 sessions kept for session ID resumption
+
+// Request body limit for the paths under `path`
+typedef struct
+{
+    const char *path;
+    size_t max_body;
+} body_route_t;
+
+typedef enum
+{
+    IO_BACKEND_EPOLL,    // readiness-based reactor (portable default)
+    IO_BACKEND_IO_URING, // completion-based, falls back to epoll if unavailable
+} io_backend_t;
+
+// Runtime settings, filled from the command line at startup and read-only afterwards
+typedef struct
+{
+    int port;
+    int workers;     // reactor threads, each with its own SO_REUSEPORT listener (0 = one per online CPU)
+    int pin_workers; // pin worker N to CPU N (modulo the CPU count)
+    io_backend_t io_backend;
+    size_t file_cache_size;        // per-worker file cache budget in bytes (0 = disabled)
+    int file_cache_revalidate_sec; // age after which a cached file is re-checked on disk
+    const char *error_pages_dir;   // directory with <status>.html custom error pages (NULL = built-in)
+    log_level_t log_level;         // server log threshold
+    const char *access_log_path;   // combined-format access log, "-" for stdout (NULL = off)
+    const char *metrics_path;      // URL path serving Prometheus metrics (NULL = off, the default)
+    size_t max_body;               // request body limit for routes without their own
+    body_route_t body_routes[MAX_BODY_ROUTES];
+    int body_route_count;
+    int compress_level;       // on-the-fly gzip/zstd level (0 = off)
+    size_t compress_min_size; // smaller bodies are sent uncompressed
+    const char *tls_cert_path; // PEM certificate chain: serve HTTPS instead of HTTP (NULL = plain)
+    const char *tls_key_path;  // PEM private key of that certificate
+    int tls_ticket_rotate_sec;     // session ticket key rotation interval (0 = no tickets)
+    size_t tls_session_cache_size; // shared TLS 1.2 session cache entries (0 = off)
+    int http2;                     // offer HTTP/2: ALPN h2 under TLS, prior knowledge h2c otherwise
+} server_config_t;
+
+extern server_config_t server_config;
+
+// Parses command-line options into server_config. Returns 0 on success, -1 on bad usage.
+int parse_server_config(int argc, char *argv[]);
+
+// Body size limit for a request path: the longest matching -B route, else
+// max_body. Buffered (non-streamed) bodies are further capped by the
+// request buffer.
+size_t server_config_max_body(const char *path);
+
+#endif
@@ -0,0 +1,44 @@
+#include <stddef.h>
+#include <time.h>
+
+#include "timer_list.h"
+
+long long monotonic_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec;
+}
+
+void timer_unlink(connection_t *conn)
+{
+    timer_list_t *list = conn->timer_list;
+    if (!list)
+        return;
+
+    if (conn->timer_prev)
+        conn->timer_prev->timer_next = conn->timer_next;
+    else
+        list->head = conn->timer_next;
+    if (conn->timer_next)
+        conn->timer_next->timer_prev = conn->timer_prev;
+    else
+        list->tail = conn->timer_prev;
+
+    conn->timer_prev = NULL;
+    conn->timer_next = NULL;
+    conn->timer_list = NULL;
+}
+
+void timer_touch(timer_list_t *list, connection_t *conn)
+{
+    timer_unlink(conn);
+    conn->deadline = monotonic_seconds() + list->timeout_sec;
+    conn->timer_list = list;
+    conn->timer_prev = list->tail;
+    if (list->tail)
+        list->tail->timer_next = conn;
+    else
+        list->head = conn;
+    list->tail = conn;
+}
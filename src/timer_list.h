@@ -0,0 +1,24 @@
+#ifndef TIMER_LIST_H
+#define TIMER_LIST_H
+
+#include "connection.h"
+
+// Connections sharing the same timeout, ordered by deadline (oldest first).
+// Because every entry in a list uses the same timeout, appending on activity
+// keeps the list sorted and expiry checks only look at the head.
+typedef struct
+{
+    connection_t *head;
+    connection_t *tail;
+    int timeout_sec;
+} timer_list_t;
+
+long long monotonic_seconds(void);
+
+// Remove the connection from whichever list it is on (no-op if none)
+void timer_unlink(connection_t *conn);
+
+// Re-arm the connection's timeout after activity (moves it to the list tail)
+void timer_touch(timer_list_t *list, connection_t *conn);
+
+#endif
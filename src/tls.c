@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
+
+#include "tls.h"
+#include "tls_session.h"
+#include "server_config.h"
+#include "log.h"
+
+#ifdef HAVE_OPENSSL
+
+static SSL_CTX *tls_ctx; // set up once before the workers start, read-only afterwards
+
+// Log and drain the thread's OpenSSL error queue
+static void log_ssl_errors(log_level_t level, const char *what)
+{
+    unsigned long error = ERR_get_error();
+    if (!error)
+    {
+        LOG_AT(level, "%s failed", what);
+        return;
+    }
+    for (; error; error = ERR_get_error())
+    {
+        char text[256];
+        ERR_error_string_n(error, text, sizeof(text));
+        LOG_AT(level, "%s failed: %s", what, text);
+    }
+}
+
+// ALPN: h2 when the client offers it and HTTP/2 is on, else http/1.1.
+// Clients offering neither go on without ALPN, as HTTP/1.x.
+static int select_alpn(SSL *tls, const unsigned char **out, unsigned char *out_len, const unsigned char *in,
+                       unsigned int in_len, void *arg)
+{
+    (void)tls;
+    (void)arg;
+    static const unsigned char protocols[] = "\x02h2\x08http/1.1";
+    const unsigned char *server = server_config.http2 ? protocols : protocols + 3;
+    unsigned int server_len = (unsigned int)(sizeof(protocols) - 1 - (size_t)(server - protocols));
+
+    unsigned char *selected;
+    if (SSL_select_next_proto(&selected, out_len, server, server_len, in, in_len) != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+int tls_init(const char *cert_path, const char *key_path)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx)
+    {
+        log_ssl_errors(LOG_LEVEL_ERROR, "SSL_CTX_new()");
+        return -1;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_3_VERSION);
+
+    // kTLS once the handshake is done; compression and renegotiation would
+    // rule it out and are unwanted anyway. A client closing without
+    // close_notify is an ordinary EOF: HTTP frames its own messages.
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_COMPRESSION | SSL_OP_NO_RENEGOTIATION |
+                                 SSL_OP_IGNORE_UNEXPECTED_EOF);
+
+    // Non-blocking writes: a record at a time, retried from wherever the
+    // caller keeps the bytes. Idle sessions give their buffers back.
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                              SSL_MODE_RELEASE_BUFFERS);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert_path) != 1)
+    {
+        LOG_ERROR("Cannot load certificate %s", cert_path);
+        log_ssl_errors(LOG_LEVEL_ERROR, "SSL_CTX_use_certificate_chain_file()");
+        SSL_CTX_free(ctx);
+        return -1;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, key_path, SSL_FILETYPE_PEM) != 1 || SSL_CTX_check_private_key(ctx) != 1)
+    {
+        LOG_ERROR("Cannot load private key %s for %s", key_path, cert_path);
+        log_ssl_errors(LOG_LEVEL_ERROR, "SSL_CTX_use_PrivateKey_file()");
+        SSL_CTX_free(ctx);
+        return -1;
+    }
+
+    SSL_CTX_set_alpn_select_cb(ctx, select_alpn, NULL);
+
+    if (tls_session_init(ctx) < 0)
+    {
+        SSL_CTX_free(ctx);
+        return -1;
+    }
+
+    tls_ctx = ctx;
+    return 0;
+}
+
+int tls_enabled(void)
+{
+    return tls_ctx != NULL;
+}
+
+SSL *tls_accept(int fd)
+{
+    SSL *tls = SSL_new(tls_ctx);
+    if (!tls)
+    {
+        log_ssl_errors(LOG_LEVEL_ERROR, "SSL_new()");
+        return NULL;
+    }
+    if (SSL_set_fd(tls, fd) != 1)
+    {
+        log_ssl_errors(LOG_LEVEL_ERROR, "SSL_set_fd()");
+        SSL_free(tls);
+        return NULL;
+    }
+    SSL_set_accept_state(tls);
+    return tls;
+}
+
+// Map a failed SSL call onto recv()/send() results. After a fatal error no
+// close_notify may be sent, so the session is marked for a quiet shutdown.
+static ssize_t io_failure(SSL *tls, int rc, int writing)
+{
+    switch (SSL_get_error(tls, rc))
+    {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_ZERO_RETURN: // close_notify received
+        if (!writing)
+            return 0;
+        errno = EPIPE;
+        return -1;
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0)
+            errno = ECONNRESET;
+        break;
+    default:
+        log_ssl_errors(LOG_LEVEL_INFO, writing ? "SSL_write()" : "SSL_read()");
+        errno = EPROTO;
+        break;
+    }
+    SSL_set_quiet_shutdown(tls, 1);
+    return -1;
+}
+
+int tls_handshake(SSL *tls)
+{
+    ERR_clear_error();
+    int rc = SSL_do_handshake(tls);
+    if (rc == 1)
+        return 1;
+
+    switch (SSL_get_error(tls, rc))
+    {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        return 0;
+    case SSL_ERROR_SYSCALL:
+        LOG_DEBUG("TLS handshake aborted: %s", errno ? strerror(errno) : "EOF");
+        ERR_clear_error();
+        break;
+    default:
+        // Typically a client that does not trust the certificate or speaks
+        // an older protocol
+        log_ssl_errors(LOG_LEVEL_DEBUG, "TLS handshake");
+        break;
+    }
+    return -1;
+}
+
+int tls_resumed(SSL *tls)
+{
+    return SSL_session_reused(tls);
+}
+
+int tls_kernel_send(SSL *tls)
+{
+    return BIO_get_ktls_send(SSL_get_wbio(tls)) ? 1 : 0;
+}
+
+int tls_alpn_h2(SSL *tls)
+{
+    const unsigned char *protocol;
+    unsigned int len;
+    SSL_get0_alpn_selected(tls, &protocol, &len);
+    return len == 2 && memcmp(protocol, "h2", 2) == 0;
+}
+
+ssize_t tls_recv(SSL *tls, void *buf, size_t len)
+{
+    size_t received;
+    ERR_clear_error();
+    errno = 0;
+    int rc = SSL_read_ex(tls, buf, len, &received);
+    return rc == 1 ? (ssize_t)received : io_failure(tls, rc, 0);
+}
+
+ssize_t tls_send(SSL *tls, const void *buf, size_t len)
+{
+    size_t sent;
+    ERR_clear_error();
+    errno = 0;
+    int rc = SSL_write_ex(tls, buf, len, &sent);
+    return rc == 1 ? (ssize_t)sent : io_failure(tls, rc, 1);
+}
+
+void tls_close(SSL *tls)
+{
+    // Best effort, without waiting for the client's close_notify
+    if (SSL_is_init_finished(tls))
+    {
+        ERR_clear_error();
+        SSL_shutdown(tls);
+        ERR_clear_error();
+    }
+    SSL_free(tls);
+}
+
+#else // !HAVE_OPENSSL
+
+int tls_init(const char *cert_path, const char *key_path)
+{
+    (void)key_path;
+    LOG_ERROR("Cannot serve TLS with %s: built without OpenSSL", cert_path);
+    return -1;
+}
+
+int tls_enabled(void)
+{
+    return 0;
+}
+
+// Never reached: tls_init() always fails
+
+struct ssl_st *tls_accept(int fd)
+{
+    (void)fd;
+    return NULL;
+}
+
+int tls_handshake(struct ssl_st *tls)
+{
+    (void)tls;
+    return -1;
+}
+
+int tls_resumed(struct ssl_st *tls)
+{
+    (void)tls;
+    return 0;
+}
+
+int tls_kernel_send(struct ssl_st *tls)
+{
+    (void)tls;
+    return 0;
+}
+
+int tls_alpn_h2(struct ssl_st *tls)
+{
+    (void)tls;
+    return 0;
+}
+
+ssize_t tls_recv(struct ssl_st *tls, void *buf, size_t len)
+{
+    (void)tls;
+    (void)buf;
+    (void)len;
+    errno = EPROTO;
+    return -1;
+}
+
+ssize_t tls_send(struct ssl_st *tls, const void *buf, size_t len)
+{
+    (void)tls;
+    (void)buf;
+    (void)len;
+    errno = EPROTO;
+    return -1;
+}
+
+void tls_close(struct ssl_st *tls)
+{
+    (void)tls;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// TLS termination through OpenSSL, compiled in when the Makefile finds its
+// headers (HAVE_OPENSSL). TLS 1.2 and 1.3 only. Once a handshake completes,
+// OpenSSL hands the session keys to the kernel where it can (kTLS): the
+// socket then encrypts whatever is written to it, so sendmsg(), sendfile()
+// and splice() keep working unchanged and file bodies stay zero-copy.
+// Without kernel support, records are encrypted in user space.
+
+struct ssl_st; // OpenSSL's SSL
+
+// Load the certificate chain and private key (PEM) into the context every
+// connection is created from. Returns 0, or -1 after printing why.
+int tls_init(const char *cert_path, const char *key_path);
+
+// 1 once tls_init() succeeded: every accepted connection speaks TLS
+int tls_enabled(void);
+
+// Start the server side of a session on accepted socket `fd`. Returns NULL
+// on failure.
+struct ssl_st *tls_accept(int fd);
+
+// Advance the handshake. Returns 1 once it completed, 0 if the socket would
+// block, -1 if it failed.
+int tls_handshake(struct ssl_st *tls);
+
+// 1 if the completed handshake resumed an earlier session (see tls_session.h)
+int tls_resumed(struct ssl_st *tls);
+
+// 1 if the kernel encrypts what is written to the socket (kTLS transmit)
+int tls_kernel_send(struct ssl_st *tls);
+
+// 1 if the client chose HTTP/2 through ALPN ("h2") during the handshake
+int tls_alpn_h2(struct ssl_st *tls);
+
+// recv()/send() through the session: bytes moved, 0 on a clean close
+// (tls_recv() only), or -1 with errno set, EAGAIN when the socket would
+// block in either direction. A tls_send() that failed with EAGAIN must be
+// retried with the same bytes.
+ssize_t tls_recv(struct ssl_st *tls, void *buf, size_t len);
+ssize_t tls_send(struct ssl_st *tls, const void *buf, size_t len);
+
+// Send close_notify if the socket takes it right away and free the session.
+// The caller closes the socket.
+void tls_close(struct ssl_st *tls);
+
+#endif
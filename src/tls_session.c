@@ -0,0 +1,394 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef HAVE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#endif
+
+#include "tls_session.h"
+#include "server_config.h"
+#include "metrics.h"
+#include "log.h"
+
+#ifdef HAVE_OPENSSL
+
+_Static_assert((TLS_SESSION_STRIPES & (TLS_SESSION_STRIPES - 1)) == 0, "stripe count must be a power of two");
+
+// ----- Session tickets -----
+
+typedef struct
+{
+    unsigned char name[16]; // sent in the clear in every ticket the key sealed
+    unsigned char aes_key[32];
+    unsigned char hmac_key[32];
+    int valid;
+} ticket_key_t;
+
+// keys[0] seals new tickets; all valid keys open them. Rotation happens
+// lazily on the first handshake past next_rotation, which is read without
+// the lock to keep that check off the fast path.
+static struct
+{
+    pthread_rwlock_t lock;
+    ticket_key_t keys[TLS_TICKET_KEYS];
+    _Atomic time_t next_rotation;
+    int interval;
+} tickets = {.lock = PTHREAD_RWLOCK_INITIALIZER};
+
+static int ticket_key_generate(ticket_key_t *key)
+{
+    if (RAND_bytes(key->name, sizeof(key->name)) != 1 || RAND_bytes(key->aes_key, sizeof(key->aes_key)) != 1 ||
+        RAND_bytes(key->hmac_key, sizeof(key->hmac_key)) != 1)
+        return -1;
+    key->valid = 1;
+    return 0;
+}
+
+// Start sealing with a fresh key and shift the older ones down, dropping
+// those that have served their time. After a long idle spell several
+// intervals may have passed at once.
+static void rotate_ticket_keys(time_t now)
+{
+    pthread_rwlock_wrlock(&tickets.lock);
+    time_t next_rotation = atomic_load_explicit(&tickets.next_rotation, memory_order_relaxed);
+    if (now < next_rotation)
+    {
+        pthread_rwlock_unlock(&tickets.lock); // another worker got here first
+        return;
+    }
+
+    ticket_key_t fresh;
+    if (ticket_key_generate(&fresh) < 0)
+    {
+        pthread_rwlock_unlock(&tickets.lock);
+        LOG_ERROR("Failed to generate a session ticket key, keeping the current one");
+        return;
+    }
+
+    time_t elapsed = (now - next_rotation) / tickets.interval + 1;
+    int shift = elapsed < TLS_TICKET_KEYS ? (int)elapsed : TLS_TICKET_KEYS;
+    for (int i = TLS_TICKET_KEYS - 1; i >= 0; i--)
+    {
+        if (i >= shift)
+            tickets.keys[i] = tickets.keys[i - shift];
+        else
+            OPENSSL_cleanse(&tickets.keys[i], sizeof(tickets.keys[i])); // never sealed anything
+    }
+    tickets.keys[0] = fresh;
+    atomic_store_explicit(&tickets.next_rotation, next_rotation + elapsed * tickets.interval, memory_order_relaxed);
+    pthread_rwlock_unlock(&tickets.lock);
+
+    OPENSSL_cleanse(&fresh, sizeof(fresh));
+    LOG_INFO("Rotated session ticket key");
+}
+
+// OpenSSL's ticket key callback: seal a new ticket (encrypt = 1) or find the
+// key that opens a presented one. Returns 1 to proceed, 2 to proceed and
+// reissue the ticket under the current key, 0 if the ticket's key is
+// unknown (full handshake), -1 on error.
+static int ticket_key_callback(SSL *ssl, unsigned char *key_name, unsigned char *iv, EVP_CIPHER_CTX *cipher,
+                               EVP_MAC_CTX *mac, int encrypt)
+{
+    (void)ssl;
+    time_t now = time(NULL);
+    if (now >= atomic_load_explicit(&tickets.next_rotation, memory_order_relaxed))
+        rotate_ticket_keys(now);
+
+    // Work on a copy so the lock is not held during the crypto setup
+    ticket_key_t key;
+    int index = -1;
+    pthread_rwlock_rdlock(&tickets.lock);
+    for (int i = 0; i < (encrypt ? 1 : TLS_TICKET_KEYS); i++)
+    {
+        if (tickets.keys[i].valid && (encrypt || memcmp(key_name, tickets.keys[i].name, sizeof(key.name)) == 0))
+        {
+            key = tickets.keys[i];
+            index = i;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&tickets.lock);
+
+    if (!encrypt)
+        metrics_count_tls_ticket(index >= 0);
+    if (index < 0)
+        return encrypt ? -1 : 0;
+
+    int rc = encrypt ? 1 : index == 0 ? 1 : 2;
+    if (encrypt)
+    {
+        memcpy(key_name, key.name, sizeof(key.name));
+        if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+            rc = -1;
+    }
+
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0),
+        OSSL_PARAM_construct_end(),
+    };
+    if (rc > 0 && (EVP_MAC_init(mac, key.hmac_key, sizeof(key.hmac_key), params) != 1 ||
+                   EVP_CipherInit_ex(cipher, EVP_aes_256_cbc(), NULL, key.aes_key, iv, encrypt) != 1))
+        rc = -1;
+    OPENSSL_cleanse(&key, sizeof(key));
+    return rc;
+}
+
+static int tickets_init(SSL_CTX *ctx)
+{
+    if (server_config.tls_ticket_rotate_sec == 0)
+    {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+        return 0;
+    }
+
+    tickets.interval = server_config.tls_ticket_rotate_sec;
+    if (ticket_key_generate(&tickets.keys[0]) < 0)
+    {
+        LOG_ERROR("Failed to generate a session ticket key");
+        return -1;
+    }
+    atomic_store(&tickets.next_rotation, time(NULL) + tickets.interval);
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_key_callback);
+
+    // A ticket sealed just before its key retires still opens for the
+    // remaining intervals; sessions live exactly that long
+    long lifetime = (long)tickets.interval * (TLS_TICKET_KEYS - 1);
+    SSL_CTX_set_timeout(ctx, lifetime < TLS_TICKET_MAX_LIFETIME ? lifetime : TLS_TICKET_MAX_LIFETIME);
+    return 0;
+}
+
+// ----- Shared session cache -----
+
+// A serialized session, keyed by its session ID
+typedef struct cached_session
+{
+    struct cached_session *hash_next;
+    struct cached_session *lru_prev;
+    struct cached_session *lru_next;
+    time_t expires;
+    unsigned int id_len;
+    unsigned char id[SSL_MAX_SSL_SESSION_ID_LENGTH];
+    size_t der_len;
+    unsigned char der[];
+} cached_session_t;
+
+// One lock's share of the cache: a hash table plus an LRU list for
+// eviction. Stripes sit on their own cache lines so that workers locking
+// different stripes do not contend on the same line.
+typedef struct
+{
+    _Alignas(64) pthread_mutex_t lock;
+    cached_session_t **buckets;
+    size_t bucket_mask;
+    cached_session_t *lru_head; // most recently used
+    cached_session_t *lru_tail;
+    size_t count;
+    size_t capacity;
+} session_stripe_t;
+
+static session_stripe_t stripes[TLS_SESSION_STRIPES];
+
+// FNV-1a. IDs are random, but nothing forces a client to send a real one.
+static uint64_t session_hash(const unsigned char *id, unsigned int len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned int i = 0; i < len; i++)
+        hash = (hash ^ id[i]) * 1099511628211ULL;
+    return hash;
+}
+
+static session_stripe_t *stripe_for(uint64_t hash)
+{
+    return &stripes[hash & (TLS_SESSION_STRIPES - 1)];
+}
+
+static cached_session_t **bucket_for(session_stripe_t *stripe, uint64_t hash)
+{
+    return &stripe->buckets[(hash / TLS_SESSION_STRIPES) & stripe->bucket_mask];
+}
+
+static void lru_unlink(session_stripe_t *stripe, cached_session_t *entry)
+{
+    if (entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        stripe->lru_head = entry->lru_next;
+    if (entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        stripe->lru_tail = entry->lru_prev;
+}
+
+static void lru_push(session_stripe_t *stripe, cached_session_t *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = stripe->lru_head;
+    if (stripe->lru_head)
+        stripe->lru_head->lru_prev = entry;
+    else
+        stripe->lru_tail = entry;
+    stripe->lru_head = entry;
+}
+
+// Slot pointing at the entry for `id`, or at the NULL ending its chain.
+// Caller holds the stripe lock.
+static cached_session_t **session_find(session_stripe_t *stripe, uint64_t hash, const unsigned char *id,
+                                       unsigned int id_len)
+{
+    cached_session_t **slot = bucket_for(stripe, hash);
+    while (*slot && ((*slot)->id_len != id_len || memcmp((*slot)->id, id, id_len) != 0))
+        slot = &(*slot)->hash_next;
+    return slot;
+}
+
+// Unlink and free the entry at `slot`. Caller holds the stripe lock.
+static void session_remove(session_stripe_t *stripe, cached_session_t **slot)
+{
+    cached_session_t *entry = *slot;
+    *slot = entry->hash_next;
+    lru_unlink(stripe, entry);
+    stripe->count--;
+    OPENSSL_cleanse(entry->der, entry->der_len);
+    free(entry);
+}
+
+// A full handshake created `session`. Returns 0: the cache keeps a
+// serialized copy, not OpenSSL's reference.
+static int session_cache_add(SSL *ssl, SSL_SESSION *session)
+{
+    (void)ssl;
+    unsigned int id_len;
+    const unsigned char *id = SSL_SESSION_get_id(session, &id_len);
+
+    // TLS 1.3 sessions resume from their tickets, which hold all the state
+    if (id_len == 0 || (SSL_SESSION_get_protocol_version(session) == TLS1_3_VERSION &&
+                        server_config.tls_ticket_rotate_sec > 0))
+        return 0;
+
+    int der_len = i2d_SSL_SESSION(session, NULL);
+    if (der_len <= 0 || der_len > TLS_SESSION_MAX_DER)
+        return 0;
+    cached_session_t *entry = malloc(sizeof(*entry) + (size_t)der_len);
+    if (!entry)
+        return 0;
+    unsigned char *der = entry->der;
+    entry->der_len = (size_t)i2d_SSL_SESSION(session, &der);
+    entry->expires = (time_t)SSL_SESSION_get_time(session) + (time_t)SSL_SESSION_get_timeout(session);
+    entry->id_len = id_len;
+    memcpy(entry->id, id, id_len);
+
+    uint64_t hash = session_hash(id, id_len);
+    session_stripe_t *stripe = stripe_for(hash);
+    pthread_mutex_lock(&stripe->lock);
+    cached_session_t **slot = session_find(stripe, hash, id, id_len);
+    if (*slot)
+        session_remove(stripe, slot);
+    if (stripe->count == stripe->capacity)
+    {
+        cached_session_t *oldest = stripe->lru_tail;
+        session_remove(stripe, session_find(stripe, session_hash(oldest->id, oldest->id_len), oldest->id,
+                                            oldest->id_len));
+        slot = session_find(stripe, hash, id, id_len); // the chain may have changed
+    }
+    entry->hash_next = NULL;
+    *slot = entry;
+    lru_push(stripe, entry);
+    stripe->count++;
+    pthread_mutex_unlock(&stripe->lock);
+    return 0;
+}
+
+// A TLS 1.2 client offered session ID `id`. Returns a new session for
+// OpenSSL to own (*copy = 0), or NULL for a full handshake.
+static SSL_SESSION *session_cache_get(SSL *ssl, const unsigned char *id, int id_len, int *copy)
+{
+    (void)ssl;
+    *copy = 0;
+    if (id_len <= 0 || id_len > SSL_MAX_SSL_SESSION_ID_LENGTH)
+        return NULL;
+
+    // Decode outside the lock from a copy
+    unsigned char der[TLS_SESSION_MAX_DER];
+    size_t der_len = 0;
+    uint64_t hash = session_hash(id, (unsigned int)id_len);
+    session_stripe_t *stripe = stripe_for(hash);
+    pthread_mutex_lock(&stripe->lock);
+    cached_session_t **slot = session_find(stripe, hash, id, (unsigned int)id_len);
+    if (*slot && (*slot)->expires <= time(NULL))
+    {
+        session_remove(stripe, slot);
+    }
+    else if (*slot)
+    {
+        cached_session_t *entry = *slot;
+        der_len = entry->der_len;
+        memcpy(der, entry->der, der_len);
+        lru_unlink(stripe, entry);
+        lru_push(stripe, entry);
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    metrics_count_tls_session_cache(der_len > 0);
+    if (der_len == 0)
+        return NULL;
+
+    const unsigned char *p = der;
+    SSL_SESSION *session = d2i_SSL_SESSION(NULL, &p, (long)der_len);
+    OPENSSL_cleanse(der, der_len);
+    return session;
+}
+
+static int session_cache_init(SSL_CTX *ctx)
+{
+    size_t size = server_config.tls_session_cache_size;
+    if (size == 0)
+    {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+        return 0;
+    }
+
+    size_t capacity = (size + TLS_SESSION_STRIPES - 1) / TLS_SESSION_STRIPES;
+    size_t bucket_count = 1;
+    while (bucket_count < capacity)
+        bucket_count <<= 1;
+
+    for (int i = 0; i < TLS_SESSION_STRIPES; i++)
+    {
+        session_stripe_t *stripe = &stripes[i];
+        stripe->buckets = calloc(bucket_count, sizeof(*stripe->buckets));
+        if (!stripe->buckets)
+        {
+            LOG_ERROR("Failed to allocate the TLS session cache");
+            return -1;
+        }
+        pthread_mutex_init(&stripe->lock, NULL);
+        stripe->bucket_mask = bucket_count - 1;
+        stripe->capacity = capacity;
+    }
+
+    // OpenSSL's own cache is one table under one lock: bypass it entirely
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(ctx, session_cache_add);
+    SSL_CTX_sess_set_get_cb(ctx, session_cache_get);
+    return 0;
+}
+
+int tls_session_init(SSL_CTX *ctx)
+{
+    // Resumed TLS 1.3 clients that offer it (psk_ke) skip the key exchange
+    // too, at the cost of forward secrecy for that connection
+    SSL_CTX_set_options(ctx, SSL_OP_ALLOW_NO_DHE_KEX);
+
+    if (tickets_init(ctx) < 0 || session_cache_init(ctx) < 0)
+        return -1;
+    return 0;
+}
+
+#endif
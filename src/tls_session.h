@@ -0,0 +1,29 @@
+#ifndef TLS_SESSION_H
+#define TLS_SESSION_H
+
+// TLS session resumption, so returning clients skip the certificate
+// signature and key exchange of a full handshake:
+//
+// - Session tickets (TLS 1.3 PSK and TLS 1.2 RFC 5077): the session state
+//   travels with the client, encrypted under a key every worker shares.
+//   The key is replaced every tls_ticket_rotate_sec; the previous ones keep
+//   decrypting for TLS_TICKET_KEYS - 1 more intervals, and a ticket under an
+//   old key is renewed on use.
+// - A session ID cache for TLS 1.2 clients without ticket support, shared
+//   by all workers and split into TLS_SESSION_STRIPES independently locked
+//   stripes so concurrent handshakes rarely wait for one another.
+//
+// Hits and misses of both are counted in the metrics.
+
+#define TLS_TICKET_KEYS 3         // current key plus the ones still accepted
+#define TLS_SESSION_STRIPES 16    // session cache locks
+#define TLS_SESSION_MAX_DER 1024  // larger serialized sessions are not cached
+#define TLS_TICKET_MAX_LIFETIME (7 * 24 * 3600) // RFC 8446 section 4.6.1
+
+struct ssl_ctx_st; // OpenSSL's SSL_CTX
+
+// Install ticket keys and the session cache on `ctx`, as configured.
+// Returns 0, or -1 after logging why.
+int tls_session_init(struct ssl_ctx_st *ctx);
+
+#endif
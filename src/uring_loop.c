@@ -0,0 +1,821 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+
+#include "uring_loop.h"
+#include "connection.h"
+#include "timer_list.h"
+#include "http_errors.h"
+#include "server_config.h"
+#include "metrics.h"
+#include "log.h"
+
+#define URING_ENTRIES 1024
+#define URING_BUF_COUNT 256 // provided receive buffers per worker (power of two)
+#define URING_BUF_SIZE 8192
+#define URING_BUF_GROUP 0
+#define PIPE_PIECE 65536 // bytes moved per file <-> pipe <-> socket round (default pipe capacity)
+
+// Operation tag stored in the low bits of user_data (connections are at least 8-byte aligned)
+enum
+{
+    OP_ACCEPT = 0,
+    OP_RECV = 1,
+    OP_SEND = 2,
+    OP_FILE_SPLICE = 3,
+    OP_TICK = 4,
+    OP_BODY_POLL = 5,  // wait for streamed body bytes
+    OP_BODY_RECV = 6,  // socket -> pipe
+    OP_BODY_STORE = 7, // pipe -> body file
+};
+#define OP_MASK 7ULL
+
+typedef struct
+{
+    int fd;
+
+    // Submission queue
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned sq_local_tail;
+    unsigned to_submit;
+    struct io_uring_sqe *sqes;
+
+    // Completion queue
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Mappings
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    // Provided receive buffers
+    struct io_uring_buf_ring *buf_ring;
+    size_t buf_ring_size;
+    char *buf_base;
+    unsigned short buf_tail;
+} uring_t;
+
+struct uring_loop
+{
+    uring_t ring;
+    int listen_fd;
+    int multishot_accept; // cleared if the kernel rejects IORING_ACCEPT_MULTISHOT
+    size_t connection_count;
+    timer_list_t read_timers;
+    timer_list_t keep_alive_timers;
+    struct __kernel_timespec tick;
+};
+
+// ----- Raw ring plumbing (no liburing dependency) -----
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void uring_unmap(uring_t *ring)
+{
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->buf_ring)
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    free(ring->buf_base);
+    if (ring->fd >= 0)
+        close(ring->fd);
+}
+
+static void uring_recycle_buffer(uring_t *ring, unsigned short bid)
+{
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ring->buf_base + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ring->buf_tail++;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+static int uring_init(uring_t *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = URING_ENTRIES * 4;
+
+    ring->fd = sys_io_uring_setup(URING_ENTRIES, &params);
+    if (ring->fd < 0 && errno == EINVAL)
+    {
+        // Older kernel: retry without the optional setup flags
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = URING_ENTRIES * 4;
+        ring->fd = sys_io_uring_setup(URING_ENTRIES, &params);
+    }
+    if (ring->fd < 0)
+    {
+        perror("io_uring_setup() failed");
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+            ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        goto fail;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            goto fail;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+
+    char *cq = ring->cq_ring;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // Provided buffer ring: the kernel picks a free buffer when data arrives,
+    // so idle connections do not pin receive memory
+    ring->buf_ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring->buf_ring == MAP_FAILED)
+    {
+        ring->buf_ring = NULL;
+        goto fail;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        perror("io_uring provided buffer ring unavailable");
+        goto fail;
+    }
+
+    ring->buf_base = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (!ring->buf_base)
+        goto fail;
+    for (unsigned short i = 0; i < URING_BUF_COUNT; i++)
+        uring_recycle_buffer(ring, i);
+
+    return 0;
+
+fail:
+    uring_unmap(ring);
+    return -1;
+}
+
+// Hand queued SQEs to the kernel and optionally wait for one completion
+static int uring_submit(uring_t *ring, unsigned wait_nr)
+{
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    for (;;)
+    {
+        int rc = sys_io_uring_enter(ring->fd, ring->to_submit, wait_nr,
+                                    wait_nr ? IORING_ENTER_GETEVENTS : 0);
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EBUSY || errno == EAGAIN)
+                return 0; // completion queue backed up: reap first, submit later
+            LOG_ERROR("io_uring_enter() failed: %s", strerror(errno));
+            return -1;
+        }
+        ring->to_submit -= (unsigned)rc;
+        return 0;
+    }
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->sq_entries)
+    {
+        // Submission queue full: push what we have to the kernel first
+        if (uring_submit(ring, 0) < 0)
+            return NULL;
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_local_tail - head >= ring->sq_entries)
+            return NULL;
+    }
+
+    unsigned index = ring->sq_local_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+    ring->to_submit++;
+    return sqe;
+}
+
+static uint64_t op_data(connection_t *conn, unsigned op)
+{
+    return (uint64_t)(uintptr_t)conn | op;
+}
+
+// ----- Connection operations -----
+
+static void close_connection(uring_loop_t *loop, connection_t *conn)
+{
+    if (conn->closing)
+        return;
+
+    conn->closing = 1;
+    timer_unlink(conn);
+    loop->connection_count--;
+    LOG_DEBUG("Connection closed");
+
+    if (conn->inflight > 0)
+        shutdown(conn->fd, SHUT_RDWR); // completes the pending ops; destroyed on the last CQE
+    else
+        connection_destroy(conn);
+}
+
+static void touch_connection(uring_loop_t *loop, connection_t *conn)
+{
+    timer_touch(connection_is_idle(conn) ? &loop->keep_alive_timers : &loop->read_timers, conn);
+}
+
+static int arm_accept(uring_loop_t *loop)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    if (!sqe)
+        return -1;
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->listen_fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (loop->multishot_accept)
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = op_data(NULL, OP_ACCEPT);
+    return 0;
+}
+
+static int arm_tick(uring_loop_t *loop)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    if (!sqe)
+        return -1;
+
+    // Fires once a second to expire timed out connections
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&loop->tick;
+    sqe->len = 1;
+    sqe->user_data = op_data(NULL, OP_TICK);
+    return 0;
+}
+
+// Returns 0 on success, 1 if the request buffer is full, -1 if no SQE was available
+static int arm_recv(uring_loop_t *loop, connection_t *conn)
+{
+    size_t space = MAX_REQUEST_SIZE - conn->buffer_len;
+    if (space == 0)
+        return 1;
+
+    struct io_uring_sqe *sqe = uring_get_sqe(&loop->ring);
+    if (!sqe)
+        return -1;
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->len = (unsigned)(space < URING_BUF_SIZE ? space : URING_BUF_SIZE);
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = op_data(conn, OP_RECV);
+    conn->inflight++;
+    return 0;
+}
+
+static void prep_splice(struct io_uring_sqe *sqe, int fd_in, int64_t off_in, int fd_out, size_t len)
+{
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = fd_in;
+    sqe->splice_off_in = (uint64_t)off_in;
+    sqe->fd = fd_out;
+    sqe->off = (uint64_t)-1; // pipe/socket side has no offset
+    sqe->len = (unsigned)len;
+    sqe->splice_flags = SPLICE_F_MOVE;
+}
+
+// Submit the next write for the head of the response queue
+static int arm_send(uring_loop_t *loop, connection_t *conn)
+{
+    out_chunk_t *chunk = conn->out_head;
+    struct io_uring_sqe *sqe;
+
+    if (chunk->fd < 0)
+    {
+        sqe = uring_get_sqe(&loop->ring);
+        if (!sqe)
+            return -1;
+
+        // Consecutive memory chunks (a pipelined batch) go out in one SENDMSG
+        int more;
+        memset(&conn->send_msg, 0, sizeof(conn->send_msg));
+        conn->send_msg.msg_iov = conn->send_iov;
+        conn->send_msg.msg_iovlen = (size_t)connection_gather_iov(conn, conn->send_iov, CONN_SEND_IOV, &more);
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn->fd;
+        sqe->addr = (uint64_t)(uintptr_t)&conn->send_msg;
+        sqe->len = 1;
+        // Headers followed by a file body leave in the same segment
+        sqe->msg_flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+        sqe->user_data = op_data(conn, OP_SEND);
+        conn->inflight++;
+        return 0;
+    }
+
+    if (connection_open_pipe(conn) < 0)
+        return -1;
+
+    if (conn->pipe_pending > 0)
+    {
+        // Finish a short send of the piece already in the pipe
+        sqe = uring_get_sqe(&loop->ring);
+        if (!sqe)
+            return -1;
+        prep_splice(sqe, conn->pipe_fds[0], -1, conn->fd, conn->pipe_pending);
+        sqe->user_data = op_data(conn, OP_SEND);
+        conn->inflight++;
+        return 0;
+    }
+
+    // The pipe holds PIPE_PIECE / 4096 pages: a piece starting mid-page (a
+    // byte range) must end on a page boundary or the file splice comes up short
+    size_t piece = PIPE_PIECE - (size_t)(chunk->offset & 4095);
+    if (piece > chunk->remain)
+        piece = chunk->remain;
+    conn->pipe_pending = piece;
+
+    // Linked pair, zero-copy: splice the next file piece into the pipe, then
+    // from the pipe into the socket once it lands
+    sqe = uring_get_sqe(&loop->ring);
+    if (!sqe)
+        return -1;
+    prep_splice(sqe, chunk->fd, (int64_t)chunk->offset, conn->pipe_fds[1], piece);
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = op_data(conn, OP_FILE_SPLICE);
+    conn->inflight++;
+
+    sqe = uring_get_sqe(&loop->ring);
+    if (!sqe)
+        return -1;
+    prep_splice(sqe, conn->pipe_fds[0], -1, conn->fd, piece);
+    sqe->user_data = op_data(conn, OP_SEND);
+    conn->inflight++;
+    return 0;
+}
+
+// Move the next piece of a streamed body: drain the pipe into the file, or
+// refill it from the socket. The socket splice runs behind a poll because the
+// non-blocking pipe would make it fail with EAGAIN while no data is waiting.
+static int arm_body_splice(uring_loop_t *loop, connection_t *conn)
+{
+    if (connection_open_pipe(conn) < 0)
+        return -1;
+
+    struct io_uring_sqe *sqe;
+    if (conn->pipe_pending > 0)
+    {
+        sqe = uring_get_sqe(&loop->ring);
+        if (!sqe)
+            return -1;
+        prep_splice(sqe, conn->pipe_fds[0], -1, conn->body_fd, conn->pipe_pending);
+        sqe->off = (uint64_t)conn->body_offset;
+        sqe->user_data = op_data(conn, OP_BODY_STORE);
+        conn->inflight++;
+        return 0;
+    }
+
+    sqe = uring_get_sqe(&loop->ring);
+    if (!sqe)
+        return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = conn->fd;
+    sqe->poll32_events = POLLIN | POLLRDHUP;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = op_data(conn, OP_BODY_POLL);
+    conn->inflight++;
+
+    sqe = uring_get_sqe(&loop->ring);
+    if (!sqe)
+        return -1;
+    size_t piece = conn->body_remaining < PIPE_PIECE ? conn->body_remaining : PIPE_PIECE;
+    prep_splice(sqe, conn->fd, -1, conn->pipe_fds[1], piece);
+    sqe->user_data = op_data(conn, OP_BODY_RECV);
+    conn->inflight++;
+    return 0;
+}
+
+// Submit whatever the state machine needs next: a send while a response is
+// queued, otherwise a receive for the next request (or the next piece of a
+// body streamed to disk)
+static void advance(uring_loop_t *loop, connection_t *conn)
+{
+    for (;;)
+    {
+        if (conn->state == CONN_WRITING)
+        {
+            if (conn->out_head)
+            {
+                if (arm_send(loop, conn) < 0)
+                    close_connection(loop, conn);
+                return;
+            }
+
+            if (!connection_on_response_sent(conn))
+            {
+                close_connection(loop, conn);
+                return;
+            }
+            continue;
+        }
+
+        if (connection_splices_body(conn))
+        {
+            if (arm_body_splice(loop, conn) < 0)
+                close_connection(loop, conn);
+            else
+                touch_connection(loop, conn);
+            return;
+        }
+
+        int rc = arm_recv(loop, conn);
+        if (rc < 0)
+        {
+            close_connection(loop, conn);
+            return;
+        }
+        if (rc > 0)
+        {
+            connection_on_read_error(conn, conn->state == CONN_READ_HEADERS ? HTTP_PARSE_ERROR : HTTP_BODY_TOO_LARGE);
+            continue;
+        }
+        touch_connection(loop, conn);
+        return;
+    }
+}
+
+// ----- Completion handlers -----
+
+static void on_accept(uring_loop_t *loop, struct io_uring_cqe *cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        if (cqe->res == -EINVAL && loop->multishot_accept)
+        {
+            LOG_INFO("Multishot accept unsupported, using single-shot accept");
+            loop->multishot_accept = 0;
+        }
+        arm_accept(loop);
+    }
+
+    if (cqe->res < 0)
+    {
+        if (cqe->res != -EINVAL)
+            LOG_WARN("accept() failed: %s", strerror(-cqe->res));
+        return;
+    }
+
+    int client_fd = cqe->res;
+    connection_t *conn = connection_create(client_fd);
+    if (!conn)
+    {
+        LOG_ERROR("Failed to allocate connection");
+        close(client_fd);
+        return;
+    }
+
+    loop->connection_count++;
+
+    // Multishot accept does not return the address: ask only if it is logged
+    if (log_access_enabled() || LOG_ENABLED(LOG_LEVEL_DEBUG))
+    {
+        socklen_t client_len = sizeof(conn->peer);
+        if (getpeername(client_fd, (struct sockaddr *)&conn->peer, &client_len) == 0)
+        {
+            LOG_DEBUG("New connection from %s:%d",
+                      inet_ntoa(conn->peer.sin_addr),
+                      ntohs(conn->peer.sin_port));
+        }
+    }
+
+    advance(loop, conn);
+}
+
+static void on_recv(uring_loop_t *loop, connection_t *conn, struct io_uring_cqe *cqe)
+{
+    if (cqe->res == -ENOBUFS)
+    {
+        // All provided buffers were in use; they are recycled by now
+        advance(loop, conn);
+        return;
+    }
+
+    if (cqe->res <= 0)
+    {
+        if (cqe->res < 0)
+            LOG_WARN("recv() failed: %s", strerror(-cqe->res));
+        connection_on_read_error(conn, cqe->res == 0 ? HTTP_IO_EOF : HTTP_IO_ERROR);
+        advance(loop, conn);
+        return;
+    }
+
+    unsigned short bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    const char *data = loop->ring.buf_base + (size_t)bid * URING_BUF_SIZE;
+    int rc = connection_append(conn, data, (size_t)cqe->res);
+    uring_recycle_buffer(&loop->ring, bid);
+
+    if (rc < 0)
+    {
+        connection_on_read_error(conn, rc);
+    }
+    else
+    {
+        LOG_DEBUG("Read %d bytes (total: %zu)", cqe->res, conn->buffer_len);
+        connection_process_input(conn);
+    }
+    advance(loop, conn);
+}
+
+static void on_send(uring_loop_t *loop, connection_t *conn, struct io_uring_cqe *cqe)
+{
+    if (cqe->res < 0)
+    {
+        if (cqe->res != -ECANCELED)
+            LOG_WARN("send() failed: %s", strerror(-cqe->res));
+        close_connection(loop, conn);
+        return;
+    }
+
+    out_chunk_t *chunk = conn->out_head;
+    size_t sent = (size_t)cqe->res;
+    metrics_count_bytes_out(sent);
+    if (chunk->fd >= 0)
+    {
+        conn->pipe_pending -= sent;
+        chunk->offset += sent;
+        chunk->remain -= sent;
+        if (chunk->remain == 0)
+            connection_pop_chunk(conn);
+    }
+    else
+    {
+        connection_advance_sent(conn, sent);
+    }
+
+    touch_connection(loop, conn);
+    advance(loop, conn);
+}
+
+static void on_file_splice(uring_loop_t *loop, connection_t *conn, struct io_uring_cqe *cqe)
+{
+    // The linked socket splice was sized for the full piece, so anything short
+    // of that (file truncated underneath us) leaves the response unusable
+    if (cqe->res < 0 || (size_t)cqe->res != conn->pipe_pending)
+    {
+        LOG_WARN("file splice failed: %s", cqe->res < 0 ? strerror(-cqe->res) : "short read");
+        close_connection(loop, conn);
+    }
+}
+
+static void on_body_recv(uring_loop_t *loop, connection_t *conn, struct io_uring_cqe *cqe)
+{
+    if (cqe->res == -EAGAIN)
+    {
+        advance(loop, conn); // woken without data: poll again
+        return;
+    }
+
+    if (cqe->res <= 0)
+    {
+        if (cqe->res < 0)
+            LOG_WARN("body splice from socket failed: %s", strerror(-cqe->res));
+        connection_on_read_error(conn, cqe->res == 0 ? HTTP_IO_EOF : HTTP_IO_ERROR);
+    }
+    else
+    {
+        connection_body_received(conn, (size_t)cqe->res);
+        touch_connection(loop, conn);
+    }
+    advance(loop, conn);
+}
+
+static void on_body_store(uring_loop_t *loop, connection_t *conn, struct io_uring_cqe *cqe)
+{
+    if (cqe->res <= 0)
+    {
+        LOG_ERROR("Failed to store request body: %s", cqe->res < 0 ? strerror(-cqe->res) : "no progress");
+        connection_body_store_failed(conn);
+    }
+    else
+    {
+        connection_body_stored(conn, (size_t)cqe->res);
+    }
+    advance(loop, conn);
+}
+
+static void expire_timers(uring_loop_t *loop, timer_list_t *list, long long now)
+{
+    while (list->head && list->head->deadline <= now)
+    {
+        connection_t *conn = list->head;
+        if (conn->state != CONN_WRITING)
+            connection_on_timeout(conn);
+        close_connection(loop, conn);
+    }
+}
+
+static void handle_completion(uring_loop_t *loop, struct io_uring_cqe *cqe)
+{
+    unsigned op = (unsigned)(cqe->user_data & OP_MASK);
+    connection_t *conn = (connection_t *)(uintptr_t)(cqe->user_data & ~OP_MASK);
+
+    if (op == OP_ACCEPT)
+    {
+        on_accept(loop, cqe);
+        return;
+    }
+    if (op == OP_TICK)
+    {
+        long long now = monotonic_seconds();
+        expire_timers(loop, &loop->read_timers, now);
+        expire_timers(loop, &loop->keep_alive_timers, now);
+        arm_tick(loop);
+        return;
+    }
+
+    conn->inflight--;
+    if (conn->closing)
+    {
+        if (op == OP_RECV && cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+            uring_recycle_buffer(&loop->ring, (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+        if (conn->inflight == 0)
+            connection_destroy(conn);
+        return;
+    }
+
+    switch (op)
+    {
+    case OP_RECV:
+        on_recv(loop, conn, cqe);
+        break;
+    case OP_SEND:
+        on_send(loop, conn, cqe);
+        break;
+    case OP_FILE_SPLICE:
+        on_file_splice(loop, conn, cqe);
+        break;
+    case OP_BODY_RECV:
+        on_body_recv(loop, conn, cqe);
+        break;
+    case OP_BODY_STORE:
+        on_body_store(loop, conn, cqe);
+        break;
+    default: // OP_BODY_POLL: its linked splice reports the outcome
+        break;
+    }
+}
+
+// ----- Loop -----
+
+uring_loop_t *uring_loop_create(int listen_fd)
+{
+    uring_loop_t *loop = calloc(1, sizeof(*loop));
+    if (!loop)
+        return NULL;
+
+    if (uring_init(&loop->ring) < 0)
+    {
+        free(loop);
+        return NULL;
+    }
+
+    loop->listen_fd = listen_fd;
+    loop->multishot_accept = 1;
+    loop->read_timers.timeout_sec = READ_TIMEOUT_SEC;
+    loop->keep_alive_timers.timeout_sec = KEEP_ALIVE_TIMEOUT_SEC;
+    loop->tick.tv_sec = 1;
+    loop->tick.tv_nsec = 0;
+
+    if (arm_accept(loop) < 0 || arm_tick(loop) < 0)
+    {
+        uring_loop_destroy(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+void uring_loop_run(uring_loop_t *loop)
+{
+    uring_t *ring = &loop->ring;
+
+    while (1)
+    {
+        if (uring_submit(ring, 1) < 0)
+            return;
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail)
+        {
+            struct io_uring_cqe cqe = ring->cqes[head & *ring->cq_mask];
+            head++;
+            // Release the slot before handling: handlers may submit and reap again
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+            handle_completion(loop, &cqe);
+            tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        }
+    }
+}
+
+void uring_loop_destroy(uring_loop_t *loop)
+{
+    if (!loop)
+        return;
+    uring_unmap(&loop->ring);
+    free(loop);
+}
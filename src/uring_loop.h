@@ -0,0 +1,21 @@
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+// Completion-based alternative to the epoll reactor (Linux io_uring).
+// Accepts with a multishot ACCEPT, receives into a ring of kernel-provided
+// buffers and sends file bodies as linked file -> pipe -> socket SPLICE
+// pairs, so a request costs one io_uring_enter() per batch instead of a
+// syscall per operation.
+// Drives the same connection state machine as event_loop.c.
+typedef struct uring_loop uring_loop_t;
+
+// Sets up the ring and buffer group for `listen_fd`. Returns NULL when the
+// kernel lacks io_uring or provided buffer rings; callers fall back to epoll.
+uring_loop_t *uring_loop_create(int listen_fd);
+
+// Runs the completion loop. Only returns on a fatal ring error.
+void uring_loop_run(uring_loop_t *loop);
+
+void uring_loop_destroy(uring_loop_t *loop);
+
+#endif
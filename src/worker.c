@@ -0,0 +1,172 @@
+#define _GNU_SOURCE // CPU_SET(), pthread_setaffinity_np()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "worker.h"
+#include "http_scan.h"
+#include "tls.h"
+#include "log.h"
+
+// Create a non-blocking listening socket. SO_REUSEPORT lets every worker bind
+// the same port; the kernel then spreads incoming connections across them.
+static int open_listen_socket(int port)
+{
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server_fd < 0)
+    {
+        perror("socket() failed");
+        return -1;
+    }
+
+    int opt = 1;
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        perror("setsockopt() failed");
+        close(server_fd);
+        return -1;
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+
+    if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    {
+        perror("bind() failed");
+        close(server_fd);
+        return -1;
+    }
+
+    if (listen(server_fd, SOMAXCONN) < 0)
+    {
+        perror("listen() failed");
+        close(server_fd);
+        return -1;
+    }
+
+    return server_fd;
+}
+
+static void *worker_main(void *arg)
+{
+    worker_t *worker = arg;
+
+    if (worker->cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker->cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0)
+            LOG_WARN("Worker %d: failed to pin to CPU %d: %s", worker->id, worker->cpu, strerror(rc));
+    }
+
+    if (worker->uring)
+        uring_loop_run(worker->uring);
+    else
+        event_loop_run(&worker->loop);
+    return NULL;
+}
+
+int workers_run(const server_config_t *config)
+{
+    int count = config->workers > 0 ? config->workers : 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        cpus = 1;
+
+    worker_t *workers = calloc((size_t)count, sizeof(*workers));
+    if (!workers)
+    {
+        fprintf(stderr, "Failed to allocate workers\n");
+        return -1;
+    }
+
+    // Open every listener before starting threads so a bind failure aborts cleanly
+    int started = 0;
+    int uring_unavailable = 0;
+    if (config->io_backend == IO_BACKEND_IO_URING && tls_enabled())
+    {
+        // Its completions carry ciphertext the connection code never sees
+        LOG_WARN("io_uring backend does not support TLS, falling back to epoll");
+        uring_unavailable = 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        worker_t *worker = &workers[i];
+        worker->id = i;
+        worker->cpu = config->pin_workers ? (int)(i % cpus) : -1;
+        worker->listen_fd = open_listen_socket(config->port);
+        if (worker->listen_fd < 0)
+            goto fail;
+
+        if (config->io_backend == IO_BACKEND_IO_URING && !uring_unavailable)
+        {
+            worker->uring = uring_loop_create(worker->listen_fd);
+            if (!worker->uring)
+            {
+                // Keep the portable path: every worker falls back to epoll
+                LOG_WARN("io_uring unavailable, falling back to epoll");
+                uring_unavailable = 1;
+                for (int j = 0; j < i; j++)
+                {
+                    uring_loop_destroy(workers[j].uring);
+                    workers[j].uring = NULL;
+                    if (event_loop_init(&workers[j].loop, workers[j].listen_fd) < 0)
+                        goto fail;
+                }
+            }
+        }
+        if (!worker->uring && event_loop_init(&worker->loop, worker->listen_fd) < 0)
+            goto fail;
+        started++;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        int rc = pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+        if (rc != 0)
+        {
+            fprintf(stderr, "Failed to start worker %d: %s\n", i, strerror(rc));
+            exit(1); // running workers never return, nothing to unwind
+        }
+    }
+
+    LOG_INFO("Server listening on %s://localhost:%d (%d worker%s, %s%s, %s parser)",
+             tls_enabled() ? "https" : "http", config->port, count, count == 1 ? "" : "s",
+             workers[0].uring ? "io_uring" : "epoll",
+             config->pin_workers ? ", pinned" : "",
+             http_scan_impl_name());
+
+    for (int i = 0; i < count; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    for (int i = 0; i < count; i++)
+        close(workers[i].listen_fd);
+    free(workers);
+    return 0;
+
+fail:
+    for (int i = 0; i < started; i++)
+    {
+        if (workers[i].uring)
+            uring_loop_destroy(workers[i].uring);
+        else
+            close(workers[i].loop.epoll_fd);
+        close(workers[i].listen_fd);
+    }
+    if (workers[started].listen_fd >= 0)
+        close(workers[started].listen_fd);
+    free(workers);
+    return -1;
+}
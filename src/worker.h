@@ -0,0 +1,26 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <pthread.h>
+
+#include "event_loop.h"
+#include "uring_loop.h"
+#include "server_config.h"
+
+// One reactor thread. Owns its listening socket and connection table; nothing
+// on the request path is shared with other workers.
+typedef struct
+{
+    int id;
+    int cpu; // CPU the thread is pinned to, -1 if unpinned
+    int listen_fd;
+    pthread_t thread;
+    event_loop_t loop;
+    uring_loop_t *uring; // set when the io_uring backend is in use
+} worker_t;
+
+// Opens one SO_REUSEPORT listener per worker, starts the worker threads and
+// waits for them. Only returns if startup fails (-1) or every worker exits (0).
+int workers_run(const server_config_t *config);
+
+#endif
@@ -0,0 +1,161 @@
+// Generates src/http_perfect_hash.h: minimal perfect hash tables for the
+// header names in src/http_headers.def and the methods in src/http_methods.def.
+//
+// Hash and displace: keys are grouped into buckets by their hash, then each
+// bucket (largest first) gets the smallest displacement that moves all of its
+// keys into free slots. With as many slots as keys, a lookup costs one key
+// hash, one displacement read and one comparison against the slot's key.
+//
+// Usage: gen_perfect_hash > src/http_perfect_hash.h  (run by `make`)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "perfect_hash.h"
+
+#define MAX_DISPLACEMENT 1000000
+
+typedef struct
+{
+    const char *name;
+    size_t len;
+    uint64_t hash;
+} hash_key_t;
+
+typedef struct
+{
+    size_t index; // hash bucket this is, kept across sorting
+    int keys[16];
+    int count;
+} bucket_t;
+
+static const char *header_names[] = {
+#define HTTP_HEADER(id, name, value_case_insensitive, trim_ows) name,
+#include "http_headers.def"
+#undef HTTP_HEADER
+};
+
+static const char *method_names[] = {
+#define HTTP_METHOD(name) #name,
+#include "http_methods.def"
+#undef HTTP_METHOD
+};
+
+static int compare_bucket_size(const void *a, const void *b)
+{
+    return ((const bucket_t *)b)->count - ((const bucket_t *)a)->count;
+}
+
+// Build and print the tables for `names`, with macros named MACRO_HASH_* and
+// arrays named table_hash_*. Returns 0 or -1.
+static int generate(const char *macro, const char *table, const char *const *names, size_t count)
+{
+    size_t size = count;
+    size_t bucket_count = count / 2 + 1;
+
+    hash_key_t *keys = calloc(count, sizeof(*keys));
+    bucket_t *buckets = calloc(bucket_count, sizeof(*buckets));
+    uint32_t *displacement = calloc(bucket_count, sizeof(*displacement));
+    int *slots = malloc(size * sizeof(*slots));
+    if (!keys || !buckets || !displacement || !slots)
+    {
+        fprintf(stderr, "%s: out of memory\n", table);
+        return -1;
+    }
+
+    for (size_t i = 0; i < size; i++)
+        slots[i] = -1;
+    for (size_t b = 0; b < bucket_count; b++)
+        buckets[b].index = b;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        keys[i].name = names[i];
+        keys[i].len = strlen(names[i]);
+        keys[i].hash = perfect_hash_key(names[i], keys[i].len);
+
+        bucket_t *bucket = &buckets[(uint32_t)keys[i].hash % bucket_count];
+        if (bucket->count == (int)(sizeof(bucket->keys) / sizeof(bucket->keys[0])))
+        {
+            fprintf(stderr, "%s: too many keys share a bucket\n", table);
+            return -1;
+        }
+        bucket->keys[bucket->count++] = (int)i;
+    }
+
+    // Place the most crowded buckets first while the table is still empty
+    qsort(buckets, bucket_count, sizeof(*buckets), compare_bucket_size);
+
+    for (size_t b = 0; b < bucket_count && buckets[b].count > 0; b++)
+    {
+        bucket_t *bucket = &buckets[b];
+        uint32_t d;
+        for (d = 0; d < MAX_DISPLACEMENT; d++)
+        {
+            size_t taken[16];
+            int ok = 1;
+            for (int k = 0; k < bucket->count && ok; k++)
+            {
+                size_t slot = perfect_hash_slot(keys[bucket->keys[k]].hash, d) % size;
+                if (slots[slot] != -1)
+                    ok = 0;
+                for (int j = 0; j < k && ok; j++)
+                {
+                    if (taken[j] == slot)
+                        ok = 0;
+                }
+                taken[k] = slot;
+            }
+            if (!ok)
+                continue;
+
+            for (int k = 0; k < bucket->count; k++)
+                slots[taken[k]] = bucket->keys[k];
+            displacement[bucket->index] = d;
+            break;
+        }
+        if (d == MAX_DISPLACEMENT)
+        {
+            fprintf(stderr, "%s: no displacement found, adjust perfect_hash.h\n", table);
+            return -1;
+        }
+    }
+
+    printf("#define %s_HASH_BUCKETS %zu\n", macro, bucket_count);
+    printf("#define %s_HASH_SIZE %zu\n\n", macro, size);
+
+    printf("static const uint32_t %s_hash_displacement[%s_HASH_BUCKETS] = {", table, macro);
+    for (size_t b = 0; b < bucket_count; b++)
+        printf("%s%u,", (b % 12) ? " " : "\n    ", displacement[b]);
+    printf("\n};\n\n");
+
+    printf("// Slot -> ID, in .def order\n");
+    printf("static const uint8_t %s_hash_slots[%s_HASH_SIZE] = {", table, macro);
+    for (size_t i = 0; i < size; i++)
+        printf("%s%d,", (i % 16) ? " " : "\n    ", slots[i]);
+    printf("\n};\n\n");
+
+    free(slots);
+    free(displacement);
+    free(buckets);
+    free(keys);
+    return 0;
+}
+
+int main(void)
+{
+    printf("// Generated by tools/gen_perfect_hash.c from src/http_headers.def and\n"
+           "// src/http_methods.def. Do not edit; run `make` after changing the tables.\n\n"
+           "#ifndef HTTP_PERFECT_HASH_H\n"
+           "#define HTTP_PERFECT_HASH_H\n\n"
+           "#include <stdint.h>\n\n");
+
+    if (generate("HTTP_HEADER", "http_header", header_names, sizeof(header_names) / sizeof(header_names[0])) < 0)
+        return 1;
+    if (generate("HTTP_METHOD", "http_method", method_names, sizeof(method_names) / sizeof(method_names[0])) < 0)
+        return 1;
+
+    printf("#endif\n");
+    return 0;
+}